@@ -3,6 +3,8 @@
 #include <boilerplate/std.hpp>
 
 #include <chrono>
+#include <cstdint>
+#include <x86intrin.h>
 
 struct data
 {
@@ -17,6 +19,29 @@ struct data
   return {uint8_t((ecx & 0xFFF000U) >> 12U), uint8_t(ecx & 0xFFFU), (uint64_t(edx) << 32U) | eax}; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 }
 
+// converts TSC ticks to nanoseconds, assuming an invariant TSC (see contrib/production/tsc_calibrate)
+struct tsc_clock
+{
+  double ticks_per_ns = 1.;
+
+  [[nodiscard]] static std::uint64_t ticks() noexcept { return __rdtsc(); }
+
+  // busy-waits for the calibration period
+  [[nodiscard]] static tsc_clock calibrate(const std::chrono::nanoseconds &period = std::chrono::milliseconds(10)) noexcept
+  {
+    const auto start_time = std::chrono::steady_clock::now();
+    const auto start_ticks = ticks();
+    auto end_time = start_time;
+    while(end_time - start_time < period)
+      end_time = std::chrono::steady_clock::now();
+    const auto end_ticks = ticks();
+    return {static_cast<double>(end_ticks - start_ticks) / static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count())};
+  }
+
+  [[nodiscard]] std::uint64_t to_ticks(const std::chrono::nanoseconds &duration) const noexcept { return static_cast<std::uint64_t>(static_cast<double>(duration.count()) * ticks_per_ns); }
+  [[nodiscard]] std::chrono::nanoseconds to_duration(std::int64_t ticks) const noexcept { return std::chrono::nanoseconds(static_cast<std::int64_t>(static_cast<double>(ticks) / ticks_per_ns)); }
+};
+
 struct incomplete_nano_clock
 {
   using rep = std::int64_t;
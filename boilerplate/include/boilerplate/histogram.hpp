@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+// Latencies in power of 2 buckets of nanoseconds: constant time to record, off the fast path or not, and percentiles as the upper bound of their
+// bucket.
+class latency_histogram
+{
+public:
+  void record(const std::chrono::nanoseconds &latency) noexcept
+  {
+    const auto ns = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(latency.count(), 0));
+    ++buckets_[std::bit_width(ns)];
+    ++count_;
+    sum_ += ns;
+    max_ = std::max(max_, ns);
+  }
+
+  [[nodiscard]] std::uint64_t count() const noexcept { return count_; }
+  [[nodiscard]] std::chrono::nanoseconds max() const noexcept { return std::chrono::nanoseconds(max_); }
+  [[nodiscard]] std::chrono::nanoseconds mean() const noexcept { return std::chrono::nanoseconds(count_ ? sum_ / count_ : 0); }
+
+  // ratio in [0, 1]
+  [[nodiscard]] std::chrono::nanoseconds percentile(double ratio) const noexcept
+  {
+    const auto rank = static_cast<std::uint64_t>(ratio * static_cast<double>(count_));
+    std::uint64_t seen = 0;
+    for(std::size_t i = 0; i != buckets_.size(); ++i)
+      if((seen += buckets_[i]) > rank)
+        return std::chrono::nanoseconds(i < 64 ? std::min((std::uint64_t {1} << i) - 1, max_) : max_);
+    return max();
+  }
+
+private:
+  std::array<std::uint64_t, 65> buckets_ {};
+  std::uint64_t count_ = 0, sum_ = 0, max_ = 0;
+};
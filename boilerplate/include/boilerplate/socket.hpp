@@ -9,18 +9,37 @@
 #include <asio/buffer.hpp>
 #include <asio/ip/multicast.hpp>
 #include <asio/ip/udp.hpp>
+#include <asio/posix/stream_descriptor.hpp>
 
 #include <gsl/util>
 
 #include <range/v3/view/take.hpp>
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
 #include <concepts>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <span>
 #if defined(LINUX)
+#  include <linux/errqueue.h>
+#  include <linux/filter.h>
 #  include <linux/net_tstamp.h>
 #  include <sched.h>
 #endif // defined(LINUX)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 #if defined(USE_TCPDIRECT)
 #  include <etherfabric/pd.h>
@@ -33,6 +52,33 @@
 #  include <vma/vma_extra.h>
 #endif // defined(USE_LIBVMA)
 
+#if defined(USE_IO_URING)
+#  include <liburing.h>
+#endif // defined(USE_IO_URING)
+
+#if defined(USE_AF_XDP)
+#  include <arpa/inet.h>
+#  include <bpf/bpf.h>
+#  include <bpf/libbpf.h>
+#  include <linux/bpf.h>
+#  include <linux/if_ether.h>
+#  include <linux/if_link.h>
+#  include <linux/if_xdp.h>
+#  include <net/if.h>
+#  include <sys/mman.h>
+#  include <xdp/xsk.h>
+#endif // defined(USE_AF_XDP)
+
+#if defined(USE_PACKET_MMAP)
+#  include <arpa/inet.h>
+#  include <linux/if_ether.h>
+#  include <linux/if_packet.h>
+#  include <net/if.h>
+#  include <poll.h>
+#  include <sys/mman.h>
+#  include <atomic>
+#endif // defined(USE_PACKET_MMAP)
+
 #if defined(USE_TCPDIRECT)
 
 struct deleters
@@ -123,6 +169,983 @@ private:
 };
 #endif
 
+#if !defined(USE_TCPDIRECT)
+// Where the RX timestamps come from: the NIC (the NIC has to stamp the packets too, see hwstamp_ctl), the kernel on reception, or network_clock (a
+// vDSO read of the TSC) when the datagram is dequeued. A datagram without the timestamp asked for falls back on the next best one, and is counted.
+enum class rx_timestamping : std::uint8_t
+{
+  dequeue,
+  software,
+  hardware,
+};
+
+class rx_timestamps
+{
+public:
+#  if defined(LINUX)
+  // the control buffer of a datagram: one of SO_TIMESTAMPING or SO_TIMESTAMPNS
+  static constexpr std::size_t control_size = CMSG_SPACE(sizeof(::scm_timestamping)) + CMSG_SPACE(sizeof(std::timespec));
+#  else  // defined(LINUX)
+  static constexpr std::size_t control_size = 0;
+#  endif // defined(LINUX)
+
+  explicit rx_timestamps(rx_timestamping source = rx_timestamping::dequeue) noexcept: source_(source) {}
+
+#  if defined(LINUX)
+  // SO_TIMESTAMPING flags, 0 for none: a hardware timestamp comes with the software one, as a fallback
+  static constexpr int flags(rx_timestamping source) noexcept
+  {
+    switch(source)
+    {
+    case rx_timestamping::dequeue: return 0;
+    case rx_timestamping::software: return SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    case rx_timestamping::hardware:
+      return SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    }
+    return 0;
+  }
+#  endif // defined(LINUX)
+
+  [[nodiscard]] rx_timestamping source() const noexcept { return source_; }
+  [[nodiscard]] bool from_control() const noexcept { return source_ != rx_timestamping::dequeue; }
+  // datagrams stamped at dequeue as the kernel gave none
+  [[nodiscard]] std::uint64_t nb_missing() const noexcept { return nb_missing_; }
+  // datagrams stamped by the kernel as the NIC gave none
+  [[nodiscard]] std::uint64_t nb_fallbacks() const noexcept { return nb_fallbacks_; }
+
+  // the timestamp of a datagram from its control messages, whose layout depends on the backend, given the time of the dequeue of its batch
+  template<typename cmsgs_type>
+  [[using gnu: always_inline, hot]] inline network_clock::time_point operator()(cmsgs_type &&cmsgs, const network_clock::time_point &dequeued) noexcept
+  {
+#  if defined(LINUX)
+    if(source_ == rx_timestamping::dequeue)
+      return dequeued;
+    for(const ::cmsghdr *cmsg: cmsgs)
+    {
+      if(cmsg->cmsg_level != SOL_SOCKET)
+        continue;
+      switch(cmsg->cmsg_type)
+      {
+      case SO_TIMESTAMPNS: return to_time_point<network_clock>(*reinterpret_cast<const std::timespec *>(CMSG_DATA(cmsg)));
+      case SO_TIMESTAMPING:
+      {
+        // ts[0]: software, ts[2]: raw hardware
+        const auto *timestamps = reinterpret_cast<const ::scm_timestamping *>(CMSG_DATA(cmsg));
+        if(source_ == rx_timestamping::hardware)
+        {
+          if(LIKELY(timestamps->ts[2].tv_sec || timestamps->ts[2].tv_nsec))
+            return to_time_point<network_clock>(timestamps->ts[2]);
+          ++nb_fallbacks_;
+        }
+        if(LIKELY(timestamps->ts[0].tv_sec || timestamps->ts[0].tv_nsec))
+          return to_time_point<network_clock>(timestamps->ts[0]);
+        break;
+      }
+      }
+    }
+    ++nb_missing_;
+#  endif // defined(LINUX)
+    return dequeued;
+  }
+
+  // the timestamp of a datagram stamped by the kernel, with the one of the NIC or not
+  [[using gnu: always_inline, hot]] inline network_clock::time_point operator()(const std::timespec &timestamp, bool from_hardware,
+                                                                                const network_clock::time_point &dequeued) noexcept
+  {
+    if(source_ == rx_timestamping::dequeue)
+      return dequeued;
+    if(source_ == rx_timestamping::hardware && !from_hardware) [[unlikely]]
+      ++nb_fallbacks_;
+    return to_time_point<network_clock>(timestamp);
+  }
+
+  // the timestamp of a datagram without control messages
+  [[using gnu: always_inline, hot]] inline network_clock::time_point operator()(const network_clock::time_point &dequeued) noexcept
+  {
+    if(source_ != rx_timestamping::dequeue)
+      ++nb_missing_;
+    return dequeued;
+  }
+
+private:
+  rx_timestamping source_;
+  std::uint64_t nb_missing_ = 0, nb_fallbacks_ = 0;
+};
+
+// the control messages of a msghdr, as a range
+class cmsgs
+{
+public:
+  explicit cmsgs(const ::msghdr &msghdr) noexcept: msghdr_(&msghdr) {}
+
+  struct iterator
+  {
+    const ::msghdr *msghdr;
+    ::cmsghdr *cmsg;
+
+    const ::cmsghdr *operator*() const noexcept { return cmsg; }
+    iterator &operator++() noexcept
+    {
+      cmsg = CMSG_NXTHDR(const_cast<::msghdr *>(msghdr), cmsg); // NOLINT(cppcoreguidelines-pro-type-cstyle-cast,cppcoreguidelines-pro-type-const-cast)
+      return *this;
+    }
+    bool operator!=(std::nullptr_t) const noexcept { return cmsg; }
+  };
+
+  [[nodiscard]] iterator begin() const noexcept { return {msghdr_, CMSG_FIRSTHDR(msghdr_)}; } // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  [[nodiscard]] std::nullptr_t end() const noexcept { return nullptr; }
+
+private:
+  const ::msghdr *msghdr_;
+};
+#endif // !defined(USE_TCPDIRECT)
+
+#if defined(USE_IO_URING)
+// The memory the kernel is given for a ring, page aligned: freed with the same alignment it was allocated with
+constexpr std::size_t uring_page_size = 4'096;
+
+struct page_aligned_delete
+{
+  void operator()(std::byte *ptr) const noexcept { ::operator delete[](ptr, std::align_val_t {uring_page_size}); }
+};
+
+using page_aligned_buffer = std::unique_ptr<std::byte[], page_aligned_delete>;
+
+// null if out of memory
+[[nodiscard]] inline page_aligned_buffer make_page_aligned_buffer(std::size_t size) noexcept
+{
+  return page_aligned_buffer(static_cast<std::byte *>(::operator new[](size, std::align_val_t {uring_page_size}, std::nothrow)));
+}
+
+// A multishot recvmsg on a ring of provided buffers: the kernel picks a buffer per datagram, and the datagram is handed over where it landed.
+// Heap allocated, as the kernel holds on to the addresses of the buffers and of the msghdr.
+class uring_receiver
+{
+  static constexpr unsigned nb_buffers = 1'024; // a power of 2
+  static constexpr unsigned short buffer_group = 0;
+  static constexpr unsigned queue_depth = 8;
+  // the datagrams are cut to the MTU by the publishers (see feed::state_map::set_mtu): bigger ones are truncated, and dropped
+  static constexpr std::size_t buffer_size = 4'096;
+
+public:
+  static boost::leaf::result<std::unique_ptr<uring_receiver>> create(int fd, const std::chrono::nanoseconds &spin_duration, rx_timestamping timestamping,
+                                                                     bool sqpoll) noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    std::unique_ptr<uring_receiver> result(new(std::nothrow) uring_receiver(fd, spin_duration, timestamping));
+    if(!result || !result->buffers) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_enough_memory), ::boilerplate::statement {"uring_receiver"});
+
+    // the submission queue polling thread keeps the syscalls off the fast path, at the cost of a core
+    ::io_uring_params params {};
+    if(sqpoll)
+    {
+      params.flags |= IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = 1'000; // ms
+    }
+    BOOST_LEAF_RC_TRYV(::io_uring_queue_init_params(queue_depth, &result->ring, &params));
+    result->ring_initialized = true;
+
+    int rc = 0;
+    result->buffer_ring = ::io_uring_setup_buf_ring(&result->ring, nb_buffers, buffer_group, 0, &rc);
+    if(!result->buffer_ring) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(-rc, std::generic_category()), ::boilerplate::statement {"io_uring_setup_buf_ring"});
+    for(unsigned i = 0; i < nb_buffers; ++i)
+      ::io_uring_buf_ring_add(result->buffer_ring, result->buffer(i), buffer_size, static_cast<unsigned short>(i), ::io_uring_buf_ring_mask(nb_buffers),
+                              static_cast<int>(i));
+    ::io_uring_buf_ring_advance(result->buffer_ring, nb_buffers);
+
+    BOOST_LEAF_CHECK(result->arm());
+    return result;
+  }
+
+  uring_receiver(const uring_receiver &) = delete;
+  uring_receiver &operator=(const uring_receiver &) = delete;
+
+  ~uring_receiver() noexcept
+  {
+    if(buffer_ring)
+      ::io_uring_free_buf_ring(&ring, buffer_ring, nb_buffers, buffer_group);
+    if(ring_initialized)
+      ::io_uring_queue_exit(&ring);
+  }
+
+  [[using gnu: always_inline, flatten, hot]] inline boost::leaf::result<void> operator()(auto &continuation) noexcept
+  {
+    ::io_uring_cqe *cqe = nullptr;
+    if(::io_uring_peek_cqe(&ring, &cqe) < 0)
+    {
+      // nothing yet: wait for the spin duration, as recvmmsg does
+      auto timeout = ::__kernel_timespec {.tv_sec = spin_duration.tv_sec, .tv_nsec = spin_duration.tv_nsec};
+      if(const auto rc = ::io_uring_wait_cqe_timeout(&ring, &cqe, &timeout); rc == -ETIME || rc == -EINTR)
+        return {};
+      else
+        BOOST_LEAF_RC_TRYV(rc);
+    }
+
+    const auto dequeued = network_clock::now();
+    unsigned head, nb_cqes = 0;
+    int nb_recycled = 0, error = 0;
+    io_uring_for_each_cqe(&ring, head, cqe)
+    {
+      ++nb_cqes;
+      // the multishot request ends on errors, and when out of buffers (-ENOBUFS)
+      if(!(cqe->flags & IORING_CQE_F_MORE))
+        armed = false;
+      if(cqe->res < 0)
+      {
+        if(cqe->res != -ENOBUFS)
+          error = -cqe->res;
+        continue;
+      }
+      if(!(cqe->flags & IORING_CQE_F_BUFFER)) [[unlikely]]
+        continue;
+
+      const auto buffer_id = static_cast<unsigned short>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      auto *const out = ::io_uring_recvmsg_validate(buffer(buffer_id), cqe->res, &msghdr);
+      if(LIKELY(out && !(out->flags & MSG_TRUNC)))
+        continuation(timestamps(recvmsg_cmsgs {out, &msghdr}, dequeued), asio::const_buffer(::io_uring_recvmsg_payload(out, &msghdr),
+                                                        ::io_uring_recvmsg_payload_length(out, cqe->res, &msghdr)));
+      ::io_uring_buf_ring_add(buffer_ring, buffer(buffer_id), buffer_size, buffer_id, ::io_uring_buf_ring_mask(nb_buffers), nb_recycled++);
+    }
+    ::io_uring_buf_ring_advance(buffer_ring, nb_recycled);
+    ::io_uring_cq_advance(&ring, nb_cqes);
+
+    if(error) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(error, std::generic_category()), ::boilerplate::statement {"io_uring recvmsg"});
+    if(!armed) [[unlikely]]
+      BOOST_LEAF_CHECK(arm());
+    return {};
+  }
+
+  [[nodiscard]] const rx_timestamps &timestamps_statistics() const noexcept { return timestamps; }
+
+private:
+  // the control messages of a datagram, where the kernel put it
+  struct recvmsg_cmsgs
+  {
+    ::io_uring_recvmsg_out *out;
+    ::msghdr *msghdr;
+
+    struct iterator
+    {
+      const recvmsg_cmsgs *cmsgs;
+      ::cmsghdr *cmsg;
+
+      const ::cmsghdr *operator*() const noexcept { return cmsg; }
+      iterator &operator++() noexcept
+      {
+        cmsg = ::io_uring_recvmsg_cmsg_nexthdr(cmsgs->out, cmsgs->msghdr, cmsg);
+        return *this;
+      }
+      bool operator!=(std::nullptr_t) const noexcept { return cmsg; }
+    };
+
+    [[nodiscard]] iterator begin() const noexcept { return {this, ::io_uring_recvmsg_cmsg_firsthdr(out, msghdr)}; }
+    [[nodiscard]] std::nullptr_t end() const noexcept { return nullptr; }
+  };
+
+  uring_receiver(int fd, const std::chrono::nanoseconds &spin_duration, rx_timestamping timestamping) noexcept:
+    fd(fd), spin_duration(to_timespec(spin_duration)), timestamps(timestamping),
+    buffers(make_page_aligned_buffer(nb_buffers * buffer_size))
+  {
+    // the layout of each buffer: io_uring_recvmsg_out, no name, the control messages, then the payload
+    msghdr.msg_controllen = rx_timestamps::control_size;
+  }
+
+  std::byte *buffer(unsigned id) noexcept { return buffers.get() + id * buffer_size; }
+
+  boost::leaf::result<void> arm() noexcept
+  {
+    auto *const sqe = ::io_uring_get_sqe(&ring);
+    if(!sqe) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::resource_unavailable_try_again), ::boilerplate::statement {"io_uring_get_sqe"});
+    ::io_uring_prep_recvmsg_multishot(sqe, fd, &msghdr, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+    BOOST_LEAF_RC_TRYV(::io_uring_submit(&ring));
+    armed = true;
+    return {};
+  }
+
+  int fd;
+  std::timespec spin_duration;
+  rx_timestamps timestamps;
+  page_aligned_buffer buffers;
+  ::msghdr msghdr {};
+  ::io_uring ring {};
+  bool ring_initialized = false;
+  ::io_uring_buf_ring *buffer_ring = nullptr;
+  bool armed = false;
+};
+
+// Sends out of registered buffers, queued on a ring and submitted together: all the sends of a pass of the fast path (datagrams and stream
+// writes, whatever their sockets) cost one syscall at most, none with SQPOLL. The payloads are copied once into slots of an arena registered
+// with the ring (a fixed buffer: no page pinning per send). The completions are reaped from the slow path; a slot released while sends are in
+// flight is only reused once they have all completed.
+//
+// A datagram goes whole or not at all, but a stream write may be short: the writes of a stream are linked (one starts once the one before it is
+// complete), and a stream has one chain in flight at a time. A short write cancels the rest of its chain; it is resumed where it stopped, then
+// the cancelled ones, from the next flush.
+class uring_sender
+{
+  static constexpr unsigned queue_depth = 256;
+  static constexpr std::uint64_t write_tag = std::uint64_t {1} << 63; // in the user data: a stream write (its index), or a datagram (its size)
+
+public:
+  static constexpr std::size_t slot_size = 4'096;
+
+  // a payload copied into a slot, given back when destroyed
+  class registration
+  {
+  public:
+    registration(registration &&other) noexcept:
+      sender_(std::exchange(other.sender_, nullptr)), slot_(other.slot_), size_(other.size_)
+    {
+    }
+    registration &operator=(registration &&other) noexcept
+    {
+      if(this != &other)
+      {
+        reset();
+        sender_ = std::exchange(other.sender_, nullptr);
+        slot_ = other.slot_;
+        size_ = other.size_;
+      }
+      return *this;
+    }
+    ~registration() noexcept { reset(); }
+
+    [[nodiscard]] unsigned slot() const noexcept { return slot_; }
+    [[nodiscard]] std::size_t size() const noexcept { return size_; }
+
+  private:
+    friend class uring_sender;
+    registration(uring_sender *sender, unsigned slot, std::size_t size) noexcept: sender_(sender), slot_(slot), size_(size) {}
+
+    void reset() noexcept
+    {
+      if(sender_)
+        std::exchange(sender_, nullptr)->release(slot_);
+    }
+
+    uring_sender *sender_;
+    unsigned slot_;
+    std::size_t size_;
+  };
+
+  static boost::leaf::result<std::unique_ptr<uring_sender>> create(unsigned nb_slots, bool sqpoll) noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    std::unique_ptr<uring_sender> result(new(std::nothrow) uring_sender(nb_slots));
+    if(!result || !result->arena) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_enough_memory), ::boilerplate::statement {"uring_sender"});
+
+    ::io_uring_params params {};
+    if(sqpoll)
+    {
+      params.flags |= IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = 1'000; // ms
+    }
+    BOOST_LEAF_RC_TRYV(::io_uring_queue_init_params(queue_depth, &result->ring, &params));
+    result->ring_initialized = true;
+
+    // the whole arena as one fixed buffer: any slot is a part of it
+    const ::iovec arena_iovec {.iov_base = result->arena.get(), .iov_len = nb_slots * slot_size};
+    BOOST_LEAF_RC_TRYV(::io_uring_register_buffers(&result->ring, &arena_iovec, 1));
+
+    result->free_slots.reserve(nb_slots);
+    for(unsigned slot = nb_slots; slot; --slot)
+      result->free_slots.push_back(slot - 1);
+    result->pending_writes.reserve(queue_depth);
+    result->writes.reserve(queue_depth);
+    result->free_writes.reserve(queue_depth);
+    return result;
+  }
+
+  uring_sender(const uring_sender &) = delete;
+  uring_sender &operator=(const uring_sender &) = delete;
+
+  ~uring_sender() noexcept
+  {
+    if(ring_initialized)
+      ::io_uring_queue_exit(&ring);
+  }
+
+  // from the slow path, or lazily (once per payload)
+  [[using gnu: cold]] boost::leaf::result<registration> register_payload(const asio::const_buffer &payload) noexcept
+  {
+    if(payload.size() > slot_size || free_slots.empty()) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::no_buffer_space), ::boilerplate::statement {"uring_sender::register_payload"});
+    const auto slot = free_slots.back();
+    free_slots.pop_back();
+    std::memcpy(data(slot), payload.data(), payload.size());
+    return registration(this, slot, payload.size());
+  }
+
+  // a datagram, queued until the flush
+  [[using gnu: always_inline, hot]] inline boost::leaf::result<void> send(int fd, const registration &payload) noexcept
+  {
+    BOOST_LEAF_AUTO(sqe, get_sqe());
+    ::io_uring_prep_write_fixed(sqe, fd, data(payload.slot()), static_cast<unsigned>(payload.size()), 0, 0);
+    ::io_uring_sqe_set_data64(sqe, payload.size());
+    ++nb_queued;
+    ++nb_in_flight;
+    return {};
+  }
+
+  // a stream write, queued until the flush, behind the ones before it on the stream
+  [[using gnu: always_inline, hot]] inline boost::leaf::result<void> write(int fd, const registration &payload) noexcept
+  {
+    pending_writes.push_back({.fd = fd, .slot = payload.slot(), .size = static_cast<unsigned>(payload.size()), .sequence = next_sequence++});
+    return {};
+  }
+
+  // the sends queued, in one syscall
+  [[using gnu: always_inline, hot]] inline boost::leaf::result<void> flush() noexcept
+  {
+    if(!pending_writes.empty()) [[unlikely]]
+      BOOST_LEAF_CHECK(queue_writes());
+    if(!nb_queued)
+      return {};
+    nb_queued = 0;
+    BOOST_LEAF_RC_TRYV(::io_uring_submit(&ring));
+    return {};
+  }
+
+  // the completions so far, from the slow path: no syscall
+  void reap() noexcept
+  {
+    ::io_uring_cqe *cqe = nullptr;
+    unsigned head, nb_cqes = 0;
+    bool resumed = false;
+    io_uring_for_each_cqe(&ring, head, cqe)
+    {
+      ++nb_cqes;
+      const auto user_data = ::io_uring_cqe_get_data64(cqe);
+      if(user_data & write_tag)
+      {
+        resumed |= reap_write(static_cast<std::size_t>(user_data & ~write_tag), cqe->res);
+        continue;
+      }
+      if(cqe->res < 0) [[unlikely]]
+        ++nb_errors_;
+      else if(static_cast<std::uint64_t>(cqe->res) != user_data) [[unlikely]]
+        ++nb_partial_writes_;
+      else
+        ++nb_sent_;
+    }
+    ::io_uring_cq_advance(&ring, nb_cqes);
+    nb_in_flight -= nb_cqes;
+
+    // in the order they were written: the rest of a short write, then the ones cancelled behind it
+    if(resumed) [[unlikely]]
+      std::sort(pending_writes.begin(), pending_writes.end(), [](const auto &lhs, const auto &rhs) noexcept { return lhs.sequence < rhs.sequence; });
+
+    if(!nb_in_flight && pending_writes.empty() && !quarantined_slots.empty())
+    {
+      free_slots.insert(free_slots.end(), quarantined_slots.begin(), quarantined_slots.end());
+      quarantined_slots.clear();
+    }
+  }
+
+  [[nodiscard]] std::uint64_t nb_sent() const noexcept { return nb_sent_; }
+  [[nodiscard]] std::uint64_t nb_errors() const noexcept { return nb_errors_; }
+  [[nodiscard]] std::uint64_t nb_partial_writes() const noexcept { return nb_partial_writes_; }
+
+private:
+  explicit uring_sender(unsigned nb_slots) noexcept:
+    arena(make_page_aligned_buffer(std::size_t {nb_slots} * slot_size))
+  {
+  }
+
+  struct stream_write
+  {
+    int fd;
+    unsigned slot, size, offset = 0; // offset: what a short write already wrote
+    std::uint64_t sequence;
+  };
+
+  struct stream
+  {
+    int fd;
+    unsigned nb_in_flight = 0;
+    bool resuming = false; // a short write: the cancelled writes behind it are written again
+  };
+
+  std::byte *data(unsigned slot) noexcept { return arena.get() + std::size_t {slot} * slot_size; }
+
+  void release(unsigned slot) noexcept
+  {
+    if(nb_in_flight || !pending_writes.empty())
+      quarantined_slots.push_back(slot);
+    else
+      free_slots.push_back(slot);
+  }
+
+  boost::leaf::result<::io_uring_sqe *> get_sqe() noexcept
+  {
+    auto *sqe = ::io_uring_get_sqe(&ring);
+    if(!sqe) [[unlikely]]
+    {
+      BOOST_LEAF_RC_TRYV(::io_uring_submit(&ring));
+      if(sqe = ::io_uring_get_sqe(&ring); !sqe)
+        return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::resource_unavailable_try_again), ::boilerplate::statement {"io_uring_get_sqe"});
+    }
+    return sqe;
+  }
+
+  stream &stream_of(int fd) noexcept
+  {
+    const auto it = std::find_if(streams.begin(), streams.end(), [fd](const auto &stream) noexcept { return stream.fd == fd; });
+    return it != streams.end() ? *it : streams.emplace_back(stream {.fd = fd});
+  }
+
+  // the pending writes of the streams without a chain in flight, one chain per stream: adjacent in the queue, each one linked to the next. A
+  // chain is never split by a submit: what does not fit in the submission queue waits for the chain to complete
+  boost::leaf::result<void> queue_writes() noexcept
+  {
+    if(::io_uring_sq_space_left(&ring) < pending_writes.size()) [[unlikely]]
+      BOOST_LEAF_RC_TRYV(::io_uring_submit(&ring));
+
+    for(std::size_t first = 0; first != pending_writes.size();)
+    {
+      auto &stream = stream_of(pending_writes[first].fd);
+      if(stream.nb_in_flight) [[unlikely]]
+      {
+        ++first;
+        continue;
+      }
+      ::io_uring_sqe *previous = nullptr;
+      for(auto it = pending_writes.begin() + static_cast<std::ptrdiff_t>(first); it != pending_writes.end();)
+      {
+        if(it->fd != stream.fd)
+        {
+          ++it;
+          continue;
+        }
+        auto *const sqe = ::io_uring_get_sqe(&ring);
+        if(!sqe) [[unlikely]]
+          return {};
+        ::io_uring_prep_write_fixed(sqe, it->fd, data(it->slot) + it->offset, it->size - it->offset, 0, 0);
+        std::size_t index;
+        if(free_writes.empty())
+        {
+          index = writes.size();
+          writes.push_back(*it);
+        }
+        else
+        {
+          index = free_writes.back();
+          free_writes.pop_back();
+          writes[index] = *it;
+        }
+        ::io_uring_sqe_set_data64(sqe, write_tag | index);
+        if(previous)
+          previous->flags |= IOSQE_IO_LINK;
+        previous = sqe;
+        ++stream.nb_in_flight;
+        ++nb_queued;
+        ++nb_in_flight;
+        it = pending_writes.erase(it);
+      }
+      stream.resuming = false;
+    }
+    return {};
+  }
+
+  // true if written again. The completion of a short write comes before the ones of the writes it cancelled
+  bool reap_write(std::size_t index, int result) noexcept
+  {
+    auto write = writes[index];
+    free_writes.push_back(index);
+    auto &stream = stream_of(write.fd);
+    --stream.nb_in_flight;
+
+    if(result == -ECANCELED && stream.resuming) [[unlikely]]
+    {
+      pending_writes.push_back(write);
+      return true;
+    }
+    if(result < 0) [[unlikely]]
+    {
+      ++nb_errors_;
+      return false;
+    }
+    if(write.offset += static_cast<unsigned>(result); write.offset != write.size) [[unlikely]]
+    {
+      ++nb_partial_writes_;
+      stream.resuming = true;
+      pending_writes.push_back(write);
+      return true;
+    }
+    ++nb_sent_;
+    return false;
+  }
+
+  page_aligned_buffer arena;
+  std::vector<unsigned> free_slots {}, quarantined_slots {};
+  ::io_uring ring {};
+  bool ring_initialized = false;
+  unsigned nb_queued = 0;
+  std::uint64_t nb_in_flight = 0, nb_sent_ = 0, nb_errors_ = 0, nb_partial_writes_ = 0;
+  std::vector<stream_write> pending_writes {}, writes {}; // writes: the ones in flight, by index
+  std::vector<std::size_t> free_writes {};
+  std::vector<stream> streams {};
+  std::uint64_t next_sequence = 0;
+};
+#endif // defined(USE_IO_URING)
+
+#if defined(USE_AF_XDP)
+// AF_XDP: an XDP program redirects the datagrams of the group and port to an XSK socket, on one queue of the interface; the others go on to the
+// stack. The datagrams land in a UMEM (huge pages if available), the fast path polls the RX ring and gives the frames back through the fill ring.
+// The traffic is to be steered to the queue (a single queue interface, or ethtool -N <interface> flow-type udp4 dst-ip <group> dst-port <port>
+// action <queue>). Generic mode (copy) works on any interface, veth included; zero copy needs driver support.
+class xdp_receiver
+{
+  static constexpr std::uint32_t nb_frames = 4'096;
+  static constexpr std::uint32_t frame_size = XSK_UMEM__DEFAULT_FRAME_SIZE;
+  static constexpr std::size_t umem_size = std::size_t {nb_frames} * frame_size;
+  static constexpr std::uint32_t batch_size = 64;
+  static constexpr std::uint32_t headers_size = sizeof(::ethhdr) + 20 + 8; // no IP options (filtered out)
+
+public:
+  static boost::leaf::result<std::unique_ptr<xdp_receiver>> create(const asio::ip::udp::endpoint &endpoint, std::string_view interface, std::uint32_t queue,
+                                                                   bool zero_copy) noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    std::unique_ptr<xdp_receiver> result(new(std::nothrow) xdp_receiver);
+    if(!result) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_enough_memory), ::boilerplate::statement {"xdp_receiver"});
+
+    result->ifindex = ::if_nametoindex(std::string(interface).c_str());
+    if(!result->ifindex) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"if_nametoindex"});
+    result->xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST | (zero_copy ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE);
+
+    // huge pages keep the UMEM in a few TLB entries
+    result->umem_area = ::mmap(nullptr, umem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if(result->umem_area == MAP_FAILED)
+      result->umem_area = ::mmap(nullptr, umem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(result->umem_area == MAP_FAILED) [[unlikely]]
+    {
+      result->umem_area = nullptr;
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"mmap"});
+    }
+
+    const ::xsk_umem_config umem_config {
+      .fill_size = nb_frames, .comp_size = XSK_RING_CONS__DEFAULT_NUM_DESCS, .frame_size = frame_size, .frame_headroom = 0, .flags = 0};
+    BOOST_LEAF_RC_TRYV(::xsk_umem__create(&result->umem, result->umem_area, umem_size, &result->fill, &result->completion, &umem_config));
+
+    // the program is ours: libxdp is not to load its default one
+    const ::xsk_socket_config socket_config {.rx_size = nb_frames,
+                                             .tx_size = 0,
+                                             .libxdp_flags = XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD,
+                                             .xdp_flags = result->xdp_flags,
+                                             .bind_flags = static_cast<std::uint16_t>(XDP_USE_NEED_WAKEUP | (zero_copy ? XDP_ZEROCOPY : XDP_COPY))};
+    BOOST_LEAF_RC_TRYV(::xsk_socket__create(&result->socket, std::string(interface).c_str(), queue, result->umem, &result->rx, nullptr, &socket_config));
+
+    result->map_fd = ::bpf_map_create(BPF_MAP_TYPE_XSKMAP, "feed_xsks", sizeof(std::uint32_t), sizeof(std::uint32_t), 64, nullptr);
+    BOOST_LEAF_RC_TRYV(result->map_fd);
+    const auto socket_fd = ::xsk_socket__fd(result->socket);
+    BOOST_LEAF_RC_TRYV(::bpf_map_update_elem(result->map_fd, &queue, &socket_fd, BPF_ANY));
+
+    const auto program = make_program(endpoint, result->map_fd);
+    result->program_fd = ::bpf_prog_load(BPF_PROG_TYPE_XDP, "feed_xdp", "GPL", program.data(), program.size(), nullptr);
+    BOOST_LEAF_RC_TRYV(result->program_fd);
+    BOOST_LEAF_RC_TRYV(::bpf_xdp_attach(static_cast<int>(result->ifindex), result->program_fd, result->xdp_flags, nullptr));
+    result->attached = true;
+
+    // all the frames to the kernel
+    std::uint32_t index = 0;
+    if(::xsk_ring_prod__reserve(&result->fill, nb_frames, &index) != nb_frames) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::no_buffer_space), ::boilerplate::statement {"xsk_ring_prod__reserve"});
+    for(std::uint32_t i = 0; i < nb_frames; ++i)
+      *::xsk_ring_prod__fill_addr(&result->fill, index++) = std::uint64_t {i} * frame_size;
+    ::xsk_ring_prod__submit(&result->fill, nb_frames);
+
+    return result;
+  }
+
+  xdp_receiver(const xdp_receiver &) = delete;
+  xdp_receiver &operator=(const xdp_receiver &) = delete;
+
+  ~xdp_receiver() noexcept
+  {
+    if(attached)
+      ::bpf_xdp_detach(static_cast<int>(ifindex), xdp_flags, nullptr);
+    if(program_fd >= 0)
+      ::close(program_fd);
+    if(socket)
+      ::xsk_socket__delete(socket);
+    if(map_fd >= 0)
+      ::close(map_fd);
+    if(umem)
+      ::xsk_umem__delete(umem);
+    if(umem_area)
+      ::munmap(umem_area, umem_size);
+  }
+
+  [[using gnu: always_inline, flatten, hot]] inline boost::leaf::result<void> operator()(auto &continuation) noexcept
+  {
+    std::uint32_t rx_index = 0;
+    const auto nb_received = ::xsk_ring_cons__peek(&rx, batch_size, &rx_index);
+    if(!nb_received)
+    {
+      // the kernel waits for a kick to go on filling
+      if(::xsk_ring_prod__needs_wakeup(&fill))
+        ::recvfrom(::xsk_socket__fd(socket), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+      return {};
+    }
+
+    // no RX timestamp on this path (short of XDP metadata): the dequeue time
+    const auto timestamp = timestamps(network_clock::now());
+    std::uint32_t fill_index = 0;
+    while(::xsk_ring_prod__reserve(&fill, nb_received, &fill_index) != nb_received) [[unlikely]]
+      ;
+    for(std::uint32_t i = 0; i < nb_received; ++i)
+    {
+      const auto *descriptor = ::xsk_ring_cons__rx_desc(&rx, rx_index + i);
+      const auto *frame = static_cast<const std::byte *>(::xsk_umem__get_data(umem_area, descriptor->addr));
+      std::uint16_t udp_length;
+      std::memcpy(&udp_length, frame + headers_size - 4, sizeof(udp_length));
+      const auto payload_size = std::min<std::size_t>(ntohs(udp_length) - 8u, descriptor->len - headers_size);
+      continuation(timestamp, asio::const_buffer(frame + headers_size, payload_size));
+      *::xsk_ring_prod__fill_addr(&fill, fill_index + i) = descriptor->addr;
+    }
+    ::xsk_ring_prod__submit(&fill, nb_received);
+    ::xsk_ring_cons__release(&rx, nb_received);
+    return {};
+  }
+
+  [[nodiscard]] const rx_timestamps &timestamps_statistics() const noexcept { return timestamps; }
+
+private:
+  xdp_receiver() noexcept = default;
+
+  static constexpr ::bpf_insn instruction(std::uint8_t code, std::uint8_t dst, std::uint8_t src, std::int16_t offset, std::int32_t immediate) noexcept
+  {
+    return {.code = code, .dst_reg = dst, .src_reg = src, .off = offset, .imm = immediate};
+  }
+
+  // IPv4 (no options) UDP to the group and port: to the XSK of the queue; anything else: to the stack. The comparisons are made on the values as
+  // loaded, in network order.
+  static std::array<::bpf_insn, 24> make_program(const asio::ip::udp::endpoint &endpoint, int map_fd) noexcept
+  {
+    const auto group = std::bit_cast<std::int32_t>(endpoint.address().to_v4().to_bytes());
+    const auto port = static_cast<std::int32_t>(htons(endpoint.port()));
+    constexpr std::int16_t pass = 22;
+    const auto to_pass = [](std::int16_t pc) { return static_cast<std::int16_t>(pass - pc - 1); };
+    // clang-format off
+    return {
+      instruction(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),                                // r6 = ctx
+      instruction(BPF_LDX | BPF_W | BPF_MEM, 2, 1, offsetof(::xdp_md, data), 0),           // r2 = data
+      instruction(BPF_LDX | BPF_W | BPF_MEM, 3, 1, offsetof(::xdp_md, data_end), 0),       // r3 = data_end
+      instruction(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+      instruction(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, headers_size),
+      instruction(BPF_JMP | BPF_JGT | BPF_X, 4, 3, to_pass(5), 0),                         // too short
+      instruction(BPF_LDX | BPF_H | BPF_MEM, 5, 2, offsetof(::ethhdr, h_proto), 0),
+      instruction(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, to_pass(7), htons(ETH_P_IP)),
+      instruction(BPF_LDX | BPF_B | BPF_MEM, 5, 2, sizeof(::ethhdr), 0),                   // version and header length
+      instruction(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, to_pass(9), 0x45),
+      instruction(BPF_LDX | BPF_B | BPF_MEM, 5, 2, sizeof(::ethhdr) + 9, 0),               // protocol
+      instruction(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, to_pass(11), IPPROTO_UDP),
+      instruction(BPF_LDX | BPF_W | BPF_MEM, 5, 2, sizeof(::ethhdr) + 16, 0),              // destination address
+      instruction(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, to_pass(13), group),
+      instruction(BPF_LDX | BPF_H | BPF_MEM, 5, 2, sizeof(::ethhdr) + 20 + 2, 0),          // destination port
+      instruction(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, to_pass(15), port),
+      instruction(BPF_LDX | BPF_W | BPF_MEM, 2, 6, offsetof(::xdp_md, rx_queue_index), 0), // r2 = queue
+      instruction(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd),             // r1 = map
+      instruction(0, 0, 0, 0, 0),
+      instruction(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),                         // to the stack if no socket on the queue
+      instruction(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+      instruction(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+      instruction(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),                         // pass:
+      instruction(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    // clang-format on
+  }
+
+  unsigned ifindex = 0;
+  std::uint32_t xdp_flags = 0;
+  void *umem_area = nullptr;
+  ::xsk_umem *umem = nullptr;
+  ::xsk_ring_prod fill {};
+  ::xsk_ring_cons completion {};
+  ::xsk_socket *socket = nullptr;
+  ::xsk_ring_cons rx {};
+  int map_fd = -1;
+  int program_fd = -1;
+  bool attached = false;
+  rx_timestamps timestamps {};
+};
+#endif // defined(USE_AF_XDP)
+
+#if defined(USE_PACKET_MMAP)
+// A TPACKET_V3 ring of an AF_PACKET socket, filtered in the kernel on the group and port: the fast path walks the blocks handed over by the kernel
+// and decodes in place, without a syscall. The kernel stamps each packet (software, or hardware with PACKET_TIMESTAMP) in ns.
+class packet_receiver
+{
+  static constexpr unsigned block_size = 1U << 20U, nb_blocks = 64, frame_size = 2'048;
+  static constexpr std::size_t ring_size = std::size_t {block_size} * nb_blocks;
+  static constexpr unsigned block_timeout = 1; // ms, a block is handed over when full or on timeout
+
+public:
+  // all the interfaces if none given
+  static boost::leaf::result<std::unique_ptr<packet_receiver>> create(const asio::ip::udp::endpoint &endpoint, std::string_view interface,
+                                                                      const std::chrono::nanoseconds &spin_duration, rx_timestamping timestamping) noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    std::unique_ptr<packet_receiver> result(new(std::nothrow) packet_receiver(spin_duration, timestamping));
+    if(!result) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_enough_memory), ::boilerplate::statement {"packet_receiver"});
+
+    unsigned ifindex = 0;
+    if(!interface.empty())
+    {
+      ifindex = ::if_nametoindex(std::string(interface).c_str());
+      if(!ifindex) [[unlikely]]
+        return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"if_nametoindex"});
+    }
+
+    result->fd = ::socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+    if(result->fd < 0) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"socket(AF_PACKET)"});
+
+    const auto set_option = [&](int level, int name, const auto &value) noexcept -> boost::leaf::result<void> {
+      if(::setsockopt(result->fd, level, name, &value, sizeof(value)) < 0) [[unlikely]]
+        return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"setsockopt"});
+      return {};
+    };
+
+    // filtered before the bind, not to let anything else in the ring
+    const auto filter = make_filter(endpoint);
+    const ::sock_fprog program {.len = static_cast<unsigned short>(filter.size()), .filter = const_cast<::sock_filter *>(filter.data())};
+    BOOST_LEAF_CHECK(set_option(SOL_SOCKET, SO_ATTACH_FILTER, program));
+    BOOST_LEAF_CHECK(set_option(SOL_PACKET, PACKET_IGNORE_OUTGOING, 1));
+    BOOST_LEAF_CHECK(set_option(SOL_PACKET, PACKET_VERSION, static_cast<int>(TPACKET_V3)));
+    if(timestamping == rx_timestamping::hardware)
+      BOOST_LEAF_CHECK(set_option(SOL_PACKET, PACKET_TIMESTAMP, static_cast<int>(SOF_TIMESTAMPING_RAW_HARDWARE)));
+    const ::tpacket_req3 request {.tp_block_size = block_size,
+                                  .tp_block_nr = nb_blocks,
+                                  .tp_frame_size = frame_size,
+                                  .tp_frame_nr = static_cast<unsigned>(ring_size / frame_size),
+                                  .tp_retire_blk_tov = block_timeout,
+                                  .tp_sizeof_priv = 0,
+                                  .tp_feature_req_word = 0};
+    BOOST_LEAF_CHECK(set_option(SOL_PACKET, PACKET_RX_RING, request));
+
+    result->ring = ::mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, result->fd, 0);
+    if(result->ring == MAP_FAILED) [[unlikely]]
+    {
+      result->ring = nullptr;
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"mmap"});
+    }
+
+    const ::sockaddr_ll address {.sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_IP), .sll_ifindex = static_cast<int>(ifindex)};
+    if(::bind(result->fd, reinterpret_cast<const ::sockaddr *>(&address), sizeof(address)) < 0) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"bind(AF_PACKET)"});
+
+    return result;
+  }
+
+  // drops everything, for the socket only there to join the group
+  static boost::leaf::result<void> mute(int fd) noexcept
+  {
+    ::sock_filter drop_all[] = {BPF_STMT(BPF_RET | BPF_K, 0)};
+    const ::sock_fprog program {.len = 1, .filter = drop_all};
+    if(::setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"setsockopt(SO_ATTACH_FILTER)"});
+    return {};
+  }
+
+  packet_receiver(const packet_receiver &) = delete;
+  packet_receiver &operator=(const packet_receiver &) = delete;
+
+  ~packet_receiver() noexcept
+  {
+    if(ring)
+      ::munmap(ring, ring_size);
+    if(fd >= 0)
+      ::close(fd);
+  }
+
+  [[using gnu: always_inline, flatten, hot]] inline boost::leaf::result<void> operator()(auto &continuation) noexcept
+  {
+    auto *block = reinterpret_cast<::tpacket_block_desc *>(static_cast<std::byte *>(ring) + std::size_t {current_block} * block_size);
+    if(!(std::atomic_ref(block->hdr.bh1.block_status).load(std::memory_order_acquire) & TP_STATUS_USER))
+    {
+      // nothing yet: busy poll the ring, or wait for the spin duration
+      if(spin_duration.tv_sec || spin_duration.tv_nsec)
+      {
+        ::pollfd poll_fd {.fd = fd, .events = POLLIN | POLLERR, .revents = 0};
+        if(::ppoll(&poll_fd, 1, &spin_duration, nullptr) < 0 && errno != EINTR) [[unlikely]]
+          return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"ppoll"});
+      }
+      return {};
+    }
+
+    const auto dequeued = network_clock::now();
+    const auto *packet = reinterpret_cast<const std::byte *>(block) + block->hdr.bh1.offset_to_first_pkt;
+    for(auto n = block->hdr.bh1.num_pkts; n; --n)
+    {
+      const auto *header = reinterpret_cast<const ::tpacket3_hdr *>(packet);
+      const auto *ip = packet + header->tp_mac + sizeof(::ethhdr);
+      // the filter let only UDP datagrams to the group and port in
+      const auto *udp = ip + 4 * (std::to_integer<unsigned>(ip[0]) & 0xFU);
+      std::uint16_t udp_length;
+      std::memcpy(&udp_length, udp + 4, sizeof(udp_length));
+      const auto available = header->tp_snaplen - static_cast<std::size_t>(udp + 8 - (packet + header->tp_mac));
+      const std::timespec timestamp {.tv_sec = header->tp_sec, .tv_nsec = header->tp_nsec};
+      continuation(timestamps(timestamp, header->tp_status & TP_STATUS_TS_RAW_HARDWARE, dequeued), asio::const_buffer(udp + 8, std::min<std::size_t>(ntohs(udp_length) - 8U, available)));
+      packet += header->tp_next_offset;
+    }
+
+    std::atomic_ref(block->hdr.bh1.block_status).store(TP_STATUS_KERNEL, std::memory_order_release);
+    current_block = (current_block + 1) % nb_blocks;
+    return {};
+  }
+
+  [[nodiscard]] const rx_timestamps &timestamps_statistics() const noexcept { return timestamps; }
+
+private:
+  packet_receiver(const std::chrono::nanoseconds &spin_duration, rx_timestamping timestamping) noexcept:
+    spin_duration(to_timespec(spin_duration)), timestamps(timestamping)
+  {
+  }
+
+  // classic BPF, on the frame from its Ethernet header: IPv4, not a fragment, UDP, to the group and port
+  static std::array<::sock_filter, 13> make_filter(const asio::ip::udp::endpoint &endpoint) noexcept
+  {
+    const auto group = endpoint.address().to_v4().to_uint(); // the loads are in host order
+    const auto port = endpoint.port();
+    // clang-format off
+    return {{
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offsetof(::ethhdr, h_proto)),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 10),
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, sizeof(::ethhdr) + 9),       // protocol
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8),
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, sizeof(::ethhdr) + 6),       // fragment offset
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1FFF, 6, 0),
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, sizeof(::ethhdr) + 16),      // destination address
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, group, 0, 4),
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, sizeof(::ethhdr)),          // X = IP header length
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, sizeof(::ethhdr) + 2),       // destination port
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, 0x40000),                             // whole
+      BPF_STMT(BPF_RET | BPF_K, 0),                                   // dropped
+    }};
+    // clang-format on
+  }
+
+  int fd = -1;
+  void *ring = nullptr;
+  unsigned current_block = 0;
+  std::timespec spin_duration;
+  rx_timestamps timestamps;
+};
+#endif // defined(USE_PACKET_MMAP)
+
 using namespace std::chrono_literals;
 
 //
@@ -140,9 +1163,22 @@ class multicast_udp_reader final : public asio::ip::udp::socket
   static constexpr auto nb_messages = 32;
 
 public:
-#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+#if defined(USE_AF_XDP)
+  static boost::leaf::result<multicast_udp_reader> create(asio::io_context &service, std::string_view address, std::string_view port,
+                                                     std::string_view interface, std::uint32_t queue = 0, bool zero_copy = false) noexcept
+#elif defined(USE_PACKET_MMAP)
+  // all the interfaces if none given
+  static boost::leaf::result<multicast_udp_reader> create(asio::io_context &service, std::string_view address, std::string_view port,
+                                                     const std::chrono::nanoseconds &spin_duration = {},
+                                                     rx_timestamping timestamping = rx_timestamping::dequeue, std::string_view interface = {}) noexcept
+#elif defined(USE_IO_URING)
   static boost::leaf::result<multicast_udp_reader> create(asio::io_context &service, std::string_view address, std::string_view port,
-                                                     const std::chrono::nanoseconds &spin_duration = {}, bool timestamping = false) noexcept
+                                                     const std::chrono::nanoseconds &spin_duration = {},
+                                                     rx_timestamping timestamping = rx_timestamping::dequeue, bool sqpoll = false) noexcept
+#elif defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+  static boost::leaf::result<multicast_udp_reader> create(asio::io_context &service, std::string_view address, std::string_view port,
+                                                     const std::chrono::nanoseconds &spin_duration = {},
+                                                     rx_timestamping timestamping = rx_timestamping::dequeue) noexcept
 #else  // defined(LINUX)) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
   static boost::leaf::result<multicast_udp_reader> create(asio::io_context &service, std::string_view address, std::string_view port) noexcept
 #endif // defined(LINUX)) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
@@ -165,12 +1201,10 @@ public:
     BOOST_LEAF_EC_TRYV(socket.open(endpoint.protocol(), _));
     BOOST_LEAF_EC_TRYV(socket.set_option(asio::ip::udp::socket::reuse_address(true), _));
 
-#  if defined(LINUX) && !defined(USE_LIBVMA)
+#  if defined(LINUX) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP)
     using busy_poll = asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>;
     using incoming_cpu = asio::detail::socket_option::integer<SOL_SOCKET, SO_INCOMING_CPU>;
-    // NOLINTNEXTLINE(hicpp-signed-bitwise)
-    using network_timestamping
-      = asio::detail::socket_option::boolean<SOL_SOCKET, SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_SOFTWARE>;
+    using network_timestamping = asio::detail::socket_option::integer<SOL_SOCKET, SO_TIMESTAMPING>;
 
     const auto cpu = ::sched_getcpu();
 
@@ -179,17 +1213,29 @@ public:
       BOOST_LEAF_EC_TRYV(socket.set_option(busy_poll(int(std::chrono::duration_cast<std::chrono::microseconds>(spin_duration).count())), _));
       BOOST_LEAF_EC_TRYV(socket.set_option(incoming_cpu(cpu), _));
     }
-    if(timestamping)
-      BOOST_LEAF_EC_TRYV(socket.set_option(network_timestamping(true), _));
+    if(const auto flags = rx_timestamps::flags(timestamping); flags)
+      BOOST_LEAF_EC_TRYV(socket.set_option(network_timestamping(flags), _));
 
     // recvmmsg timeout parameter is buggy
     const auto as_timeval = to_timeval(spin_duration);
     BOOST_LEAF_EC_TRYV([&]() {
       _ = std::error_code(::setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &as_timeval, sizeof(as_timeval)), std::generic_category());
     }());
-#  endif // defined(LINUX) && !defined(USE_LIBVMA)
-
+#    if !defined(USE_IO_URING)
+    // no spin duration: a read does not wait at all (a zero SO_RCVTIMEO would wait forever). The ring waits on its own (see uring_receiver)
+    if(spin_duration.count() <= 0)
+      BOOST_LEAF_EC_TRYV(socket.non_blocking(true, _));
+#    endif // !defined(USE_IO_URING)
+#  endif // defined(LINUX) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP)
+
+#  if defined(LINUX) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP)
+    // bound to the port alone, for more groups to be joined (see join), but given the datagrams of its own groups only
+    using multicast_all = asio::detail::socket_option::integer<IPPROTO_IP, IP_MULTICAST_ALL>;
+    BOOST_LEAF_EC_TRYV(socket.set_option(multicast_all(0), _));
+    BOOST_LEAF_EC_TRYV(socket.bind(asio::ip::udp::endpoint(endpoint.protocol(), endpoint.port()), _));
+#  else  // defined(LINUX) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP)
     socket.bind(endpoint);
+#  endif // defined(LINUX) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP)
     BOOST_LEAF_EC_TRYV(socket.set_option(asio::ip::multicast::join_group(endpoint.address()), _));
 
 #  if defined(USE_LIBVMA)
@@ -199,8 +1245,25 @@ public:
       return BOOST_LEAF_NEW_ERROR();
 
     return multicast_udp_reader(std::move(socket), vma_ring_fd);
+#  elif defined(USE_AF_XDP)
+    // the socket is only there to join the group: the datagrams are redirected before reaching it
+    auto receiver = BOOST_LEAF_TRYX(xdp_receiver::create(endpoint, interface, queue, zero_copy));
+    return multicast_udp_reader(std::move(socket), std::move(receiver));
+#  elif defined(USE_PACKET_MMAP)
+    // the socket is only there to join the group: the datagrams are taken from the ring
+    BOOST_LEAF_CHECK(packet_receiver::mute(socket.native_handle()));
+    auto receiver = BOOST_LEAF_TRYX(packet_receiver::create(endpoint, interface, spin_duration, timestamping));
+    return multicast_udp_reader(std::move(socket), std::move(receiver));
+#  elif defined(USE_IO_URING)
+    auto receiver = BOOST_LEAF_TRYX(uring_receiver::create(socket.native_handle(), spin_duration, timestamping, sqpoll));
+    return multicast_udp_reader(std::move(socket), std::move(receiver));
 #  elif defined(USE_RECVMMSG)
-    return multicast_udp_reader(std::move(socket), spin_duration);
+    std::unique_ptr<receive_batch> batch(new(std::nothrow) receive_batch); // NOLINT(cppcoreguidelines-owning-memory)
+    if(!batch) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_enough_memory), ::boilerplate::statement {"multicast_udp_reader"});
+    return multicast_udp_reader(std::move(socket), spin_duration, timestamping, std::move(batch));
+#  elif defined(LINUX)
+    return multicast_udp_reader(std::move(socket), timestamping);
 #  else  // defined(USE_RECVMMSG)
     return multicast_udp_reader(std::move(socket));
 #  endif // defined(USE_LIBVMA)
@@ -236,49 +1299,102 @@ public:
 #elif defined(USE_LIBVMA)
 
     const std::size_t nb_completions = vma_api::instance().socketxtreme_poll(vma_ring_fd_, completions_.data(), completions_.size(), 0);
+    // the hardware timestamps, if the NIC stamps (VMA_HW_TS_CONVERSION)
+    const auto dequeued = network_clock::now();
     for(auto &&completion: completions_ | ranges::views::take(nb_completions))
     {
       assert(completion.events & VMA_SOCKETXTREME_PACKET);
       const auto &packet = completion.packet;
       assert(packet.num_bufs == 1);
-      continuation(to_time_point<network_clock>(packet.hw_timestamp), asio::const_buffer(packet.buff_lst->payload, packet.total_len));
+      const auto timestamp
+        = packet.hw_timestamp.tv_sec || packet.hw_timestamp.tv_nsec ? to_time_point<network_clock>(packet.hw_timestamp) : timestamps_(dequeued);
+      continuation(timestamp, asio::const_buffer(packet.buff_lst->payload, packet.total_len));
     }
     for(auto &&completion: completions_ | ranges::views::take(nb_completions))
       vma_api::instance().socketxtreme_free_vma_packets(&completion.packet, 1);
 
+#elif defined(USE_IO_URING) || defined(USE_AF_XDP) || defined(USE_PACKET_MMAP)
+    BOOST_LEAF_CHECK((*receiver_)(continuation));
+
 #elif defined(USE_RECVMMSG)
     // recvmmsg timeout parameter is buggy
     auto spin_duration = spin_duration_;
-    const std::size_t nb_messages_read = BOOST_LEAF_ERRNO_TRYX(::recvmmsg(native_handle(), msgvec_.data(), nb_messages, MSG_WAITFORONE, &spin_duration), _ > 0);
-
-    const auto get_timestamp = [](msghdr *msg)
+    const auto nb_messages_read = ::recvmmsg(native_handle(), batch_->messages.data(), nb_messages, MSG_WAITFORONE, &spin_duration);
+    if(nb_messages_read < 0)
     {
-      for(auto *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
-      {
-        if(cmsg->cmsg_level != SOL_SOCKET)
-          continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        return {};
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"recvmmsg"});
+    }
 
-        switch(cmsg->cmsg_type)
-        {
-        case SO_TIMESTAMPNS:
-        case SO_TIMESTAMPING: return to_time_point<network_clock>(*reinterpret_cast<const std::timespec *>(CMSG_DATA(cmsg)));
-        }
-      }
-      return network_clock::time_point {};
-    };
+    const auto dequeued = network_clock::now();
+    for(std::size_t i = 0; i != static_cast<std::size_t>(nb_messages_read); ++i)
+    {
+      auto &message = batch_->messages[i];
+      continuation(timestamps_(cmsgs(message.msg_hdr), dequeued), asio::const_buffer(batch_->buffers[i].data(), message.msg_len));
+      // the kernel shrinks it to what it wrote
+      message.msg_hdr.msg_controllen = rx_timestamps::control_size;
+    }
 
-    const auto timestamp = get_timestamp(&msgvec_[0].msg_hdr);
-    for(std::size_t i = 0; i != nb_messages_read; ++i)
-      continuation(timestamp, asio::const_buffer(buffers_[i].data(), msgvec_[i].msg_len));
+#elif defined(LINUX)
+    ::iovec iovec {.iov_base = buffer_.data(), .iov_len = buffer_size};
+    ::msghdr message {.msg_iov = &iovec, .msg_iovlen = 1, .msg_control = control_.data, .msg_controllen = rx_timestamps::control_size};
+    const auto msg_length = ::recvmsg(native_handle(), &message, 0);
+    if(msg_length < 0)
+    {
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        return {};
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"recvmsg"});
+    }
+    continuation(timestamps_(cmsgs(message), network_clock::now()), asio::const_buffer(buffer_.data(), static_cast<std::size_t>(msg_length)));
 
 #else  // defined(USE_TCPDIRECT)
     const auto msg_length = receive(asio::buffer(buffer_.data(), buffer_size));
-    continuation(network_clock::time_point(), asio::const_buffer(buffer_.data(), msg_length));
+    continuation(timestamps_(network_clock::now()), asio::const_buffer(buffer_.data(), msg_length));
 #endif // defined(USE_TCPDIRECT)
 
     return {};
   }
 
+#if !defined(USE_TCPDIRECT)
+  // where the RX timestamps came from, and how many were missing
+#  if defined(USE_IO_URING) || defined(USE_AF_XDP) || defined(USE_PACKET_MMAP)
+  [[nodiscard]] const rx_timestamps &timestamps_statistics() const noexcept { return receiver_->timestamps_statistics(); }
+#  else  // defined(USE_IO_URING) || defined(USE_AF_XDP) || defined(USE_PACKET_MMAP)
+  [[nodiscard]] const rx_timestamps &timestamps_statistics() const noexcept { return timestamps_; }
+#  endif // defined(USE_IO_URING) || defined(USE_AF_XDP) || defined(USE_PACKET_MMAP)
+#endif // !defined(USE_TCPDIRECT)
+
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP)
+  // a classic BPF program run by the kernel on the datagrams of the socket (from the UDP header), before they are queued: an empty one detaches it
+  [[using gnu: cold]] boost::leaf::result<void> filter(std::span<const ::sock_filter> program) noexcept
+  {
+    if(program.empty())
+    {
+      if(::setsockopt(native_handle(), SOL_SOCKET, SO_DETACH_FILTER, nullptr, 0) < 0 && errno != ENOENT) [[unlikely]]
+        return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"setsockopt(SO_DETACH_FILTER)"});
+      return {};
+    }
+    const ::sock_fprog fprog {.len = static_cast<unsigned short>(program.size()), .filter = const_cast<::sock_filter *>(program.data())};
+    if(::setsockopt(native_handle(), SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"setsockopt(SO_ATTACH_FILTER)"});
+    return {};
+  }
+
+  // more groups, on the port of the socket, multiplexed on the same reader
+  [[using gnu: cold]] boost::leaf::result<void> join(const asio::ip::address &group) noexcept
+  {
+    BOOST_LEAF_EC_TRYV(set_option(asio::ip::multicast::join_group(group), _));
+    return {};
+  }
+
+  [[using gnu: cold]] boost::leaf::result<void> leave(const asio::ip::address &group) noexcept
+  {
+    BOOST_LEAF_EC_TRYV(set_option(asio::ip::multicast::leave_group(group), _));
+    return {};
+  }
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP)
+
 private:
 #if defined(USE_TCPDIRECT)
   using zock_ptr = std::unique_ptr<zfur, deleters>;
@@ -290,39 +1406,204 @@ private:
 #elif defined(USE_LIBVMA)
   int vma_ring_fd_;
   std::array<vma_completion_t, 16> completions_;
+  rx_timestamps timestamps_ {rx_timestamping::hardware};
 
   multicast_udp_reader(asio::ip::udp::socket && socket, int vma_ring_fd) noexcept: asio::ip::udp::socket(std::move(socket)), vma_ring_fd_(vma_ring_fd) {}
 
+#elif defined(USE_IO_URING) || defined(USE_AF_XDP) || defined(USE_PACKET_MMAP)
+#  if defined(USE_AF_XDP)
+  using receiver_type = xdp_receiver;
+#  elif defined(USE_PACKET_MMAP)
+  using receiver_type = packet_receiver;
+#  else  // defined(USE_AF_XDP)
+  using receiver_type = uring_receiver;
+#  endif // defined(USE_AF_XDP)
+  std::unique_ptr<receiver_type> receiver_;
+
+  multicast_udp_reader(asio::ip::udp::socket &&socket, std::unique_ptr<receiver_type> &&receiver) noexcept:
+    asio::ip::udp::socket(std::move(socket)), receiver_(std::move(receiver))
+  {
+  }
+
 #elif defined(USE_RECVMMSG)
   std::timespec spin_duration_;
+  rx_timestamps timestamps_;
 
-  std::array<std::array<char, buffer_size>, nb_messages> buffers_ {};
-
-  template<std::size_t... indices>
-  std::array<iovec, nb_messages> make_iovecs(decltype(buffers_) &buffers, [[maybe_unused]] std::index_sequence<indices...> _)
+  // heap allocated, as the msghdrs point into it
+  struct receive_batch
   {
-    return {iovec {.iov_base = buffers[indices].data(), .iov_len = buffer_size}...};
-  }
-  std::array<iovec, nb_messages> iovecs_ = make_iovecs(buffers_, std::make_index_sequence<nb_messages>());
+    struct control
+    {
+      alignas(::cmsghdr) std::byte data[rx_timestamps::control_size];
+    };
 
-  template<std::size_t... indices>
-  std::array<mmsghdr, nb_messages> make_msgvec(decltype(iovecs_) &iovecs, [[maybe_unused]] std::index_sequence<indices...> _)
+    std::array<std::array<char, buffer_size>, nb_messages> buffers;
+    std::array<control, nb_messages> controls;
+    std::array<iovec, nb_messages> iovecs;
+    std::array<mmsghdr, nb_messages> messages;
+  };
+  std::unique_ptr<receive_batch> batch_;
+
+  multicast_udp_reader(asio::ip::udp::socket &&socket, const std::chrono::nanoseconds &spin_duration, rx_timestamping timestamping,
+                       std::unique_ptr<receive_batch> &&batch) noexcept:
+    asio::ip::udp::socket(std::move(socket)),
+    spin_duration_(to_timespec(spin_duration)), timestamps_(timestamping), batch_(std::move(batch))
   {
-    return {mmsghdr {.msg_hdr = {.msg_iov = &iovecs[indices], .msg_iovlen = 1}, .msg_len = 0}...};
+    for(std::size_t i = 0; i != nb_messages; ++i)
+    {
+      batch_->iovecs[i] = {.iov_base = batch_->buffers[i].data(), .iov_len = buffer_size};
+      batch_->messages[i] = {.msg_hdr = {.msg_iov = &batch_->iovecs[i],
+                                         .msg_iovlen = 1,
+                                         .msg_control = batch_->controls[i].data,
+                                         .msg_controllen = rx_timestamps::control_size},
+                             .msg_len = 0};
+    }
   }
-  std::array<mmsghdr, nb_messages> msgvec_ = make_msgvec(iovecs_, std::make_index_sequence<nb_messages>());
+#elif defined(LINUX)
+  std::array<char, buffer_size> buffer_ {};
+  struct
+  {
+    alignas(::cmsghdr) std::byte data[rx_timestamps::control_size];
+  } control_ {};
+  rx_timestamps timestamps_;
 
-  multicast_udp_reader(asio::ip::udp::socket &&socket, const std::chrono::nanoseconds &spin_duration) noexcept:
-    asio::ip::udp::socket(std::move(socket)), spin_duration_(to_timespec(spin_duration))
+  multicast_udp_reader(asio::ip::udp::socket &&socket, rx_timestamping timestamping) noexcept:
+    asio::ip::udp::socket(std::move(socket)), timestamps_(timestamping)
   {
   }
 #else  // defined(USE_RECVMMSG)
   std::array<char, buffer_size> buffer_ {};
+  rx_timestamps timestamps_;
 
   explicit multicast_udp_reader(asio::ip::udp::socket &&socket) noexcept: asio::ip::udp::socket(std::move(socket)) {}
 #endif // defined(USE_TCPDIRECT)
 };
 
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+//
+//
+// TX timestamps
+
+// Where the TX timestamps come from: the kernel, as the packet is handed over to the driver, or the NIC, as it leaves.
+enum class tx_timestamping : std::uint8_t
+{
+  none,
+  software,
+  hardware,
+};
+
+// The TX timestamps are looped back on the error queue of the socket, with the id of the send (SOF_TIMESTAMPING_OPT_ID): the number of the datagram
+// for a datagram socket, the offset of its last byte for a stream socket, from when the timestamping was enabled. The send calls are left as they
+// are: the queue is drained from the slow path.
+class tx_timestamps
+{
+public:
+  static constexpr int flags(tx_timestamping source) noexcept
+  {
+    switch(source)
+    {
+    case tx_timestamping::none: return 0;
+    case tx_timestamping::software: return SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    case tx_timestamping::hardware:
+      return SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    }
+    return 0;
+  }
+
+  static boost::leaf::result<void> enable(int fd, tx_timestamping source) noexcept
+  {
+    if(const int value = flags(source); value && ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &value, sizeof(value)) < 0) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"setsockopt(SO_TIMESTAMPING)"});
+    return {};
+  }
+
+  // hands over the (id, timestamp) pairs queued so far, returns their number
+  static boost::leaf::result<std::size_t> drain(int fd, std::invocable<std::uint32_t, const network_clock::time_point &> auto &&on_timestamp) noexcept
+  {
+    constexpr std::size_t control_size = CMSG_SPACE(sizeof(::scm_timestamping)) + CMSG_SPACE(sizeof(::sock_extended_err) + sizeof(::sockaddr_in6));
+    struct
+    {
+      alignas(::cmsghdr) std::byte data[control_size];
+    } control;
+
+    for(std::size_t nb_timestamps = 0;;)
+    {
+      ::msghdr message {.msg_control = control.data, .msg_controllen = control_size};
+      if(::recvmsg(fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+      {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+          return nb_timestamps;
+        return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"recvmsg(MSG_ERRQUEUE)"});
+      }
+
+      network_clock::time_point timestamp {};
+      const ::sock_extended_err *error = nullptr;
+      for(const ::cmsghdr *cmsg: cmsgs(message))
+      {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING)
+        {
+          // ts[0]: software, ts[2]: raw hardware
+          const auto *timestamps = reinterpret_cast<const ::scm_timestamping *>(CMSG_DATA(cmsg));
+          timestamp = to_time_point<network_clock>(timestamps->ts[2].tv_sec || timestamps->ts[2].tv_nsec ? timestamps->ts[2] : timestamps->ts[0]);
+        }
+        else if((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+          error = reinterpret_cast<const ::sock_extended_err *>(CMSG_DATA(cmsg));
+      }
+
+      // only the timestamps of the send itself (no SCHED nor ACK ones are asked for)
+      if(error && error->ee_errno == ENOMSG && error->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && error->ee_info == SCM_TSTAMP_SND
+         && timestamp != network_clock::time_point {})
+      {
+        on_timestamp(error->ee_data, timestamp);
+        ++nb_timestamps;
+      }
+    }
+  }
+};
+
+// The sends waiting for their TX timestamps, by increasing id. When full, the oldest send is dropped; a send whose id is skipped by the
+// timestamps never had one.
+template<typename record_type, std::size_t capacity = 1'024>
+class tx_records
+{
+  static_assert(std::has_single_bit(capacity));
+
+public:
+  [[using gnu: always_inline, hot]] inline void push(std::uint32_t id, const record_type &record) noexcept
+  {
+    if(UNLIKELY(tail_ - head_ == capacity))
+    {
+      ++head_;
+      ++nb_unmatched_;
+    }
+    entries_[tail_++ & (capacity - 1)] = {id, record};
+  }
+
+  // the record of the send, if any
+  const record_type *match(std::uint32_t id) noexcept
+  {
+    for(; head_ != tail_; ++head_)
+    {
+      const auto &[entry_id, record] = entries_[head_ & (capacity - 1)];
+      // ids wrap around
+      if(const auto delta = static_cast<std::int32_t>(entry_id - id); delta > 0)
+        return nullptr;
+      else if(delta == 0)
+        return &entries_[head_++ & (capacity - 1)].second;
+      ++nb_unmatched_;
+    }
+    return nullptr;
+  }
+
+  // sends dropped, or left without a timestamp
+  [[nodiscard]] std::uint64_t nb_unmatched() const noexcept { return nb_unmatched_; }
+
+private:
+  std::array<std::pair<std::uint32_t, record_type>, capacity> entries_ {};
+  std::uint64_t head_ = 0, tail_ = 0, nb_unmatched_ = 0;
+};
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+
 //
 //
 // UDP writer
@@ -333,7 +1614,12 @@ class udp_writer final : public asio::ip::udp::socket
 #endif
 {
 public:
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+  static boost::leaf::result<udp_writer> create(asio::io_context &service, std::string_view address, std::string_view port,
+                                                tx_timestamping timestamping = tx_timestamping::none) noexcept
+#else  // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
   static boost::leaf::result<udp_writer> create(asio::io_context &service, std::string_view address, std::string_view port) noexcept
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
   {
 #if defined(USE_TCPDIRECT)
     const asio::ip::udp::endpoint addr_local(asio::ip::udp::v4(), 0),
@@ -349,6 +1635,9 @@ public:
     const auto endpoint = BOOST_LEAF_EC_TRYX(asio::ip::udp::resolver(service).resolve(address, port, _)).begin()->endpoint();
     asio::ip::udp::socket socket {service};
     BOOST_LEAF_EC_TRYV(socket.connect(endpoint, _));
+#  if defined(LINUX) && !defined(USE_LIBVMA)
+    BOOST_LEAF_CHECK(tx_timestamps::enable(socket.native_handle(), timestamping));
+#  endif // defined(LINUX) && !defined(USE_LIBVMA)
     return udp_writer(std::move(socket));
 #endif
   }
@@ -400,3 +1689,126 @@ private:
   udp_writer(zock_ptr &&zock) noexcept: zock_(std::move(zock)) {}
 #endif // defined(USE_TCPDIRECT)
 };
+
+//
+//
+// stream writer
+//
+// Non blocking, with TCP_NODELAY: a message (a header and a payload) is one writev. What the socket does not take (a full send buffer: a slow
+// peer) goes to a bounded overflow queue, drained from the slow path; the messages sent meanwhile queue behind it, to keep the order. A message
+// that does not fit is dropped whole, never cut: the stream stays framed. The writes are all the syscall the fast path makes: warm() keeps the path
+// in cache between them.
+class stream_writer final : public asio::posix::stream_descriptor
+{
+public:
+  static boost::leaf::result<stream_writer> create(asio::io_context &service, int fd, std::size_t overflow_capacity = 65'536) noexcept
+  {
+    asio::posix::stream_descriptor descriptor(service, fd);
+    BOOST_LEAF_EC_TRYV(descriptor.non_blocking(true, _));
+    // not a TCP socket (a pipe, a UNIX socket): nothing to disable
+    if(const int on = 1; ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) && errno != ENOTSOCK && errno != EOPNOTSUPP) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"setsockopt(TCP_NODELAY)"});
+    return stream_writer(std::move(descriptor), overflow_capacity);
+  }
+
+  stream_writer(stream_writer &&) = default;
+  stream_writer &operator=(stream_writer &&) = default;
+
+  // true if on the socket, false if queued
+  [[using gnu: always_inline, flatten, hot]] inline boost::leaf::result<bool> send(const asio::const_buffer &header, const asio::const_buffer &payload) noexcept
+  {
+    if(!overflow.empty()) [[unlikely]]
+      return enqueue(header, payload, 0);
+
+    const std::array iovecs {::iovec {.iov_base = const_cast<void *>(header.data()), .iov_len = header.size()},
+                             ::iovec {.iov_base = const_cast<void *>(payload.data()), .iov_len = payload.size()}};
+    const auto written = ::writev(native_handle(), iovecs.data(), static_cast<int>(iovecs.size()));
+    if(written == static_cast<::ssize_t>(header.size() + payload.size())) [[likely]]
+      return true;
+    if(written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"writev"});
+    return enqueue(header, payload, static_cast<std::size_t>(std::max<::ssize_t>(written, 0)));
+  }
+
+  [[using gnu: always_inline, flatten, hot]] inline boost::leaf::result<bool> send(const asio::const_buffer &payload) noexcept
+  {
+    return send(asio::const_buffer(), payload);
+  }
+
+  [[nodiscard]] bool backlogged() const noexcept { return !overflow.empty(); }
+
+  // from the slow path
+  [[using gnu: cold]] boost::leaf::result<void> drain() noexcept
+  {
+    while(!overflow.empty())
+    {
+      const auto written = ::write(native_handle(), overflow.data() + overflow_head, overflow.size() - overflow_head);
+      if(written < 0)
+      {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+          return {};
+        return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"write"});
+      }
+      if((overflow_head += static_cast<std::size_t>(written)) == overflow.size())
+      {
+        overflow.clear();
+        overflow_head = 0;
+      }
+    }
+    return {};
+  }
+
+  // an empty write: the syscall and the socket, without a byte on the wire
+  [[using gnu: noinline, cold]] void warm() noexcept
+  {
+    if(overflow.empty())
+    {
+      const ::iovec iovec {.iov_base = overflow.data(), .iov_len = 0};
+      static_cast<void>(::writev(native_handle(), &iovec, 1));
+    }
+  }
+
+  [[nodiscard]] std::uint64_t nb_partial_writes() const noexcept { return nb_partial_writes_; }
+  [[nodiscard]] std::uint64_t nb_backpressured() const noexcept { return nb_backpressured_; }
+  [[nodiscard]] std::uint64_t nb_dropped() const noexcept { return nb_dropped_; }
+
+private:
+  stream_writer(asio::posix::stream_descriptor &&descriptor, std::size_t overflow_capacity) noexcept:
+    asio::posix::stream_descriptor(std::move(descriptor)), overflow_capacity(overflow_capacity)
+  {
+    overflow.reserve(overflow_capacity);
+  }
+
+  // the part of the message the socket did not take: the rest of a message begun on the socket is queued whatever the capacity
+  [[using gnu: noinline, cold]] boost::leaf::result<bool> enqueue(const asio::const_buffer &header, const asio::const_buffer &payload, std::size_t skip) noexcept
+  {
+    const auto size = header.size() + payload.size() - skip;
+    if(!skip && overflow.size() - overflow_head + size > overflow_capacity)
+    {
+      ++nb_dropped_;
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::no_buffer_space), ::boilerplate::statement {"stream_writer::enqueue"});
+    }
+    if(skip)
+      ++nb_partial_writes_;
+    ++nb_backpressured_;
+
+    if(overflow.size() + size > overflow_capacity)
+    {
+      overflow.erase(overflow.begin(), overflow.begin() + static_cast<std::ptrdiff_t>(overflow_head));
+      overflow_head = 0;
+    }
+    for(const auto &buffer: {header, payload})
+    {
+      const auto *first = static_cast<const std::byte *>(buffer.data());
+      const auto skipped = std::min(skip, buffer.size());
+      overflow.insert(overflow.end(), first + skipped, first + buffer.size());
+      skip -= skipped;
+    }
+    return false;
+  }
+
+  std::size_t overflow_capacity;
+  std::vector<std::byte> overflow {};
+  std::size_t overflow_head = 0;
+  std::uint64_t nb_partial_writes_ = 0, nb_backpressured_ = 0, nb_dropped_ = 0;
+};
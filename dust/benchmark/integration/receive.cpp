@@ -0,0 +1,126 @@
+#include <benchmark/benchmark.h>
+
+#include <boilerplate/chrono.hpp>
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/socket.hpp>
+
+#include <asio/buffer.hpp>
+#include <asio/io_context.hpp>
+
+#include <boost/leaf/handle_errors.hpp>
+
+#if defined(USE_SHM_RING)
+#  include <feed/binary/feed_ring.hpp>
+#endif // defined(USE_SHM_RING)
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+// The receive stage alone, over loopback multicast, for whatever backend the build picks (USE_RECVMMSG, USE_IO_URING...): a thread keeps the group
+// fed with datagrams stamped with their send time (back to back, or paced by the argument, in ns), the fast path polls them. Built once per
+// backend, the runs compare. With USE_SHM_RING, the datagrams go through a shared memory ring instead.
+
+#if defined(BOOST_NO_EXCEPTIONS)
+namespace boost
+{
+void throw_exception(const std::exception &exception)
+{
+  std::cerr << exception.what() << std::endl;
+  std::abort();
+}
+} // namespace boost
+#endif //  defined(BOOST_NO_EXCEPTIONS)
+
+#if defined(ASIO_NO_EXCEPTIONS)
+namespace asio::detail
+{
+template<typename exception_type>
+void throw_exception(const exception_type &exception)
+{
+  boost::throw_exception(exception);
+}
+} // namespace asio::detail
+#endif // defined(ASIO_NO_EXCEPTIONS)
+
+namespace
+{
+constexpr auto group = "239.255.0.1", port = "4501";
+constexpr auto ring_name = "/receive_benchmark";
+constexpr std::size_t datagram_size = 256; // a few messages
+
+void receive(benchmark::State &state) noexcept
+{
+  using namespace std::chrono_literals;
+
+  asio::io_context service(1);
+
+  const auto error_handlers = std::make_tuple(
+    [&](const boost::leaf::error_info &unmatched, const std::error_code &error_code) { state.SkipWithError((std::ostringstream() << error_code << unmatched).str().c_str()); },
+    [&](const boost::leaf::error_info &unmatched) { state.SkipWithError((std::ostringstream() << unmatched).str().c_str()); });
+
+  boost::leaf::try_handle_all(
+    [&]() noexcept -> boost::leaf::result<void>
+    {
+#if defined(USE_SHM_RING)
+      auto writer = BOOST_LEAF_TRYX(feed::ring_writer::create(ring_name));
+      auto reader = BOOST_LEAF_TRYX(feed::ring_reader::open(ring_name));
+      const auto send = [&](const asio::const_buffer &datagram) noexcept { writer.publish(datagram); };
+#else  // defined(USE_SHM_RING)
+      auto reader = BOOST_LEAF_TRYX(multicast_udp_reader::create(service, group, port, 100us));
+      auto writer = BOOST_LEAF_TRYX(udp_writer::create(service, group, port));
+      const auto send = [&](const asio::const_buffer &datagram) noexcept { static_cast<void>(writer.send(datagram)); };
+#endif // defined(USE_SHM_RING)
+
+      std::atomic_bool stop = false;
+      const auto gap = std::chrono::nanoseconds(state.range(0));
+      std::thread sender(
+        [&]() noexcept
+        {
+          std::array<std::byte, datagram_size> datagram {};
+          for(auto next = std::chrono::steady_clock::now(); !stop.load(std::memory_order_relaxed); next += gap)
+          {
+            while(std::chrono::steady_clock::now() < next)
+              ;
+            const auto sent = std::chrono::steady_clock::now().time_since_epoch().count();
+            std::memcpy(datagram.data(), &sent, sizeof(sent));
+            send(asio::buffer(datagram));
+          }
+        });
+
+      std::uint64_t nb_datagrams = 0, nb_bytes = 0;
+      std::chrono::nanoseconds total_latency {};
+      const auto continuation = [&]([[maybe_unused]] const network_clock::time_point &timestamp, asio::const_buffer &&buffer) noexcept
+      {
+        std::int64_t sent;
+        std::memcpy(&sent, buffer.data(), sizeof(sent));
+        total_latency += std::chrono::steady_clock::now().time_since_epoch() - std::chrono::steady_clock::duration(sent);
+        ++nb_datagrams;
+        nb_bytes += buffer.size();
+      };
+
+      for(auto _: state)
+        BOOST_LEAF_CHECK(reader(continuation));
+
+      stop.store(true, std::memory_order_relaxed);
+      sender.join();
+
+      state.SetItemsProcessed(static_cast<std::int64_t>(nb_datagrams));
+      state.SetBytesProcessed(static_cast<std::int64_t>(nb_bytes));
+      // send to dequeue, queueing in the socket included
+      state.counters["latency_ns"] = nb_datagrams ? static_cast<double>(total_latency.count()) / static_cast<double>(nb_datagrams) : 0.;
+      return {};
+    },
+    error_handlers);
+}
+} // namespace
+
+BENCHMARK(receive)->Arg(0)->Arg(10'000)->MinTime(2.);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,150 @@
+#include <benchmark/benchmark.h>
+
+#include <boilerplate/chrono.hpp>
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/socket.hpp>
+
+#include <asio/buffer.hpp>
+#include <asio/io_context.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/write.hpp>
+
+#include <boost/leaf/handle_errors.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#include <unistd.h>
+
+// The send stage alone: a datagram to a loopback multicast group and a payload on a stream (a socketpair, drained by a thread), per iteration. Today's
+// path (a send and a blocking write, two syscalls) against the batched one (both queued on an io_uring out of registered buffers, one submit).
+
+#if defined(BOOST_NO_EXCEPTIONS)
+namespace boost
+{
+void throw_exception(const std::exception &exception)
+{
+  std::cerr << exception.what() << std::endl;
+  std::abort();
+}
+} // namespace boost
+#endif //  defined(BOOST_NO_EXCEPTIONS)
+
+#if defined(ASIO_NO_EXCEPTIONS)
+namespace asio::detail
+{
+template<typename exception_type>
+void throw_exception(const exception_type &exception)
+{
+  boost::throw_exception(exception);
+}
+} // namespace asio::detail
+#endif // defined(ASIO_NO_EXCEPTIONS)
+
+namespace
+{
+constexpr auto group = "239.255.0.1", port = "4502";
+constexpr std::size_t datagram_size = 64, stream_size = 256;
+
+template<typename send_type>
+void send(benchmark::State &state, send_type &&prepare) noexcept
+{
+  asio::io_context service(1);
+
+  const auto error_handlers = std::make_tuple(
+    [&](const boost::leaf::error_info &unmatched, const std::error_code &error_code) { state.SkipWithError((std::ostringstream() << error_code << unmatched).str().c_str()); },
+    [&](const boost::leaf::error_info &unmatched) { state.SkipWithError((std::ostringstream() << unmatched).str().c_str()); });
+
+  boost::leaf::try_handle_all(
+    [&]() noexcept -> boost::leaf::result<void>
+    {
+      auto writer = BOOST_LEAF_TRYX(udp_writer::create(service, group, port));
+      asio::local::stream_protocol::socket stream(service), peer(service);
+      BOOST_LEAF_EC_TRYV(asio::local::connect_pair(stream, peer, _));
+
+      std::atomic_bool stop = false;
+      std::thread drain(
+        [&]() noexcept
+        {
+          std::array<std::byte, 65'536> sink;
+          peer.non_blocking(true);
+          while(!stop.load(std::memory_order_relaxed))
+            static_cast<void>(::read(peer.native_handle(), sink.data(), sink.size()));
+        });
+
+      const std::array<std::byte, datagram_size> datagram {};
+      const std::array<std::byte, stream_size> payload {};
+      auto step = BOOST_LEAF_TRYX(prepare(writer, stream, asio::buffer(datagram), asio::buffer(payload)));
+
+      for(auto _: state)
+        BOOST_LEAF_CHECK(step());
+
+      stop.store(true, std::memory_order_relaxed);
+      drain.join();
+
+      state.SetItemsProcessed(state.iterations());
+      state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(datagram_size + stream_size));
+      return {};
+    },
+    error_handlers);
+}
+
+void send_blocking(benchmark::State &state) noexcept
+{
+  send(state,
+       [](auto &writer, auto &stream, const asio::const_buffer &datagram, const asio::const_buffer &payload) noexcept
+       {
+         return boost::leaf::result<std::function<boost::leaf::result<void>()>>(
+           [&writer, &stream, datagram, payload]() noexcept -> boost::leaf::result<void>
+           {
+             BOOST_LEAF_CHECK(writer.send(datagram));
+             BOOST_LEAF_EC_TRYV(asio::write(stream, payload, _));
+             return {};
+           });
+       });
+}
+
+#if defined(USE_IO_URING)
+void send_batched(benchmark::State &state) noexcept
+{
+  std::unique_ptr<uring_sender> sender_ptr;
+  std::optional<uring_sender::registration> datagram_registration, payload_registration;
+  send(state,
+       [&](auto &writer, auto &stream, const asio::const_buffer &datagram, const asio::const_buffer &payload) noexcept
+         -> boost::leaf::result<std::function<boost::leaf::result<void>()>>
+       {
+         sender_ptr = BOOST_LEAF_TRYX(uring_sender::create(16, state.range(0) != 0));
+         datagram_registration = BOOST_LEAF_TRYX(sender_ptr->register_payload(datagram));
+         payload_registration = BOOST_LEAF_TRYX(sender_ptr->register_payload(payload));
+         return [&, datagram_fd = writer.native_handle(), stream_fd = stream.native_handle()]() noexcept -> boost::leaf::result<void>
+         {
+           BOOST_LEAF_CHECK(sender_ptr->send(datagram_fd, *datagram_registration));
+           BOOST_LEAF_CHECK(sender_ptr->write(stream_fd, *payload_registration));
+           BOOST_LEAF_CHECK(sender_ptr->flush());
+           sender_ptr->reap();
+           return {};
+         };
+       });
+  if(sender_ptr)
+  {
+    state.counters["nb_errors"] = static_cast<double>(sender_ptr->nb_errors());
+    state.counters["nb_partial_writes"] = static_cast<double>(sender_ptr->nb_partial_writes());
+  }
+}
+#endif // defined(USE_IO_URING)
+} // namespace
+
+BENCHMARK(send_blocking)->MinTime(2.);
+#if defined(USE_IO_URING)
+// without, then with, the kernel thread polling the submission queue
+BENCHMARK(send_batched)->Arg(0)->Arg(1)->MinTime(2.);
+#endif // defined(USE_IO_URING)
+
+BENCHMARK_MAIN();
@@ -0,0 +1,88 @@
+#include <feed/binary/feed_pcap.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <boost/endian/conversion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// The ingest of a capture in memory: ethernet frames of updates datagrams, one in 8 to another port, in a nanosecond pcap. The throughput is in bytes
+// of capture.
+
+namespace
+{
+constexpr std::size_t nb_frames = 65'536;
+
+std::vector<std::byte> make_capture(std::size_t payload_size)
+{
+  std::vector<std::byte> result;
+  const auto append = [&]<typename value_type>(value_type value) noexcept
+  {
+    const auto *bytes = reinterpret_cast<const std::byte *>(&value); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    result.insert(result.end(), bytes, bytes + sizeof(value));
+  };
+  const auto append_big = [&]<typename value_type>(value_type value) noexcept { append(boost::endian::native_to_big(value)); };
+
+  append(feed::detail::pcap::magic_nanoseconds);
+  append(std::uint16_t {2});
+  append(std::uint16_t {4});
+  append(std::uint64_t {0});
+  append(std::uint32_t {65'535});
+  append(std::uint32_t {feed::detail::pcap::ethernet});
+
+  const std::vector<std::byte> payload(payload_size);
+  const auto size = static_cast<std::uint32_t>(14 + 20 + 8 + payload_size);
+  for(std::uint32_t i = 0; i < nb_frames; ++i)
+  {
+    append(i / 1'000'000);
+    append(i % 1'000'000 * 1'000);
+    append(size);
+    append(size);
+
+    result.insert(result.end(), 12, std::byte {0xff});
+    append_big(feed::detail::pcap::ethertype_ipv4);
+
+    append(std::uint8_t {0x45});
+    append(std::uint8_t {0});
+    append_big(static_cast<std::uint16_t>(size - 14));
+    append(std::uint32_t {0});
+    append(std::uint8_t {64});
+    append(feed::detail::pcap::protocol_udp);
+    append(std::uint16_t {0});
+    append_big(std::uint32_t {0x7f00'0001});
+    append_big(std::uint32_t {0xe000'0001});
+
+    append_big(std::uint16_t {1'234});
+    append_big(i % 8 ? std::uint16_t {4'401} : std::uint16_t {9'999});
+    append_big(static_cast<std::uint16_t>(8 + payload_size));
+    append(std::uint16_t {0});
+    result.insert(result.end(), payload.begin(), payload.end());
+  }
+  return result;
+}
+
+void read_pcap(benchmark::State &state)
+{
+  const auto capture = make_capture(static_cast<std::size_t>(state.range(0)));
+
+  std::uint64_t nb_events = 0;
+  for([[maybe_unused]] auto _: state)
+  {
+    auto statistics = feed::read_pcap(asio::const_buffer(capture.data(), capture.size()), {},
+                                      [&]([[maybe_unused]] std::uint64_t timestamp, const asio::const_buffer &packet) noexcept
+                                      { nb_events += packet.size() != 0; });
+    benchmark::DoNotOptimize(statistics);
+  }
+  benchmark::DoNotOptimize(nb_events);
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * capture.size()));
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * nb_frames));
+}
+} // namespace
+
+// the datagram sizes: a message, a typical datagram, a full one
+BENCHMARK(read_pcap)->Arg(18)->Arg(256)->Arg(1'400);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,115 @@
+#include "trigger/trigger.hpp"
+
+#include <feed/decimal.hpp>
+
+#include <benchmark/benchmark.h>
+
+#if !defined(__clang__)
+#  include <decimal/decimal>
+#endif // !defined(__clang__)
+
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// The same random walk on a 0.0005 tick, around 100, through the price types: trigger compares and the wire decoding.
+
+namespace
+{
+constexpr std::size_t nb_prices = 4'096;
+
+template<typename price_type>
+price_type make_price(std::int32_t nb_ticks)
+{
+  if constexpr(std::is_same_v<price_type, feed::tick_price>)
+    return feed::tick_price(100.) + feed::tick_price(.0005) * nb_ticks;
+  else
+    return price_type(100.) + price_type(.0005) * price_type(nb_ticks);
+}
+
+template<typename price_type>
+const std::vector<price_type> &random_walk()
+{
+  static const auto result = []() {
+    std::mt19937 generator(42); // NOLINT(cert-msc32-c,cert-msc51-cpp)
+    std::uniform_int_distribution<std::int32_t> step(-2, 2);
+    std::vector<price_type> result;
+    std::int32_t nb_ticks = 0;
+    for(std::size_t i = 0; i < nb_prices; ++i)
+      result.push_back(make_price<price_type>(nb_ticks += step(generator)));
+    return result;
+  }();
+  return result;
+}
+
+template<typename price_type>
+void move_trigger_walk(benchmark::State &state)
+{
+  using namespace std::chrono_literals;
+
+  const auto &prices = random_walk<price_type>();
+  move_trigger<price_type> trigger(make_price<price_type>(0), make_price<price_type>(4) - make_price<price_type>(0), 10ms);
+  const auto continuation = []([[maybe_unused]] auto timestamp) noexcept { return true; };
+  std::chrono::steady_clock::time_point timestamp;
+
+  std::size_t nb_triggers = 0;
+  for([[maybe_unused]] auto _: state)
+    for(auto &&price: prices)
+    {
+      timestamp += 100us;
+      nb_triggers += trigger(continuation, timestamp, price);
+    }
+  benchmark::DoNotOptimize(nb_triggers);
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * prices.size()));
+}
+
+void decode_float(benchmark::State &state)
+{
+  std::vector<std::uint32_t> wire;
+  for(auto &&price: random_walk<feed::tick_price>())
+    wire.push_back(price.to_float_bits());
+
+  for([[maybe_unused]] auto _: state)
+    for(auto bits: wire)
+      benchmark::DoNotOptimize(std::bit_cast<float>(bits));
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * wire.size()));
+}
+
+void decode_float_to_tick_price(benchmark::State &state)
+{
+  std::vector<std::uint32_t> wire;
+  for(auto &&price: random_walk<feed::tick_price>())
+    wire.push_back(price.to_float_bits());
+
+  for([[maybe_unused]] auto _: state)
+    for(auto bits: wire)
+      benchmark::DoNotOptimize(feed::tick_price::from_float_bits(bits));
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * wire.size()));
+}
+
+void decode_decimal32_to_tick_price(benchmark::State &state)
+{
+  std::vector<std::uint32_t> wire;
+  for(auto &&price: random_walk<feed::tick_price>())
+    wire.push_back(price.to_decimal32_bits());
+
+  for([[maybe_unused]] auto _: state)
+    for(auto bits: wire)
+      benchmark::DoNotOptimize(feed::tick_price::from_decimal32_bits(bits));
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * wire.size()));
+}
+} // namespace
+
+BENCHMARK_TEMPLATE(move_trigger_walk, float);
+BENCHMARK_TEMPLATE(move_trigger_walk, feed::tick_price);
+#if !defined(__clang__)
+BENCHMARK_TEMPLATE(move_trigger_walk, std::decimal::decimal32);
+#endif // !defined(__clang__)
+
+BENCHMARK(decode_float);
+BENCHMARK(decode_float_to_tick_price);
+BENCHMARK(decode_decimal32_to_tick_price);
+
+BENCHMARK_MAIN();
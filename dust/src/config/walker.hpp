@@ -43,7 +43,9 @@ struct from_walker_impl<address>
 template<>
 struct from_walker_impl<feed::price_t>
 {
-#if defined(LEAN_AND_MEAN) || defined(__clang__)
+#if defined(TICK_PRICE)
+  auto operator()(const walker &w) { return feed::price_t(static_cast<double>(static_cast<config::numeric_type>(*w))); }
+#elif defined(LEAN_AND_MEAN) || defined(__clang__)
   auto operator()(const walker &w) { return static_cast<config::numeric_type>(*w); }
 #else  // defined(LEAN_AND_MEAN) || defined(__clang__)
   auto operator()(const walker &w) { return feed::price_t(std::decimal::decimal32(static_cast<config::numeric_type>(*w))); }
@@ -0,0 +1,261 @@
+#include "handlers.hpp"
+#include "logger_thread.hpp"
+#include "model/arbitration.hpp"
+#include "model/decoder.hpp"
+#include "model/fan_out.hpp"
+
+#include <boilerplate/chrono.hpp>
+#include <boilerplate/logger.hpp>
+#include <boilerplate/pointers.hpp>
+#include <boilerplate/socket.hpp>
+
+#include <feed/binary/feed_ring.hpp>
+#include <feed/binary/feed_state_table.hpp>
+#include <feed/feed.hpp>
+
+#include <asio/awaitable.hpp>
+#include <asio/buffer.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/connect.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/posix/stream_descriptor.hpp>
+#include <asio/read_until.hpp>
+#include <asio/signal_set.hpp>
+
+#include <boost/leaf/common.hpp>
+#include <boost/leaf/handle_errors.hpp>
+
+#include <cstddef>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// The feed handler: the feed received and decoded once on the box, for many dust processes (dust_shm_ring, with feed.state_table). The lines are
+// arbitrated and the gaps recovered here; the datagrams go on the ring of feed.update_ring as they were received (the ones of an instrument being
+// recovered once it is), the states of the instruments in the table of feed.state_table. A consumer recovers from the table, without a round trip.
+// The properties are read on stdin, as dust's are.
+
+#if defined(BOOST_NO_EXCEPTIONS)
+namespace boost
+{
+/*[[noreturn]]*/ void throw_exception(const std::exception &exception)
+{
+  logger::printer printer;
+  printer(logger::level::CRITICAL, exception.what());
+  std::abort();
+}
+
+struct source_location;
+/*[[noreturn]]*/ void throw_exception(std::exception const &e, boost::source_location const &) { throw_exception(e); }
+} // namespace boost
+#endif //  defined(BOOST_NO_EXCEPTIONS)
+
+#if defined(ASIO_NO_EXCEPTIONS)
+namespace asio::detail
+{
+template<typename exception_type>
+/*[[noreturn]]*/ void throw_exception(const exception_type &exception)
+{
+  boost::throw_exception(exception);
+}
+} // namespace asio::detail
+#endif // defined(ASIO_NO_EXCEPTIONS)
+
+
+auto main() -> int
+{
+  using namespace config::literals;
+  using namespace logger::literals;
+  using namespace std::string_literals;
+
+  asio::io_context service(1);
+
+  logger_thread logger_thread;
+  auto logger_ptr = boilerplate::make_strict_not_null(&logger_thread.logger);
+
+  logger_ptr->log_non_trivial(logger::info, "lwpid={} Starting feed handler."_format, std::this_thread::get_id());
+  logger_ptr->flush();
+
+  auto spawn = [&service, logger_ptr](auto &&coroutine, auto name)
+  {
+    asio::co_spawn(
+      service,
+      [&service, logger_ptr, name, coroutine = std::forward<decltype(coroutine)>(coroutine)]() mutable noexcept -> boost::leaf::awaitable<void>
+      {
+        co_await boost::leaf::co_try_handle_all(
+          [&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>>
+          {
+            BOOST_LEAF_CO_TRYV(co_await coroutine());
+            co_return boost::leaf::success();
+          },
+          make_handlers([&service, logger_ptr, name](auto format, auto &&...args) noexcept {
+            logger_ptr->log_non_trivial(logger::critical, "coroutine=\"{}\" "_format + format, name, std::forward<decltype(args)>(args)...);
+            service.stop();
+          }));
+      },
+      asio::detached);
+  };
+
+  asio::signal_set signals(service, SIGINT, SIGTERM);
+  signals.async_wait(
+    [&](auto error_code, auto signal_number) noexcept
+    {
+      if(error_code)
+        return;
+      logger_ptr->log(logger::info, "signal={} Interrupting."_format, signal_number);
+      service.stop();
+    });
+
+  asio::posix::stream_descriptor command_input(service, ::dup(STDIN_FILENO));
+  std::string command_input_buffer;
+
+  boost::leaf::try_handle_all([&]() noexcept -> boost::leaf::result<void> {
+      //
+      // properties
+
+      const auto command_size = BOOST_LEAF_EC_TRYX(asio::read_until(command_input, asio::dynamic_buffer(command_input_buffer), "\n\n", _));
+      const auto properties = BOOST_LEAF_TRYX(config::properties::create(boost::make_iterator_range(command_input_buffer.begin(), command_input_buffer.begin() + command_size)));
+      const auto feed_properties = properties["feed"_hs];
+
+      //
+      // snapshots: the initial one, then one per gap
+
+      auto snapshot_socket = ({
+          const auto [snapshot_host, snapshot_port] = (config::address)*feed_properties["snapshot"_hs];
+          const auto snapshot_endpoints = BOOST_LEAF_EC_TRYX(asio::ip::tcp::resolver(service).resolve(snapshot_host, snapshot_port, _));
+          auto snapshot_socket = asio::ip::tcp::socket(service);
+          BOOST_LEAF_EC_TRYV(asio::connect(snapshot_socket, snapshot_endpoints, _));
+          std::move(snapshot_socket);
+      });
+
+      // the version the server publishes the updates with, the decoder picked from it
+      std::optional<feed::wire_version> wire_version;
+      if(const auto max_version = max_wire_version(feed_properties); max_version)
+      {
+        spawn([&, max_version = *max_version]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+          wire_version = BOOST_LEAF_CO_TRYX(co_await feed::co_request_version(snapshot_socket, max_version));
+          logger_ptr->log(logger::info, "wire_version={} Version negotiated."_format, std::to_underlying(*wire_version));
+          co_return boost::leaf::success();
+        }, "version"s);
+        while(!wire_version && !service.stopped())
+          BOOST_LEAF_EC_TRYV(service.poll(_));
+      }
+
+      //
+      // receive: the A line, and the B line if any
+
+      const auto timestamping = ({
+          using namespace std::string_view_literals;
+          const config::string_type name = feed_properties["timestamping"_hs].get_or(config::string_type("dequeue"));
+          if(name != "dequeue"sv && name != "software"sv && name != "hardware"sv)
+            return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"feed.timestamping"});
+          name == "hardware"sv ? rx_timestamping::hardware : name == "software"sv ? rx_timestamping::software : rx_timestamping::dequeue;
+      });
+      // with a second line, the lines are read in turn without waiting on either: a wait on A would hold back the first arrivals on B
+      const auto spin_duration = feed_properties["update_b"_hs] ? 0ns : feed_properties["spin_duration"_hs].get_or(1'000ns);
+      const auto create_updates_socket = [&](std::string_view host, std::string_view port) noexcept {
+        return multicast_udp_reader::create(service, host, port, spin_duration, timestamping);
+      };
+
+      const auto [updates_host, updates_port] = (config::address)*feed_properties["update"_hs];
+      auto updates_socket = BOOST_LEAF_TRYX(create_updates_socket(updates_host, updates_port));
+      std::optional<decltype(updates_socket)> updates_b_socket;
+      if(const auto update_b = feed_properties["update_b"_hs]; update_b)
+      {
+        const auto [updates_b_host, updates_b_port] = (config::address)*update_b;
+        updates_b_socket.emplace(BOOST_LEAF_TRYX(create_updates_socket(updates_b_host, updates_b_port)));
+      }
+
+      //
+      // publish
+
+      const config::string_type &updates_ring_name = *feed_properties["update_ring"_hs];
+      const config::string_type &state_table_name = *feed_properties["state_table"_hs];
+
+      return with_decoder(feed_properties, wire_version, [&](auto &&decoder) noexcept -> boost::leaf::result<void> {
+        using decoder_type = std::decay_t<decltype(decoder)>;
+
+        fan_out<decoder_type> stage(BOOST_LEAF_TRYX(feed::state_table_writer::create(state_table_name)),
+                                    BOOST_LEAF_TRYX(feed::ring_writer::create(updates_ring_name, std::size_t(feed_properties["ring_capacity"_hs].get_or(16'777'216)))),
+                                    decoder);
+        logger_ptr->log_non_trivial(logger::info, "update_ring=\"{}\" state_table=\"{}\" Publishing."_format, updates_ring_name, state_table_name);
+
+        // the decoders of the lines start from the snapshots, as the one of the stage does
+        std::optional<line_arbiter<decoder_type>> arbiter;
+        if(updates_b_socket)
+          arbiter.emplace(decoder);
+
+        // the gaps batched: one bulk snapshot at a time on the socket
+        std::vector<feed::instrument_id_type> pending_instruments;
+        bool recovery_running = false;
+        const auto recover = [&](std::vector<feed::instrument_id_type> instruments) noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+          logger_ptr->log(logger::debug, "nb_instruments={} request bulk snapshot"_format, instruments.size());
+          BOOST_LEAF_CO_TRYV(co_await feed::co_request_bulk_snapshot(snapshot_socket, instruments, [&](auto instrument_id, feed::instrument_state &&state) noexcept {
+            logger_ptr->log(logger::debug, "instrument=\"{}\" sequence_id={} received snapshot"_format, instrument_id, state.sequence_id);
+            if(arbiter)
+              arbiter->reset(instrument_id, state);
+            stage.recover(instrument_id, std::move(state));
+          }));
+          recovery_running = false;
+          co_return boost::leaf::success();
+        };
+
+        // all the instruments (an empty request) before the first datagram
+        recovery_running = true;
+        spawn([&]() noexcept { return recover({}); }, "initial snapshot"s);
+        while(recovery_running && !service.stopped())
+          BOOST_LEAF_EC_TRYV(service.poll(_));
+
+        const auto request_snapshot = [&](feed::instrument_id_type instrument_id) noexcept { pending_instruments.push_back(instrument_id); };
+        const auto publish = [&](const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept { stage(timestamp, buffer, request_snapshot); };
+
+        while(!service.stopped()) [[likely]]
+        {
+          BOOST_LEAF_CHECK(updates_socket([&](const network_clock::time_point &timestamp, asio::const_buffer &&buffer) noexcept {
+            if(!arbiter || (*arbiter)(0, timestamp, buffer))
+              publish(timestamp, buffer);
+          }));
+          if(updates_b_socket)
+            BOOST_LEAF_CHECK((*updates_b_socket)([&](const network_clock::time_point &timestamp, asio::const_buffer &&buffer) noexcept {
+              if((*arbiter)(1, timestamp, buffer))
+                publish(timestamp, buffer);
+            }));
+
+          if(!pending_instruments.empty() && !recovery_running) [[unlikely]]
+          {
+            recovery_running = true;
+            spawn([&, instruments = std::exchange(pending_instruments, {})]() mutable noexcept { return recover(std::move(instruments)); }, "recovery"s);
+          }
+
+          BOOST_LEAF_EC_TRYV(service.poll(_));
+          logger_ptr->flush();
+        }
+
+        const auto &statistics = stage.statistics();
+        logger_ptr->log(logger::info, "nb_datagrams={} nb_messages={} nb_stale={} nb_gaps={} nb_recoveries={} nb_replayed={} nb_held={} nb_published_bytes={} Feed handler stopped."_format,
+                        statistics.nb_datagrams, statistics.nb_messages, statistics.nb_stale, statistics.nb_gaps, statistics.nb_recoveries,
+                        statistics.nb_replayed, statistics.nb_held, stage.nb_published_bytes());
+        if(arbiter)
+          for(std::size_t line = 0; line != arbiter->nb_lines; ++line)
+          {
+            const auto &line_statistics = arbiter->statistics(line);
+            logger_ptr->log(logger::info, "line={} nb_datagrams={} nb_wins={} nb_gaps={} nb_gaps_filled={} Arbitration."_format, line ? "B" : "A",
+                            line_statistics.nb_datagrams, line_statistics.nb_wins, line_statistics.nb_gaps, line_statistics.nb_gaps_filled);
+          }
+        return boost::leaf::success();
+      });
+    },
+    make_handlers([&](auto &&...args) noexcept {
+        logger_thread.printer(logger::critical, std::forward<decltype(args)>(args)...);
+        std::abort();
+    }));
+
+  return 0;
+}
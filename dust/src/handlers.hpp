@@ -1,6 +1,8 @@
 #pragma once
 
 #include "config/config_reader.hpp"
+#include "model/decoder.hpp"
+#include "model/group_membership.hpp"
 #include "trigger/trigger_dispatcher.hpp"
 
 #include <boilerplate/fmt.hpp>
@@ -64,6 +66,16 @@ inline auto make_handlers(auto &&printer) noexcept
                        return printer("location=\"{}:{} {}\" config={} Invalid trigger config"_format, location.file, location.line,
                                location.function, static_cast<const void *>(invalid_trigger_config.walker.object.get()));
                      },
+                     [printer](const invalid_decoder_config &invalid_decoder_config, const boost::leaf::e_source_location &location) noexcept
+                     {
+                       return printer("location=\"{}:{} {}\" config={} Invalid decoder config"_format, location.file, location.line,
+                               location.function, static_cast<const void *>(invalid_decoder_config.walker.object.get()));
+                     },
+                     [printer](const invalid_group_config &invalid_group_config, const boost::leaf::e_source_location &location) noexcept
+                     {
+                       return printer("location=\"{}:{} {}\" config={} Invalid group config"_format, location.file, location.line,
+                               location.function, static_cast<const void *>(invalid_group_config.walker.object.get()));
+                     },
                      [printer](const missing_field &missing_field, const boost::leaf::e_source_location &location) noexcept
                      {
                        return printer("location=\"{}:{} {}\" field={} Missing field"_format, location.file, location.line, location.function,
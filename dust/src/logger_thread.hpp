@@ -0,0 +1,33 @@
+#pragma once
+
+#include <boilerplate/logger.hpp>
+#include <boilerplate/pointers.hpp>
+
+#include <boost/core/noncopyable.hpp>
+
+#include <atomic>
+#include <thread>
+
+// The logger, drained by a thread of its own: the hot path only formats into the queue.
+
+struct logger_thread : boost::noncopyable
+{
+  logger::printer printer {};
+  logger::logger logger {boilerplate::make_strict_not_null(&printer)};
+  std::atomic_bool leave {};
+  static_assert(decltype(leave)::is_always_lock_free);
+
+  std::thread thread {[this]() noexcept
+                      {
+                        while(!leave.load(std::memory_order_acquire))
+                          logger.drain();
+                      }};
+
+  ~logger_thread()
+  {
+    logger.flush();
+    logger.drain();
+    leave.store(true, std::memory_order_release);
+    thread.join();
+  }
+};
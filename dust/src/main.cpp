@@ -1,12 +1,21 @@
 #include "handlers.hpp"
+#include "logger_thread.hpp"
+#include "model/arbitration.hpp"
 #include "model/automata.hpp"
+#include "model/decoder.hpp"
+#include "model/group_membership.hpp"
 
 #include <boilerplate/chrono.hpp>
+#include <boilerplate/histogram.hpp>
 #include <boilerplate/logger.hpp>
 #include <boilerplate/likely.hpp>
 #include <boilerplate/pointers.hpp>
 #include <boilerplate/socket.hpp>
 
+#include <feed/binary/feed_filter.hpp>
+#include <feed/binary/feed_recorder.hpp>
+#include <feed/binary/feed_ring.hpp>
+#include <feed/binary/feed_state_table.hpp>
 #include <feed/feed.hpp>
 
 #include <asio/awaitable.hpp>
@@ -24,8 +33,6 @@
 #include <asio/signal_set.hpp>
 #include <asio/write.hpp>
 
-#include <boost/core/noncopyable.hpp>
-
 #include <boost/leaf/common.hpp>
 #include <boost/leaf/handle_errors.hpp>
 
@@ -36,13 +43,18 @@
 #include <std_function/function.h>
 
 #include <algorithm>
+#include <arpa/inet.h>
 #include <array>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 
 #if defined(BACKTEST_HARNESS)
@@ -88,28 +100,6 @@ template<typename exception_type>
 } // namespace asio::detail
 #endif // defined(ASIO_NO_EXCEPTIONS)
 
-struct logger_thread : boost::noncopyable
-{
-  logger::printer printer {};
-  logger::logger logger {boilerplate::make_strict_not_null(&printer)};
-  std::atomic_bool leave {};
-  static_assert(decltype(leave)::is_always_lock_free);
-
-  std::thread thread {[this]() noexcept
-                      {
-                        while(!leave.load(std::memory_order_acquire))
-                          logger.drain();
-                      }};
-
-  ~logger_thread()
-  {
-    logger.flush();
-    logger.drain();
-    leave.store(true, std::memory_order_release);
-    thread.join();
-  }
-};
-
 
 auto main() -> int
 {
@@ -192,58 +182,209 @@ auto main() -> int
       //
       // receive
 
+      // the version the snapshot server publishes the updates with, the decoder picked from it
+      std::optional<feed::wire_version> wire_version;
+
 #if defined(BACKTEST_HARNESS)
       auto co_request_snapshot = backtest::make_snapshot_requester();
+      auto co_request_bulk_snapshot = [&](const auto &instruments, auto on_snapshot) noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+        for(auto instrument_id: instruments)
+          on_snapshot(instrument_id, BOOST_LEAF_CO_TRYX(co_await co_request_snapshot(instrument_id)));
+        co_return boost::leaf::success();
+      };
       auto updates_socket = backtest::make_update_source();
 #else // defined(BACKTEST_HARNESS)
-      auto snapshot_socket = ({
-          const auto [snapshot_host, snapshot_port] = (config::address)*properties["feed"_hs]["snapshot"_hs];
-          const auto snapshot_endpoints = BOOST_LEAF_EC_TRYX(asio::ip::tcp::resolver(service).resolve(snapshot_host, snapshot_port, _));
-          auto snapshot_socket = asio::ip::tcp::socket(service);
-          BOOST_LEAF_EC_TRYV(asio::connect(snapshot_socket, snapshot_endpoints, _));
-          std::move(snapshot_socket);
-      });
+      // from a feed handler on the same box (see feed_handler.cpp): the snapshots read from its table, no snapshot server
+      std::optional<feed::state_table_reader> state_table;
+      if(const auto state_table_name = properties["feed"_hs]["state_table"_hs]; state_table_name)
+      {
+#  if defined(USE_SHM_RING)
+        state_table.emplace(BOOST_LEAF_TRYX(feed::state_table_reader::open(*state_table_name)));
+#  else  // defined(USE_SHM_RING)
+        // the updates are not the handler's
+        return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_supported), ::boilerplate::statement {"feed.state_table"});
+#  endif // defined(USE_SHM_RING)
+      }
+
+      auto snapshot_socket = asio::ip::tcp::socket(service);
+      if(!state_table)
+      {
+        const auto [snapshot_host, snapshot_port] = (config::address)*properties["feed"_hs]["snapshot"_hs];
+        const auto snapshot_endpoints = BOOST_LEAF_EC_TRYX(asio::ip::tcp::resolver(service).resolve(snapshot_host, snapshot_port, _));
+        BOOST_LEAF_EC_TRYV(asio::connect(snapshot_socket, snapshot_endpoints, _));
+
+        if(const auto max_version = max_wire_version(properties["feed"_hs]); max_version)
+        {
+          spawn([&, max_version = *max_version]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+            wire_version = BOOST_LEAF_CO_TRYX(co_await feed::co_request_version(snapshot_socket, max_version));
+            logger_ptr->log(logger::info, "wire_version={} Version negotiated."_format, std::to_underlying(*wire_version));
+            co_return boost::leaf::success();
+          }, "version"s);
+          while(!wire_version && !service.stopped())
+            BOOST_LEAF_EC_TRYV(service.poll(_));
+        }
+      }
 
-      auto co_request_snapshot = [snapshot_socket = std::move(snapshot_socket), logger_ptr] (auto instrument_id) mutable noexcept -> boost::leaf::awaitable<boost::leaf::result<feed::instrument_state>> {
+      auto co_request_snapshot = [&snapshot_socket, &state_table, logger_ptr] (auto instrument_id) mutable noexcept -> boost::leaf::awaitable<boost::leaf::result<feed::instrument_state>> {
         REQUIRES(automaton);
+        if(state_table)
+        {
+          auto state = state_table->load(instrument_id);
+          logger_ptr->log(logger::debug, "instrument=\"{}\" sequence_id={} loaded snapshot"_format, instrument_id, state.sequence_id);
+          co_return state;
+        }
         logger_ptr->log(logger::debug, "instrument=\"{}\" request snapshot"_format, instrument_id);
         auto state = BOOST_LEAF_CO_TRYX(co_await feed::co_request_snapshot(snapshot_socket, instrument_id));
         logger_ptr->log(logger::debug, "instrument=\"{}\" sequence_id={} received snapshot"_format, instrument_id, state.sequence_id);
         co_return state;
       };
 
+      auto co_request_bulk_snapshot = [&snapshot_socket, &state_table, logger_ptr](const auto &instruments, auto on_snapshot) noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+        if(state_table)
+        {
+          for(auto instrument_id: instruments)
+            on_snapshot(instrument_id, state_table->load(instrument_id));
+          co_return boost::leaf::success();
+        }
+        logger_ptr->log(logger::debug, "nb_instruments={} request bulk snapshot"_format, instruments.size());
+        BOOST_LEAF_CO_TRYV(co_await feed::co_request_bulk_snapshot(snapshot_socket, instruments, [&](auto instrument_id, feed::instrument_state &&state) noexcept {
+          logger_ptr->log(logger::debug, "instrument=\"{}\" sequence_id={} received snapshot"_format, instrument_id, state.sequence_id);
+          on_snapshot(instrument_id, std::move(state));
+        }));
+        co_return boost::leaf::success();
+      };
+
+#  if defined(USE_SHM_RING)
+      // from a publisher on the same box (see feed::server, or feed_handler.cpp): the ring named by feed.update_ring, no syscall
+      const config::string_type &updates_ring_name = *properties["feed"_hs]["update_ring"_hs];
+      auto updates_socket = BOOST_LEAF_TRYX(feed::ring_reader::open(updates_ring_name));
+
+      // a ring is not lossy the way a line is
+      std::optional<decltype(updates_socket)> updates_b_socket;
+      if(properties["feed"_hs]["update_b"_hs])
+        return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_supported), ::boilerplate::statement {"feed.update_b"});
+#  else  // defined(USE_SHM_RING)
       const auto [updates_host, updates_port] = (config::address)*properties["feed"_hs]["update"_hs];
-#  if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
-      auto updates_socket = BOOST_LEAF_TRYX(multicast_udp_reader::create(service, updates_host, updates_port, properties["feed"_hs]["spin_duration"_hs].get_or(1'000ns), properties["feed"_hs]["timestamping"_hs].get_or(false)));
+#  if defined(USE_AF_XDP)
+      const config::string_type &interface = *properties["feed"_hs]["interface"_hs];
+      const auto create_updates_socket = [&](std::string_view host, std::string_view port) noexcept {
+        return multicast_udp_reader::create(service, host, port, interface, properties["feed"_hs]["queue"_hs].get_or(0), properties["feed"_hs]["zero_copy"_hs].get_or(false));
+      };
+#  elif defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+      // with a second line, the lines are read in turn without waiting on either: a wait on A would hold back the first arrivals on B
+      const auto spin_duration = properties["feed"_hs]["update_b"_hs] ? 0ns : properties["feed"_hs]["spin_duration"_hs].get_or(1'000ns);
+      // dequeue (default), software or hardware
+      const auto timestamping = ({
+          using namespace std::string_view_literals;
+          const config::string_type name = properties["feed"_hs]["timestamping"_hs].get_or(config::string_type("dequeue"));
+          if(name != "dequeue"sv && name != "software"sv && name != "hardware"sv)
+            return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"feed.timestamping"});
+          name == "hardware"sv ? rx_timestamping::hardware : name == "software"sv ? rx_timestamping::software : rx_timestamping::dequeue;
+      });
+#    if defined(USE_IO_URING)
+      const auto create_updates_socket = [&](std::string_view host, std::string_view port) noexcept {
+        return multicast_udp_reader::create(service, host, port, spin_duration, timestamping, properties["feed"_hs]["sqpoll"_hs].get_or(false));
+      };
+#    elif defined(USE_PACKET_MMAP)
+      const config::string_type interface = properties["feed"_hs]["interface"_hs].get_or(config::string_type());
+      const auto create_updates_socket = [&](std::string_view host, std::string_view port) noexcept {
+        return multicast_udp_reader::create(service, host, port, spin_duration, timestamping, interface);
+      };
+#    else  // defined(USE_IO_URING)
+      const auto create_updates_socket = [&](std::string_view host, std::string_view port) noexcept {
+        return multicast_udp_reader::create(service, host, port, spin_duration, timestamping);
+      };
+#    endif // defined(USE_IO_URING)
 #  else
-      auto updates_socket = BOOST_LEAF_TRYX(multicast_udp_reader::create(service, updates_host, updates_port));
+      const auto create_updates_socket = [&](std::string_view host, std::string_view port) noexcept { return multicast_udp_reader::create(service, host, port); };
 #  endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+      auto updates_socket = BOOST_LEAF_TRYX(create_updates_socket(updates_host, updates_port));
+
+      // A/B arbitration (opt-in): the same feed on a second line
+      std::optional<decltype(updates_socket)> updates_b_socket;
+      if(const auto update_b = properties["feed"_hs]["update_b"_hs]; update_b)
+      {
+#  if defined(USE_AF_XDP)
+        // the XDP program of the interface redirects one group
+        return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_supported), ::boilerplate::statement {"feed.update_b"});
+#  else  // defined(USE_AF_XDP)
+        const auto [updates_b_host, updates_b_port] = (config::address)*update_b;
+        updates_b_socket.emplace(BOOST_LEAF_TRYX(create_updates_socket(updates_b_host, updates_b_port)));
+#  endif // defined(USE_AF_XDP)
+      }
+#  endif // defined(USE_SHM_RING)
 #endif // defined(BACKTEST_HARNESS)
 
-      auto receive = [updates_socket = std::move(updates_socket), spin_count = std::min(std::size_t(properties["feed"_hs]["spin_count"_hs].get_or(1)), std::size_t(1))](auto continuation) mutable noexcept {
+#if defined(BACKTEST_HARNESS)
+      auto receive = [&updates_socket, spin_count = std::min(std::size_t(properties["feed"_hs]["spin_count"_hs].get_or(1)), std::size_t(1))](auto continuation, [[maybe_unused]] auto *arbiter_ptr) mutable noexcept {
         using namespace piped_continuation;
         for(auto n = spin_count; n; --n)
           (std::ref(updates_socket) |= continuation)();
       };
+#else  // defined(BACKTEST_HARNESS)
+      // with a second line, each datagram goes through the arbiter: the first arrival is passed on, the duplicate dropped
+      auto receive = [&updates_socket, &updates_b_socket, spin_count = std::min(std::size_t(properties["feed"_hs]["spin_count"_hs].get_or(1)), std::size_t(1))](auto continuation, auto *arbiter_ptr) mutable noexcept {
+        using namespace piped_continuation;
+        for(auto n = spin_count; n; --n)
+        {
+          if(!arbiter_ptr) [[likely]]
+          {
+            (std::ref(updates_socket) |= continuation)();
+            continue;
+          }
+          for(std::size_t line = 0; line != std::decay_t<decltype(*arbiter_ptr)>::nb_lines; ++line)
+            (line ? *updates_b_socket : updates_socket)([&](const network_clock::time_point &timestamp, auto &&buffer) noexcept {
+              if((*arbiter_ptr)(line, timestamp, buffer))
+                continuation(timestamp, std::forward<decltype(buffer)>(buffer));
+            });
+        }
+      };
+#endif // defined(BACKTEST_HARNESS)
+
+      //
+      // record (opt-in): the datagrams as received, for replay
+
+      std::unique_ptr<feed::recorder> recorder_ptr;
+      if(const auto capture_path = properties["feed"_hs]["capture"_hs]; capture_path)
+        recorder_ptr = BOOST_LEAF_TRYX(feed::recorder::create(
+          {.path = *capture_path, .file_size = std::size_t(properties["feed"_hs]["capture_file_size"_hs].get_or(1'073'741'824))}));
+
+      const auto record = [recorder_ptr = recorder_ptr.get()](auto continuation, const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept {
+        if(recorder_ptr)
+          (*recorder_ptr)(timestamp, buffer);
+        return continuation(timestamp, buffer);
+      };
 
       //
       // decode
 
-      const auto decode = [&](auto &automata) noexcept {
-        const auto decode_header = [&](feed::instrument_id_type instrument_id, feed::sequence_id_type sequence_id) noexcept
-        {
-          auto *const automaton_ptr = automata.at_if_not_disabled(instrument_id);
-          auto snapshot_requester = [&](auto termination_handler) {
-            spawn([&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
-              auto state = BOOST_LEAF_CO_TRYX(co_await co_request_snapshot(automaton_ptr->instrument_id));
-              automaton_ptr->apply(std::move(state));
-              co_return boost::leaf::success();
-            }, "request_snapshot"s);
-          };
-          return LIKELY(automaton_ptr) && LIKELY(automaton_ptr->handle_sequence_id(sequence_id, snapshot_requester)) ? automaton_ptr : nullptr;
-        };
+      // reset_decoders(instrument_id, state) with each snapshot
+      const auto decode = [&](auto &automata, auto &decoder, auto &reset_decoders) noexcept {
+        const auto decode_header = boilerplate::overloaded {
+          [&](feed::instrument_id_type instrument_id, feed::sequence_id_type sequence_id) noexcept
+          {
+            auto *const automaton_ptr = automata.at_if_not_disabled(instrument_id);
+            auto snapshot_requester = [&](auto termination_handler) {
+              spawn([&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+                auto state = BOOST_LEAF_CO_TRYX(co_await co_request_snapshot(automaton_ptr->instrument_id));
+                reset_decoders(automaton_ptr->instrument_id, state);
+                automaton_ptr->apply(std::move(state));
+                co_return boost::leaf::success();
+              }, "request_snapshot"s);
+            };
+            return LIKELY(automaton_ptr) && LIKELY(automaton_ptr->handle_sequence_id(sequence_id, snapshot_requester)) ? automaton_ptr : nullptr;
+          },
+          // a snapshot on the wire (see feed::decoder): applied as the ones of the snapshot server
+          [&](feed::instrument_id_type instrument_id, const feed::instrument_state &snapshot) noexcept
+          {
+            if(auto *const automaton_ptr = automata.at_if_not_disabled(instrument_id); automaton_ptr)
+            {
+              reset_decoders(instrument_id, snapshot);
+              automaton_ptr->apply(feed::instrument_state(snapshot));
+            }
+          }};
 
-        return [decode_header](auto continuation, const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept { return feed::detail::decode(decode_header, continuation, timestamp, buffer); };
+        return [decode_header, &decoder](auto continuation, const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept { return decoder(decode_header, continuation, timestamp, buffer); };
       };
 
       //
@@ -255,15 +396,134 @@ auto main() -> int
       // send
 
       const auto [send_host, send_port] = (config::address)*properties["send"_hs]["datagram"_hs];
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
+      // none (default), software or hardware
+      const auto tx_timestamping = ({
+          using namespace std::string_view_literals;
+          const config::string_type name = properties["send"_hs]["tx_timestamping"_hs].get_or(config::string_type("none"));
+          if(name != "none"sv && name != "software"sv && name != "hardware"sv)
+            return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"send.tx_timestamping"});
+          name == "hardware"sv ? tx_timestamping::hardware : name == "software"sv ? tx_timestamping::software : tx_timestamping::none;
+      });
+      auto send_datagram_socket = *properties["send"_hs]["datagram"_hs] ? std::make_optional(BOOST_LEAF_TRYX(udp_writer::create(service, send_host, send_port, tx_timestamping))) : std::nullopt;
+#else  // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
       auto send_datagram_socket = *properties["send"_hs]["datagram"_hs] ? std::make_optional(BOOST_LEAF_TRYX(udp_writer::create(service, send_host, send_port))) : std::nullopt;
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
 
 #if defined(BACKTEST_HARNESS)
       auto stream_send = backtest::make_stream_send();
 #else  // defined(BACKTEST_HARNESS)
-      auto send_stream = asio::posix::stream_descriptor(service, ::dup(*properties["send"_hs]["fd"_hs]));
-      auto stream_send = [send_stream = std::move(send_stream)](auto buffer) mutable noexcept -> boost::leaf::result<bool> { return BOOST_LEAF_EC_TRYX(asio::write(send_stream, buffer, _)) == buffer.size(); };
+      auto send_stream = BOOST_LEAF_TRYX(
+        stream_writer::create(service, ::dup(*properties["send"_hs]["fd"_hs]), std::size_t(properties["send"_hs]["overflow_capacity"_hs].get_or(65'536))));
+      [[maybe_unused]] const int send_stream_fd = send_stream.native_handle();
+#  if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+      // the stream has to be a TCP socket then
+      BOOST_LEAF_CHECK(tx_timestamps::enable(send_stream.native_handle(), tx_timestamping));
+#  endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA)
+      // none (default: the payloads as they are) or length (each one behind its length, 4 bytes big endian)
+      const bool length_framing = ({
+          using namespace std::string_view_literals;
+          const config::string_type name = properties["send"_hs]["framing"_hs].get_or(config::string_type("none"));
+          if(name != "none"sv && name != "length"sv)
+            return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"send.framing"});
+          name == "length"sv;
+      });
+      const auto stream_send = [&send_stream, length_framing](const asio::const_buffer &buffer) noexcept -> boost::leaf::result<bool> {
+        if(!length_framing)
+          return send_stream.send(buffer);
+        const std::uint32_t length = htonl(static_cast<std::uint32_t>(buffer.size()));
+        return send_stream.send(asio::buffer(&length, sizeof(length)), buffer);
+      };
+
+      // the send path kept hot between the triggers
+      spawn([&, period = properties["send"_hs]["warm_period"_hs].get_or(1'000'000ns)]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+        asio::steady_timer timer(service);
+        for(;;)
+        {
+          timer.expires_after(period);
+          BOOST_LEAF_ASIO_CO_TRYV(co_await timer.async_wait(_));
+          send_stream.warm();
+        }
+      }, "stream warm up"s);
 #endif // defined(BACKTEST_HARNESS)
 
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
+      //
+      // TX timestamps (opt-in): the sends are recorded by id, the timestamps drained from the slow path and matched back
+
+      struct tx_record
+      {
+        feed::instrument_id_type instrument_id;
+        network_clock::time_point in_ts, out_ts;
+      };
+      struct tx_line
+      {
+        int fd;
+        std::string_view name;
+        tx_records<tx_record> records {};
+        latency_histogram latencies {}; // from the reception of the update to the wire
+        std::uint64_t next_id = 0;      // datagrams for a datagram socket, bytes for a stream one
+      };
+      tx_line datagram_tx {.fd = send_datagram_socket ? send_datagram_socket->native_handle() : -1, .name = "datagram"},
+        stream_tx {.fd = send_stream_fd, .name = "stream"};
+
+      if(tx_timestamping != tx_timestamping::none)
+        spawn([&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+          asio::steady_timer timer(service);
+          for(;;)
+          {
+            timer.expires_after(std::chrono::milliseconds(1));
+            BOOST_LEAF_ASIO_CO_TRYV(co_await timer.async_wait(_));
+            for(auto *line: {&datagram_tx, &stream_tx})
+              if(line->fd >= 0)
+                BOOST_LEAF_CO_TRYV(tx_timestamps::drain(line->fd, [&](std::uint32_t id, const network_clock::time_point &wire_ts) noexcept {
+                  if(const auto *record = line->records.match(id); record)
+                  {
+                    line->latencies.record(wire_ts - record->in_ts);
+                    logger_ptr->log(logger::info, "instrument={} in_ts={} out_ts={} wire_ts={} line={} Payload on the wire"_format, record->instrument_id,
+                                    to_timespec(record->in_ts), to_timespec(record->out_ts), to_timespec(wire_ts), line->name);
+                  }
+                }));
+          }
+        }, "tx timestamps"s);
+
+      // a stream send is keyed by the offset of its last byte: a queued message takes its bytes of the stream, but is not timed
+      const auto record_stream_send = [&](auto *instrument_ptr, const network_clock::time_point &feed_timestamp, const auto &stream_send_result) noexcept {
+        if(stream_send_result) [[likely]]
+        {
+          stream_tx.next_id += (length_framing ? sizeof(std::uint32_t) : 0) + instrument_ptr->payload.stream_payload.size;
+          if(*stream_send_result) [[likely]]
+            stream_tx.records.push(static_cast<std::uint32_t>(stream_tx.next_id - 1), {instrument_ptr->instrument_id, feed_timestamp, network_clock::now()});
+        }
+      };
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
+
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+      //
+      // batched send (opt-in): the sends of a pass of the fast path are queued on a ring, out of registered copies of the payloads, and submitted
+      // together after it
+
+      std::unique_ptr<uring_sender> sender_ptr;
+      if(properties["send"_hs]["batched"_hs].get_or(false))
+      {
+        // the registered copies are the payloads alone
+        if(length_framing)
+          return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"send.framing"});
+        sender_ptr = BOOST_LEAF_TRYX(uring_sender::create(properties["send"_hs]["nb_slots"_hs].get_or(256), properties["send"_hs]["sqpoll"_hs].get_or(false)));
+      }
+      const int send_datagram_fd = send_datagram_socket ? send_datagram_socket->native_handle() : -1;
+
+      // the payloads are registered as they are set (see the main loop and the commands): a datagram whole, the stream written in order
+      const auto queue_datagram = [&](auto *instrument_ptr) noexcept -> boost::leaf::result<network_clock::time_point> {
+        BOOST_LEAF_CHECK(sender_ptr->send(send_datagram_fd, *instrument_ptr->payload.datagram_registration));
+        return network_clock::now();
+      };
+      const auto queue_stream = [&](auto *instrument_ptr) noexcept -> boost::leaf::result<bool> {
+        BOOST_LEAF_CHECK(sender_ptr->write(send_stream_fd, *instrument_ptr->payload.stream_registration));
+        return true;
+      };
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+
       const auto send = [&](auto &automata) {
         constexpr bool send_datagram = std::decay_t<decltype(automata)>::automaton_type::send_datagram;
 
@@ -277,8 +537,21 @@ auto main() -> int
               return false;
             }
 
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+            auto send_timestamp_result = sender_ptr ? queue_datagram(instrument_ptr) : send_datagram_socket->send(instrument_ptr->payload.datagram_payload);
+            auto stream_send_result = sender_ptr ? queue_stream(instrument_ptr) : stream_send(asio::const_buffer(instrument_ptr->payload.stream_payload));
+#else  // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
             auto send_timestamp_result = send_datagram_socket->send(instrument_ptr->payload.datagram_payload);
             auto stream_send_result = stream_send(asio::const_buffer(instrument_ptr->payload.stream_payload));
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
+            if(tx_timestamping != tx_timestamping::none)
+            {
+              if(send_timestamp_result)
+                datagram_tx.records.push(static_cast<std::uint32_t>(datagram_tx.next_id++), {instrument_ptr->instrument_id, feed_timestamp, *send_timestamp_result});
+              record_stream_send(instrument_ptr, feed_timestamp, stream_send_result);
+            }
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
 
             if(send_timestamp_result) [[likely]]
               logger_ptr->log(logger::info, "instrument={} in_ts={} out_ts={} Payload datagram sent"_format, instrument_ptr->instrument_id, to_timespec(feed_timestamp),
@@ -293,7 +566,15 @@ auto main() -> int
           }
           else
           {
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+            auto stream_send_result = sender_ptr ? queue_stream(instrument_ptr) : stream_send(asio::const_buffer(instrument_ptr->payload.stream_payload));
+#else  // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
             auto stream_send_result = stream_send(asio::const_buffer(instrument_ptr->payload.stream_payload));
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
+            if(tx_timestamping != tx_timestamping::none)
+              record_stream_send(instrument_ptr, feed_timestamp, stream_send_result);
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
 
             if(stream_send_result && *stream_send_result) [[likely]]
               logger_ptr->log(logger::info, "instrument={} in_ts={} Payload sent"_format, instrument_ptr->instrument_id, to_timespec(feed_timestamp));
@@ -349,100 +630,265 @@ auto main() -> int
       //
       // main loop
 
-      auto run = with_automata(properties["config"_hs], logger_ptr, [&](auto &&automata) noexcept -> boost::leaf::result<void> {
-        using automata_type = std::decay_t<decltype(automata)>;
+      auto run = with_decoder(properties["feed"_hs], wire_version, [&](auto &&decoder) noexcept -> boost::leaf::result<void> {
+        return with_automata(properties["config"_hs], logger_ptr, [&](auto &&automata) noexcept -> boost::leaf::result<void> {
+          using automata_type = std::decay_t<decltype(automata)>;
+
+          //
+          // decoders: the one of the fast path, and one per line if arbitrated, all starting from each snapshot
+
+          std::optional<line_arbiter<std::decay_t<decltype(decoder)>>> arbiter;
+#if !defined(BACKTEST_HARNESS)
+          if(updates_b_socket)
+            arbiter.emplace(decoder);
+#endif // !defined(BACKTEST_HARNESS)
+          const auto reset_decoders = [&](feed::instrument_id_type instrument_id, const feed::instrument_state &state) noexcept {
+            decoder.reset(instrument_id, state);
+            if(arbiter)
+              arbiter->reset(instrument_id, state);
+          };
 
-        //
-        // initial snapshot (if !dynamic_subscription)
+          //
+          // kernel filter (opt-in, binary format): the packets with none of the instruments subscribed to dropped before the copy, the filter
+          // regenerated on each subscription
+
+          const bool kernel_filter = properties["feed"_hs]["kernel_filter"_hs].get_or(false);
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP) && !defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          constexpr bool binary_format = std::is_same_v<std::decay_t<decltype(decoder)>, feed::binary_decoder>
+                                         || std::is_same_v<std::decay_t<decltype(decoder)>, feed::binary_v1_decoder>;
+          const auto update_kernel_filter = [&](std::optional<feed::instrument_id_type> subscribing = std::nullopt) noexcept -> boost::leaf::result<void> {
+            if(!kernel_filter || !binary_format)
+              return {};
+            std::vector<feed::instrument_id_type> instrument_ids;
+            automata.each([&](auto &automaton) noexcept { instrument_ids.push_back(automaton.instrument_id); });
+            if(subscribing)
+              instrument_ids.push_back(*subscribing);
+            const auto program = feed::make_socket_filter(instrument_ids);
+            BOOST_LEAF_CHECK(updates_socket.filter(program));
+            if(updates_b_socket)
+              BOOST_LEAF_CHECK(updates_b_socket->filter(program));
+            logger_ptr->log(logger::debug, "nb_instruments={} nb_instructions={} kernel filter updated"_format, instrument_ids.size(), program.size());
+            return {};
+          };
+#else  // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP) && !defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          // the kernel does not see the datagrams (or not through the socket)
+          if(kernel_filter)
+            return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_supported), ::boilerplate::statement {"feed.kernel_filter"});
+          const auto update_kernel_filter = []([[maybe_unused]] std::optional<feed::instrument_id_type> subscribing = std::nullopt) noexcept -> boost::leaf::result<void> { return {}; };
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP) && !defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          BOOST_LEAF_CHECK(update_kernel_filter());
+
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+          //
+          // batched send: the payloads registered before the first send, then as they change
+
+          if(sender_ptr)
+          {
+            boost::leaf::result<void> registered;
+            automata.each([&](auto &automaton) noexcept {
+              if(registered)
+                registered = automaton.payload.register_with(*sender_ptr);
+            });
+            BOOST_LEAF_CHECK(registered);
+          }
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+
+          //
+          // sharded groups: joined and left with the subscriptions, multiplexed on the updates socket
+
+          auto memberships = BOOST_LEAF_TRYX(group_membership::create(properties["feed"_hs]));
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP) && !defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          // the B line is one group
+          if(!memberships.empty() && updates_b_socket)
+            return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_supported), ::boilerplate::statement {"feed.sharded_groups"});
+          const auto update_membership = [&](feed::instrument_id_type instrument_id, bool subscribing) noexcept -> boost::leaf::result<void> {
+            if(const auto group = subscribing ? memberships.subscribe(instrument_id) : memberships.unsubscribe(instrument_id); group)
+            {
+              const auto address = BOOST_LEAF_EC_TRYX(asio::ip::make_address(*group, _));
+              BOOST_LEAF_CHECK(subscribing ? updates_socket.join(address) : updates_socket.leave(address));
+              logger_ptr->log_non_trivial(logger::info, "group={} instrument={} joined={} Group membership changed"_format, *group, instrument_id, subscribing);
+            }
+            return {};
+          };
+#else  // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP) && !defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          // no membership of the socket to change
+          if(!memberships.empty())
+            return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_supported), ::boilerplate::statement {"feed.sharded_groups"});
+          const auto update_membership = []([[maybe_unused]] feed::instrument_id_type instrument_id, [[maybe_unused]] bool subscribing) noexcept -> boost::leaf::result<void> { return {}; };
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(USE_AF_XDP) && !defined(USE_PACKET_MMAP) && !defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          if(!automata_type::dynamic_subscription)
+          {
+            std::vector<feed::instrument_id_type> instrument_ids;
+            automata.each([&](auto &automaton) noexcept { instrument_ids.push_back(automaton.instrument_id); });
+            for(const auto instrument_id: instrument_ids)
+              BOOST_LEAF_CHECK(update_membership(instrument_id, true));
+          }
+
+          //
+          // initial snapshot (if !dynamic_subscription)
+
+          if(!automata_type::dynamic_subscription)
+          {
+            std::vector<feed::instrument_id_type> instrument_ids;
+            automata.each([&](auto &automaton) noexcept { instrument_ids.push_back(automaton.instrument_id); });
 
-        if(!automata_type::dynamic_subscription)
-        {
-          automata.each([&](auto &automaton) noexcept -> boost::leaf::result<void> {
             bool done = false;
-            spawn([&]() -> boost::leaf::awaitable<boost::leaf::result<void>> {
-              auto state = BOOST_LEAF_CO_TRYX(co_await co_request_snapshot(automaton.instrument_id));
-              automaton.trigger.reset(std::move(state));
+            spawn([&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+              BOOST_LEAF_CO_TRYV(co_await co_request_bulk_snapshot(instrument_ids, [&](feed::instrument_id_type instrument_id, feed::instrument_state &&state) noexcept {
+                if(auto *automaton_ptr = automata.at(instrument_id); automaton_ptr) [[likely]]
+                {
+                  reset_decoders(instrument_id, state);
+                  automaton_ptr->apply(std::move(state));
+                }
+              }));
               done = true;
               co_return boost::leaf::success();
             }, "initial snapshot"s);
-            while(!done)
+            while(!done && !service.stopped())
               BOOST_LEAF_EC_TRYV(service.poll(_));
-            return boost::leaf::success();
-          });
-        }
+          }
 
-        //
-        // commands
+          //
+          // commands
 
-        spawn([&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
-          using namespace dispatch::literals;
-  
-          constexpr bool send_datagram = automata_type::automaton_type::send_datagram;
-          constexpr bool dynamic_subscription = automata_type::dynamic_subscription;
-  
-          std::string command_buffer;
-  
-          for(;;)
-          {
-            logger_ptr->log(logger::debug, "awaiting commands");
-            const auto command_size = BOOST_LEAF_ASIO_CO_TRYX(
-              co_await asio::async_read_until(command_input, dynamic_command_input_buffer, "\n\n", _));
-  
-            const auto properties = BOOST_LEAF_CO_TRYX(config::properties::create(boost::make_iterator_range(command_input_buffer.begin(), command_input_buffer.begin() + command_size)));
-            const auto entrypoint = properties["entrypoint"_hs];
-            logger_ptr->log_non_trivial(logger::debug, "command=\"{}\" command recieved"_format, entrypoint["type"_hs]);
-            switch(dispatch_hash(*entrypoint["type"_hs])) // TODO
+          spawn([&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>> {
+            using namespace dispatch::literals;
+    
+            constexpr bool send_datagram = automata_type::automaton_type::send_datagram;
+            constexpr bool dynamic_subscription = automata_type::dynamic_subscription;
+    
+            std::string command_buffer;
+    
+            for(;;)
             {
-            case "payload"_h:
-              if(auto *automaton_ptr = automata.at(*entrypoint["instrument"_hs]); automaton_ptr)
-                automaton_ptr->payload = BOOST_LEAF_CO_TRYX(decode_payload<send_datagram>(entrypoint));
-              break;
-            case "subscribe"_h:
-              if constexpr(dynamic_subscription)
+              logger_ptr->log(logger::debug, "awaiting commands");
+              const auto command_size = BOOST_LEAF_ASIO_CO_TRYX(
+                co_await asio::async_read_until(command_input, dynamic_command_input_buffer, "\n\n", _));
+    
+              const auto properties = BOOST_LEAF_CO_TRYX(config::properties::create(boost::make_iterator_range(command_input_buffer.begin(), command_input_buffer.begin() + command_size)));
+              const auto entrypoint = properties["entrypoint"_hs];
+              logger_ptr->log_non_trivial(logger::debug, "command=\"{}\" command recieved"_format, entrypoint["type"_hs]);
+              switch(dispatch_hash(*entrypoint["type"_hs])) // TODO
               {
-                const feed::instrument_id instrument_id = *entrypoint["instrument"_hs];
-                auto state = BOOST_LEAF_CO_TRYX(co_await co_request_snapshot(instrument_id));
-                BOOST_LEAF_CO_TRYV(with_trigger(entrypoint, logger_ptr, [&](auto &&upstream_dispatcher) noexcept -> boost::leaf::result<void> {
-                  auto poly_dispatcher = polymorphic_trigger_dispatcher::make<std::decay_t<decltype(upstream_dispatcher)>>(std::move(upstream_dispatcher));
-                  poly_dispatcher.reset(std::move(state));
-                  auto payload = BOOST_LEAF_TRYX(decode_payload<send_datagram>(entrypoint));
-                  automata.emplace({.instrument_id = instrument_id, .trigger = std::move(poly_dispatcher), .payload = std::move(payload)});
-                  return boost::leaf::success();
-                })());
+              case "payload"_h:
+                if(auto *automaton_ptr = automata.at(*entrypoint["instrument"_hs]); automaton_ptr)
+                {
+                  auto payload = BOOST_LEAF_CO_TRYX(decode_payload<send_datagram>(entrypoint));
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+                  if(sender_ptr)
+                    BOOST_LEAF_CO_TRYV(payload.register_with(*sender_ptr));
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+                  automaton_ptr->payload = std::move(payload);
+                }
+                break;
+              case "subscribe"_h:
+                if constexpr(dynamic_subscription)
+                {
+                  const feed::instrument_id instrument_id = *entrypoint["instrument"_hs];
+                  // the updates let through before the snapshot is requested
+                  BOOST_LEAF_CO_TRYV(update_kernel_filter(instrument_id));
+                  BOOST_LEAF_CO_TRYV(update_membership(instrument_id, true));
+                  auto state = BOOST_LEAF_CO_TRYX(co_await co_request_snapshot(instrument_id));
+                  BOOST_LEAF_CO_TRYV(with_trigger(entrypoint, logger_ptr, [&](auto &&upstream_dispatcher) noexcept -> boost::leaf::result<void> {
+                    auto poly_dispatcher = polymorphic_trigger_dispatcher::make<std::decay_t<decltype(upstream_dispatcher)>>(std::move(upstream_dispatcher));
+                    reset_decoders(instrument_id, state);
+                    poly_dispatcher.reset(std::move(state));
+                    auto payload = BOOST_LEAF_TRYX(decode_payload<send_datagram>(entrypoint));
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+                    if(sender_ptr)
+                      BOOST_LEAF_CHECK(payload.register_with(*sender_ptr));
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+                    automata.emplace({.instrument_id = instrument_id, .trigger = std::move(poly_dispatcher), .payload = std::move(payload)});
+                    return boost::leaf::success();
+                  })());
+                }
+                break;
+              case "unsubscribe"_h:
+                if constexpr(dynamic_subscription)
+                {
+                  const feed::instrument_id_type instrument_id = *entrypoint["instrument"_hs];
+                  automata.erase(instrument_id);
+                  BOOST_LEAF_CO_TRYV(update_kernel_filter());
+                  BOOST_LEAF_CO_TRYV(update_membership(instrument_id, false));
+                }
+                break;
+              case "quit"_h: service.stop(); break;
+              case "detach"_h: co_return boost::leaf::success();
               }
-              break;
-            case "unsubscribe"_h:
-              if constexpr(dynamic_subscription)
-                automata.erase(*entrypoint["instrument"_hs]);
-              break;
-            case "quit"_h: service.stop(); break;
-            case "detach"_h: co_return boost::leaf::success();
+              dynamic_command_input_buffer.consume(command_size);
             }
-            dynamic_command_input_buffer.consume(command_size);
-          }
-        }, "commands"s);
+          }, "commands"s);
 
-        using namespace piped_continuation;
-        auto send_ = send(automata);
-        auto fast_path = std::ref(receive) |= decode(automata) |= trigger |= std::ref(send_) |= post_send(properties, automata);
+          auto arbitrated_receive = [&](auto continuation) noexcept { return receive(continuation, arbiter ? &*arbiter : nullptr); };
 
-        while(!service.stopped()) [[likely]]
-        {
-          // warm up
-          automata.each([&](auto &automaton) {
-              automaton.trigger.warm_up();
-              auto *instrument_ptr = &automaton;
-              send_([]([[maybe_unused]] auto *instrument_ptr){ return true; }, network_clock::time_point {}, instrument_ptr, std::false_type {});
-          });
-          asm volatile("# LLVM-MCA-BEGIN trigger");
-          fast_path();
-          asm volatile("# LLVM-MCA-END trigger");
-
-          BOOST_LEAF_EC_TRYV(service.poll(_));
-          logger_ptr->flush();
-        }
-        logger_ptr->log(logger::info, "Executor stopped.");
-        return boost::leaf::success();
+          using namespace piped_continuation;
+          auto send_ = send(automata);
+          auto fast_path = std::ref(arbitrated_receive) |= record |= decode(automata, decoder, reset_decoders) |= trigger |= std::ref(send_) |= post_send(properties, automata);
+
+          while(!service.stopped()) [[likely]]
+          {
+            // warm up
+            automata.each([&](auto &automaton) {
+                automaton.trigger.warm_up();
+                auto *instrument_ptr = &automaton;
+                send_([]([[maybe_unused]] auto *instrument_ptr){ return true; }, network_clock::time_point {}, instrument_ptr, std::false_type {});
+            });
+            asm volatile("# LLVM-MCA-BEGIN trigger");
+            fast_path();
+            asm volatile("# LLVM-MCA-END trigger");
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+            if(sender_ptr)
+            {
+              BOOST_LEAF_CHECK(sender_ptr->flush());
+              sender_ptr->reap();
+            }
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+#if !defined(BACKTEST_HARNESS)
+            if(send_stream.backlogged()) [[unlikely]]
+              BOOST_LEAF_CHECK(send_stream.drain());
+#endif // !defined(BACKTEST_HARNESS)
+
+            BOOST_LEAF_EC_TRYV(service.poll(_));
+            logger_ptr->flush();
+            if(recorder_ptr)
+              recorder_ptr->flush();
+          }
+          if(recorder_ptr)
+            logger_ptr->log(logger::info, "nb_recorded={} nb_dropped={} nb_write_errors={} Recorder stopped."_format, recorder_ptr->nb_written(),
+                            recorder_ptr->nb_dropped(), recorder_ptr->nb_write_errors());
+#if defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          logger_ptr->log(logger::info, "nb_overruns={} nb_lost_bytes={} Receiver stopped."_format, updates_socket.nb_overruns(), updates_socket.nb_lost_bytes());
+#elif !defined(BACKTEST_HARNESS) && !defined(USE_TCPDIRECT)
+          const auto &timestamps = updates_socket.timestamps_statistics();
+          logger_ptr->log(logger::info, "nb_missing_timestamps={} nb_software_fallbacks={} Receiver stopped."_format, timestamps.nb_missing(),
+                          timestamps.nb_fallbacks());
+#endif // defined(USE_SHM_RING) && !defined(BACKTEST_HARNESS)
+          if(arbiter)
+            for(std::size_t line = 0; line != arbiter->nb_lines; ++line)
+            {
+              const auto &statistics = arbiter->statistics(line);
+              logger_ptr->log(logger::info, "line={} nb_datagrams={} nb_wins={} nb_gaps={} nb_gaps_filled={} Arbitration."_format, line ? "B" : "A",
+                              statistics.nb_datagrams, statistics.nb_wins, statistics.nb_gaps, statistics.nb_gaps_filled);
+            }
+#if !defined(BACKTEST_HARNESS)
+          logger_ptr->log(logger::info, "nb_partial_writes={} nb_backpressured={} nb_dropped={} Stream writer stopped."_format, send_stream.nb_partial_writes(),
+                          send_stream.nb_backpressured(), send_stream.nb_dropped());
+#endif // !defined(BACKTEST_HARNESS)
+#if defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+          if(sender_ptr)
+            logger_ptr->log(logger::info, "nb_sent={} nb_errors={} nb_partial_writes={} Batched sender stopped."_format, sender_ptr->nb_sent(),
+                            sender_ptr->nb_errors(), sender_ptr->nb_partial_writes());
+#endif // defined(USE_IO_URING) && !defined(BACKTEST_HARNESS)
+#if defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
+          for(const auto *line: {&datagram_tx, &stream_tx})
+            if(line->latencies.count())
+              logger_ptr->log(logger::info, "line={} nb_timestamped={} nb_unmatched={} p50_ns={} p99_ns={} max_ns={} TX timestamps."_format, line->name,
+                              line->latencies.count(), line->records.nb_unmatched(), line->latencies.percentile(.5).count(),
+                              line->latencies.percentile(.99).count(), line->latencies.max().count());
+#endif // defined(LINUX) && !defined(USE_TCPDIRECT) && !defined(USE_LIBVMA) && !defined(BACKTEST_HARNESS)
+          logger_ptr->log(logger::info, "Executor stopped.");
+          return boost::leaf::success();
+        })();
       });
 
       BOOST_LEAF_CHECK(run());
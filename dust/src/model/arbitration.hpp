@@ -0,0 +1,191 @@
+#pragma once
+
+#include <boilerplate/boilerplate.hpp>
+#include <boilerplate/chrono.hpp>
+
+#include <feed/decoder.hpp>
+#include <feed/feed_structures.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A/B line arbitration: the same feed on two lines, each datagram passed on first arrival. A datagram is new if one of its messages is ahead, by
+// sequence id, of what was passed for its instrument: the duplicate from the slower line is dropped, whichever line it is, and a gap on a line is
+// filled by the other one if it was ahead. The other messages of a datagram passed on may be stale: downstream drops them by sequence id (see
+// automaton::handle_sequence_id, and fan_out). The keys come from a decoder per line (a stateful format decodes each line against its own
+// references), no update is decoded. The decoders of the lines are given the snapshots too (see reset): a v2 line decodes the deltas from there
+// on, without waiting for a key message.
+
+struct line_statistics
+{
+  std::uint64_t nb_datagrams = 0, nb_wins = 0; // the datagrams of the line, and the ones passed on (first arrivals)
+  std::uint64_t nb_gaps = 0, nb_gaps_filled = 0; // the sequence gaps of the line, and the ones the other line had passed already
+};
+
+template<feed::decoder decoder_type>
+class line_arbiter
+{
+public:
+  static constexpr std::size_t nb_lines = 2;
+
+  // prototype: the decoder as configured (a stateful decoder may be set up with its streams), copied for each line
+  explicit line_arbiter(const decoder_type &prototype = {}) noexcept: decoders {prototype, prototype} {}
+
+  // true if the datagram is to be passed on
+  [[using gnu: always_inline, flatten, hot]] inline bool operator()(std::size_t line, const network_clock::time_point &timestamp,
+                                                                    const asio::const_buffer &buffer) noexcept
+  {
+    auto &statistics = statistics_[line];
+    ++statistics.nb_datagrams;
+
+    bool ahead = false;
+    const auto on_message = [&](feed::instrument_id_type instrument_id, feed::sequence_id_type sequence_id) noexcept -> feed::instrument_state * {
+      auto &sequence_ids = (*this)[instrument_id];
+      auto &line_sequence_id = sequence_ids.lines[line];
+      if(line_sequence_id && sequence_id > line_sequence_id + 1) [[unlikely]]
+      {
+        ++statistics.nb_gaps;
+        if(sequence_ids.passed >= sequence_id - 1)
+          ++statistics.nb_gaps_filled;
+      }
+      line_sequence_id = std::max(line_sequence_id, sequence_id);
+      if(sequence_id > sequence_ids.passed)
+      {
+        sequence_ids.passed = sequence_id;
+        ahead = true;
+      }
+      return nullptr;
+    };
+    // a snapshot on the wire (see feed::decoder) is arbitrated by its sequence id
+    decoders[line](boilerplate::overloaded {on_message,
+                                            [&](feed::instrument_id_type instrument_id, const feed::instrument_state &snapshot) noexcept {
+                                              on_message(instrument_id, snapshot.sequence_id);
+                                            }},
+                   []([[maybe_unused]] auto &&...args) noexcept {}, timestamp, buffer);
+
+    statistics.nb_wins += ahead;
+    return ahead;
+  }
+
+  // a line already past the snapshot keeps its references
+  void reset(feed::instrument_id_type instrument_id, const feed::instrument_state &snapshot) noexcept
+  {
+    auto &sequence_ids = (*this)[instrument_id];
+    for(std::size_t line = 0; line != nb_lines; ++line)
+      if(sequence_ids.lines[line] <= snapshot.sequence_id)
+      {
+        decoders[line].reset(instrument_id, snapshot);
+        sequence_ids.lines[line] = snapshot.sequence_id;
+      }
+    sequence_ids.passed = std::max(sequence_ids.passed, snapshot.sequence_id);
+  }
+
+  [[nodiscard]] const line_statistics &statistics(std::size_t line) const noexcept { return statistics_[line]; }
+
+private:
+  struct sequence_ids_type
+  {
+    feed::sequence_id_type passed = 0;
+    std::array<feed::sequence_id_type, nb_lines> lines {};
+  };
+
+  sequence_ids_type &operator[](feed::instrument_id_type instrument_id) noexcept
+  {
+    if(instrument_id >= instruments.size()) [[unlikely]]
+      instruments.resize(instrument_id + 1);
+    return instruments[instrument_id];
+  }
+
+  std::array<decoder_type, nb_lines> decoders {};
+  std::vector<sequence_ids_type> instruments {};
+  std::array<line_statistics, nb_lines> statistics_ {};
+};
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+
+#  include <feed/feed.hpp>
+
+#  include <tuple>
+
+TEST_SUITE("arbitration")
+{
+  // one message, one update (bq0)
+  constexpr auto make_packet(std::uint8_t instrument, std::uint8_t sequence_id) noexcept
+  {
+    return feed::sample_packets::make_packet(0x01, 0x00, instrument, 0x00, 0x00, 0x00, sequence_id, 0x01, 0x14, 0x00, 0x00, 0x00, sequence_id);
+  }
+
+  TEST_CASE("first arrival")
+  {
+    line_arbiter<feed::binary_decoder> arbiter;
+    const auto a1 = make_packet(1, 1), a2 = make_packet(1, 2), b2 = make_packet(2, 2);
+
+    CHECK(arbiter(0, {}, asio::buffer(a1)));
+    CHECK(!arbiter(1, {}, asio::buffer(a1)));  // the duplicate
+    CHECK(arbiter(1, {}, asio::buffer(a2)));   // B ahead
+    CHECK(!arbiter(0, {}, asio::buffer(a2)));
+    CHECK(arbiter(0, {}, asio::buffer(b2)));   // another instrument
+    CHECK(arbiter.statistics(0).nb_datagrams == 3);
+    CHECK(arbiter.statistics(0).nb_wins == 2);
+    CHECK(arbiter.statistics(1).nb_wins == 1);
+  }
+
+  TEST_CASE("gap filled")
+  {
+    line_arbiter<feed::binary_decoder> arbiter;
+    const auto p1 = make_packet(1, 1), p2 = make_packet(1, 2), p3 = make_packet(1, 3);
+
+    CHECK(arbiter(0, {}, asio::buffer(p1)));
+    CHECK(!arbiter(1, {}, asio::buffer(p1)));
+    CHECK(arbiter(1, {}, asio::buffer(p2))); // lost on A
+    CHECK(arbiter(0, {}, asio::buffer(p3)));
+    CHECK(!arbiter(1, {}, asio::buffer(p3)));
+    CHECK(arbiter.statistics(0).nb_gaps == 1);
+    CHECK(arbiter.statistics(0).nb_gaps_filled == 1);
+    CHECK(arbiter.statistics(1).nb_gaps == 0);
+  }
+
+  TEST_CASE("v2 from a snapshot")
+  {
+    constexpr feed::instrument_id_type instrument = 42;
+
+    feed::state_map state_map;
+    state_map.set_version(feed::wire_version::v2, true, 64);
+    std::vector<std::vector<std::byte>> packets;
+    for(feed::quantity_t quantity = 1; quantity <= 4; ++quantity)
+    {
+      feed::instrument_state state;
+      feed::update_state(state, feed::bq0_v, quantity);
+      for(auto &&packet: state_map.update(std::array {std::tuple {instrument, state}}))
+        packets.emplace_back(static_cast<const std::byte *>(packet.data()), static_cast<const std::byte *>(packet.data()) + packet.size());
+      if(quantity == 1)
+        packets.clear(); // the key message, before the snapshot
+    }
+    REQUIRE(packets.size() == 3);
+
+    // deltas only: without the snapshot, the lines have nothing to decode them against
+    line_arbiter<feed::binary_decoder> arbiter;
+    CHECK(!arbiter(0, {}, asio::buffer(packets[0])));
+
+    feed::instrument_state snapshot;
+    feed::update_state(snapshot, feed::bq0_v, feed::quantity_t {1});
+    snapshot.sequence_id = 1;
+    arbiter.reset(instrument, snapshot);
+    CHECK(arbiter(0, {}, asio::buffer(packets[0])));
+    CHECK(!arbiter(1, {}, asio::buffer(packets[0])));
+    CHECK(arbiter(1, {}, asio::buffer(packets[1])));
+    CHECK(!arbiter(0, {}, asio::buffer(packets[1])));
+    CHECK(arbiter(0, {}, asio::buffer(packets[2])));
+    CHECK(arbiter.statistics(0).nb_gaps == 0);
+    CHECK(arbiter.statistics(1).nb_gaps == 0);
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
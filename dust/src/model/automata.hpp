@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <chrono>
 #include <concepts>
+#include <cstdint>
 #include <cstdio>
 #include <memory>
 #include <type_traits>
@@ -54,7 +55,8 @@ struct automaton final
 
   bool handle_sequence_id(feed::sequence_id_type sequence_id, auto snapshot_requester) noexcept requires handle_packet_loss
   {
-      const auto diff = sequence_id - (this->sequence_id + 1);
+      // signed: a message behind the state (a stale one, passed on along with a newer one by the arbitration) is not a gap
+      const auto diff = static_cast<std::int32_t>(sequence_id - (this->sequence_id + 1));
       if(!diff) [[likely]]
         return true;
       if(diff < 0) [[unlikely]]
@@ -68,9 +70,9 @@ struct automaton final
   constexpr bool handle_sequence_id(feed::sequence_id_type, auto) noexcept requires (!handle_packet_loss) { return true; }
 
   void apply(feed::instrument_state &&state) noexcept {
-    trigger.reset(std::move(state));
     if constexpr(handle_packet_loss)
-      this->sequence_id = sequence_id;
+      this->sequence_id = state.sequence_id;
+    trigger.reset(std::move(state));
   };
 
   operator const payload_type &() const noexcept { return payload; }
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../config/config_reader.hpp"
+#include "../config/walker.hpp"
+
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/piped_continuation.hpp>
+
+#include <feed/decoder.hpp>
+#include <feed/feed.hpp>
+
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+
+#if defined(USE_RTSDK)
+#  include <feed/rtsdk/decode.hpp>
+#endif // defined(USE_RTSDK)
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+// The decode stage is picked per feed at startup, from feed.format and the version the snapshot server publishes the updates with: the fast path
+// is instantiated, and inlined, once per decoder. A new format is a feed::decoder and a case here.
+
+struct invalid_decoder_config
+{
+  const config::walker &walker;
+};
+
+// the highest version of the binary format feed.format decodes, to ask the snapshot server for (none for another format)
+inline std::optional<feed::wire_version> max_wire_version(const config::walker &config) noexcept
+{
+  using namespace config::literals;
+  using namespace std::string_view_literals;
+
+  const config::string_type name = config["format"_hs].get_or(config::string_type("binary"));
+  if(name == "binary"sv)
+    return feed::wire_version::v2;
+  if(name == "binary_v1"sv)
+    return feed::wire_version::v1;
+  return std::nullopt;
+}
+
+// wire_version: the one the snapshot server replied with, if asked
+decltype(auto) with_decoder(const config::walker &config, std::optional<feed::wire_version> wire_version, auto continuation) noexcept
+{
+  using namespace config::literals;
+  using namespace std::string_view_literals;
+
+  using result_type = std::invoke_result_t<decltype(continuation), feed::binary_decoder>;
+  static_assert(boost::leaf::is_result_type<result_type>::value);
+
+  const auto select_decoder = [=](auto continuation) noexcept -> result_type
+  {
+    const config::string_type name = config["format"_hs].get_or(config::string_type("binary"));
+    // no v2 packets expected: no deltas to keep track of
+    if(name == "binary_v1"sv || (name == "binary"sv && wire_version == feed::wire_version::v1))
+      return continuation(feed::binary_v1_decoder {});
+    if(name == "binary"sv)
+      return continuation(feed::binary_decoder {});
+#if defined(USE_RTSDK)
+    // the streams of the RWF messages mapped upfront: feed.rtsdk_streams[i] to the instrument feed.rtsdk_instruments[i]
+    if(name == "rtsdk"sv)
+    {
+      const auto streams_walker = config["rtsdk_streams"_hs], instruments_walker = config["rtsdk_instruments"_hs];
+      const config::numeric_list_type streams = streams_walker ? config::numeric_list_type(*streams_walker) : config::numeric_list_type {};
+      const config::numeric_list_type instruments = instruments_walker ? config::numeric_list_type(*instruments_walker) : config::numeric_list_type {};
+      if(streams.size() != instruments.size()) [[unlikely]]
+        return BOOST_LEAF_NEW_ERROR(invalid_decoder_config {config});
+      feed::rtsdk::decoder decoder;
+      for(std::size_t i = 0; i != streams.size(); ++i)
+        decoder.subscribe(static_cast<RsslInt32>(streams[i]), static_cast<feed::instrument_id_type>(instruments[i]));
+      return continuation(std::move(decoder));
+    }
+#endif // defined(USE_RTSDK)
+    return BOOST_LEAF_NEW_ERROR(invalid_decoder_config {config});
+  };
+
+  using namespace piped_continuation;
+  return select_decoder |= continuation;
+}
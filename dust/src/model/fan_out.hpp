@@ -0,0 +1,312 @@
+#pragma once
+
+#include <boilerplate/boilerplate.hpp>
+#include <boilerplate/chrono.hpp>
+
+#include <feed/binary/feed_ring.hpp>
+#include <feed/binary/feed_state_table.hpp>
+#include <feed/decoder.hpp>
+#include <feed/feed_structures.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The stage of the feed handler (see feed_handler.cpp) after the receive: each datagram decoded once, into the state of its instruments, for the
+// consumers on the box. The states changed are stored in the table, then the datagram is published on the ring as is: a consumer that sees a gap on
+// the ring finds a state at least as recent in the table. An instrument with a gap is recovered by a snapshot, its messages after the gap kept
+// meanwhile: the ones past the snapshot are replayed on it, as long as they follow on. The datagrams with a message of an instrument being recovered
+// are held back from the ring until no instrument is: a consumer sees the gap once the table has the state past it, and loads it once. The other
+// instruments of these datagrams are published on meanwhile, so their held messages come out stale (and a consumer may reload them once too).
+
+struct fan_out_statistics
+{
+  std::uint64_t nb_datagrams = 0, nb_messages = 0, nb_stale = 0; // the messages applied, and the ones at or before the state
+  std::uint64_t nb_gaps = 0, nb_recoveries = 0, nb_replayed = 0; // the messages kept while recovering, then applied on the snapshot
+  std::uint64_t nb_held = 0; // the datagrams held back from the ring until the recoveries
+};
+
+template<feed::decoder decoder_type>
+class fan_out
+{
+public:
+  // decoder: as configured (a stateful decoder may be set up with its streams)
+  fan_out(feed::state_table_writer &&table, feed::ring_writer &&ring, decoder_type decoder = {}) noexcept:
+    decoder(std::move(decoder)), table(std::move(table)), ring(std::move(ring))
+  {
+  }
+
+  // snapshot_requester(instrument_id) on a gap, once until the instrument is recovered
+  [[using gnu: always_inline, flatten, hot]] inline void operator()(const network_clock::time_point &timestamp, const asio::const_buffer &buffer,
+                                                                    auto &&snapshot_requester) noexcept
+  {
+    ++statistics_.nb_datagrams;
+    bool hold = false;
+    const auto on_message = [&](feed::instrument_id_type instrument_id, feed::sequence_id_type sequence_id) noexcept -> instrument_type * {
+      auto &instrument = (*this)[instrument_id];
+      if(sequence_id <= instrument.state.sequence_id) [[unlikely]]
+      {
+        ++statistics_.nb_stale;
+        return nullptr;
+      }
+      if(instrument.recovering) [[unlikely]]
+      {
+        instrument.pending_messages.push_back({sequence_id, instrument.pending_updates.size()});
+        hold = true;
+        return &instrument;
+      }
+      // the message of the gap is not kept: a stateful format does not decode it, and the snapshot is at least as recent
+      if(sequence_id != instrument.state.sequence_id + 1) [[unlikely]]
+      {
+        ++statistics_.nb_gaps;
+        instrument.recovering = true;
+        ++nb_recovering;
+        hold = true;
+        snapshot_requester(instrument_id);
+        return nullptr;
+      }
+      ++statistics_.nb_messages;
+      instrument.state.sequence_id = sequence_id;
+      if(!std::exchange(instrument.changed, true))
+        changed.push_back(instrument_id);
+      return &instrument;
+    };
+    // a snapshot on the wire (see feed::decoder): a recovery
+    const auto on_snapshot = [&](feed::instrument_id_type instrument_id, const feed::instrument_state &snapshot) noexcept {
+      recover(instrument_id, feed::instrument_state(snapshot));
+    };
+    decoder(
+      boilerplate::overloaded {on_message, on_snapshot},
+      []([[maybe_unused]] const network_clock::time_point &timestamp, const feed::update &update, instrument_type *instrument) noexcept {
+        if(instrument->recovering) [[unlikely]]
+          instrument->pending_updates.push_back(update);
+        else
+          feed::update_state(instrument->state, update);
+      },
+      timestamp, buffer);
+
+    for(const auto instrument_id: changed)
+    {
+      auto &instrument = instruments[instrument_id];
+      instrument.changed = false;
+      table.store(instrument_id, instrument.state);
+    }
+    changed.clear();
+    if(hold) [[unlikely]]
+      hold_back(timestamp, buffer);
+    else
+      ring.publish(buffer, timestamp);
+  }
+
+  // a snapshot behind the state is not applied, and the replay stops at the first message missing: the next message is a gap again. The datagrams
+  // held back are published once the last instrument is recovered
+  void recover(feed::instrument_id_type instrument_id, feed::instrument_state &&snapshot) noexcept
+  {
+    auto &instrument = (*this)[instrument_id];
+    if(std::exchange(instrument.recovering, false))
+      --nb_recovering;
+    if(snapshot.sequence_id >= instrument.state.sequence_id) [[likely]]
+    {
+      ++statistics_.nb_recoveries;
+      instrument.state = std::move(snapshot);
+      for(std::size_t i = 0; i != instrument.pending_messages.size(); ++i)
+      {
+        const auto [sequence_id, begin] = instrument.pending_messages[i];
+        if(sequence_id <= instrument.state.sequence_id)
+          continue;
+        if(sequence_id != instrument.state.sequence_id + 1)
+          break;
+        ++statistics_.nb_replayed;
+        instrument.state.sequence_id = sequence_id;
+        const auto end = i + 1 != instrument.pending_messages.size() ? instrument.pending_messages[i + 1].second : instrument.pending_updates.size();
+        for(auto j = begin; j != end; ++j)
+          feed::update_state(instrument.state, instrument.pending_updates[j]);
+      }
+      decoder.reset(instrument_id, instrument.state);
+      table.store(instrument_id, instrument.state);
+    }
+    instrument.pending_messages.clear();
+    instrument.pending_updates.clear();
+    if(!nb_recovering)
+      release();
+  }
+
+  [[nodiscard]] const fan_out_statistics &statistics() const noexcept { return statistics_; }
+  [[nodiscard]] std::uint64_t nb_published_bytes() const noexcept { return ring.nb_published_bytes(); }
+
+private:
+  struct instrument_type
+  {
+    feed::instrument_state state {}; // the updates accumulated: the fields ever set
+    bool recovering = false, changed = false;
+    std::vector<std::pair<feed::sequence_id_type, std::size_t>> pending_messages {}; // while recovering: the sequence id, and the first update
+    std::vector<feed::update> pending_updates {};
+  };
+
+  struct held_datagram
+  {
+    network_clock::time_point timestamp;
+    std::size_t offset, size; // in held_bytes
+  };
+
+  void hold_back(const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept
+  {
+    ++statistics_.nb_held;
+    const auto *const data = static_cast<const std::byte *>(buffer.data());
+    held_datagrams.push_back({timestamp, held_bytes.size(), buffer.size()});
+    held_bytes.insert(held_bytes.end(), data, data + buffer.size());
+  }
+
+  void release() noexcept
+  {
+    for(const auto &[timestamp, offset, size]: held_datagrams)
+      ring.publish(asio::const_buffer(held_bytes.data() + offset, size), timestamp);
+    held_datagrams.clear();
+    held_bytes.clear();
+  }
+
+  instrument_type &operator[](feed::instrument_id_type instrument_id) noexcept
+  {
+    if(instrument_id >= instruments.size()) [[unlikely]]
+      instruments.resize(instrument_id + 1);
+    return instruments[instrument_id];
+  }
+
+  decoder_type decoder {};
+  feed::state_table_writer table;
+  feed::ring_writer ring;
+  std::vector<instrument_type> instruments {};
+  std::vector<feed::instrument_id_type> changed {}; // by the datagram being decoded
+  std::size_t nb_recovering = 0;
+  std::vector<held_datagram> held_datagrams {};
+  std::vector<std::byte> held_bytes {};
+  fan_out_statistics statistics_ {};
+};
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+
+#  include <feed/feed.hpp>
+
+#  include <array>
+#  include <string>
+
+#  include <unistd.h>
+
+TEST_SUITE("fan_out")
+{
+  // one message, one update: the sequence id as bq0
+  constexpr auto make_packet(std::uint8_t instrument, std::uint8_t sequence_id) noexcept
+  {
+    return feed::sample_packets::make_packet(0x01, 0x00, instrument, 0x00, 0x00, 0x00, sequence_id, 0x01, 0x14, 0x00, 0x00, 0x00, sequence_id);
+  }
+
+  TEST_CASE("gap recovered")
+  {
+    const auto name = "/fan_out_" + std::to_string(::getpid());
+    auto table = feed::state_table_writer::create(name + "_table");
+    REQUIRE(table);
+    auto ring = feed::ring_writer::create(name + "_ring", 0, 64);
+    REQUIRE(ring);
+    auto states = feed::state_table_reader::open(name + "_table");
+    REQUIRE(states);
+    auto packets = feed::ring_reader::open(name + "_ring");
+    REQUIRE(packets);
+
+    fan_out<feed::binary_decoder> stage(std::move(*table), std::move(*ring));
+    // the sequence ids of instrument 1 published since the last call
+    const auto published = [&]() {
+      std::vector<std::uint8_t> result;
+      CHECK((*packets)([&](const network_clock::time_point &, asio::const_buffer &&packet) {
+        result.push_back(static_cast<const std::uint8_t *>(packet.data())[6]);
+      }));
+      return result;
+    };
+    std::vector<feed::instrument_id_type> requested;
+    const auto request = [&](feed::instrument_id_type instrument_id) { requested.push_back(instrument_id); };
+    const auto p1 = make_packet(1, 1), p4 = make_packet(1, 4), p5 = make_packet(1, 5), p6 = make_packet(1, 6), p8 = make_packet(1, 8);
+
+    stage({}, asio::buffer(p1), request);
+    stage({}, asio::buffer(p1), request); // stale
+    CHECK(states->load(1).sequence_id == 1);
+    stage({}, asio::buffer(p4), request);
+    stage({}, asio::buffer(p5), request); // recovering: kept
+    stage({}, asio::buffer(p6), request);
+    CHECK(requested == std::vector<feed::instrument_id_type> {1});
+    CHECK(states->load(1).sequence_id == 1);
+    // held back until recovered
+    CHECK(published() == std::vector<std::uint8_t> {1, 1});
+
+    // replayed on the snapshot
+    stage.recover(1, feed::instrument_state {.sequence_id = 4});
+    CHECK(states->load(1).sequence_id == 6);
+    CHECK(states->load(1).bq0 == 6);
+    CHECK(published() == std::vector<std::uint8_t> {4, 5, 6});
+    stage({}, asio::buffer(p6), request); // stale
+    stage.recover(1, feed::instrument_state {.sequence_id = 2}); // behind
+    CHECK(states->load(1).sequence_id == 6);
+
+    // replayed until the first message missing
+    stage({}, asio::buffer(p8), request);
+    stage({}, asio::buffer(p1), request);
+    const auto p9 = make_packet(1, 9), p11 = make_packet(1, 11);
+    stage({}, asio::buffer(p9), request);
+    stage({}, asio::buffer(p11), request);
+    CHECK(requested == std::vector<feed::instrument_id_type> {1, 1});
+    stage.recover(1, feed::instrument_state {.sequence_id = 8});
+    CHECK(states->load(1).sequence_id == 9);
+
+    CHECK(published() == std::vector<std::uint8_t> {6, 1, 8, 9, 11}); // all of them, as is
+    CHECK(stage.statistics().nb_messages == 1);
+    CHECK(stage.statistics().nb_stale == 3);
+    CHECK(stage.statistics().nb_gaps == 2);
+    CHECK(stage.statistics().nb_recoveries == 2);
+    CHECK(stage.statistics().nb_replayed == 3);
+    CHECK(stage.statistics().nb_held == 6);
+  }
+
+  // a format with snapshots on the wire: each datagram is one, of instrument 1, its first byte as sequence id and bq0
+  struct snapshot_decoder
+  {
+    std::size_t operator()(auto &&message_header_handler, [[maybe_unused]] auto &&update_handler, [[maybe_unused]] const network_clock::time_point &timestamp,
+                           const asio::const_buffer &buffer) noexcept
+    {
+      const auto value = *static_cast<const std::uint8_t *>(buffer.data());
+      message_header_handler(feed::instrument_id_type {1}, feed::instrument_state {.bq0 = value, .sequence_id = value});
+      return buffer.size();
+    }
+
+    void reset([[maybe_unused]] feed::instrument_id_type instrument, [[maybe_unused]] const feed::instrument_state &snapshot) noexcept {}
+  };
+
+  TEST_CASE("snapshot on the wire")
+  {
+    const auto name = "/fan_out_wire_" + std::to_string(::getpid());
+    auto table = feed::state_table_writer::create(name + "_table");
+    REQUIRE(table);
+    auto ring = feed::ring_writer::create(name + "_ring", 0, 64);
+    REQUIRE(ring);
+    auto states = feed::state_table_reader::open(name + "_table");
+    REQUIRE(states);
+
+    fan_out<snapshot_decoder> stage(std::move(*table), std::move(*ring));
+    std::size_t nb_requested = 0;
+    const auto request = [&]([[maybe_unused]] feed::instrument_id_type instrument_id) { ++nb_requested; };
+    const std::array<std::uint8_t, 1> s3 {3}, s2 {2};
+
+    // a state reset, not a gap
+    stage({}, asio::buffer(s3), request);
+    CHECK(states->load(1).sequence_id == 3);
+    CHECK(states->load(1).bq0 == 3);
+    stage({}, asio::buffer(s2), request); // behind
+    CHECK(states->load(1).sequence_id == 3);
+    CHECK(!nb_requested);
+    CHECK(stage.statistics().nb_recoveries == 1);
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
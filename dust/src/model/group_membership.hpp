@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../config/config_reader.hpp"
+
+#include <boilerplate/leaf.hpp>
+
+#include <feed/feed_structures.hpp>
+
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// The instruments sharded across multicast groups (on the port of feed.update): feed.sharded_instruments, and feed.sharded_groups the group of each.
+// A group is joined while one of its instruments is subscribed to; the other instruments are on feed.update, always joined.
+
+struct invalid_group_config
+{
+  const config::walker &walker;
+};
+
+class group_membership
+{
+public:
+  static boost::leaf::result<group_membership> create(const config::walker &config) noexcept
+  {
+    using namespace config::literals;
+
+    const auto instruments_walker = config["sharded_instruments"_hs], groups_walker = config["sharded_groups"_hs];
+    const config::numeric_list_type instruments = instruments_walker ? config::numeric_list_type(*instruments_walker) : config::numeric_list_type {};
+    const config::string_list_type groups = groups_walker ? config::string_list_type(*groups_walker) : config::string_list_type {};
+    if(instruments.size() != groups.size()) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(invalid_group_config {config});
+
+    group_membership result;
+    for(std::size_t i = 0; i != instruments.size(); ++i)
+    {
+      const auto it = std::find(result.groups.begin(), result.groups.end(), groups[i]);
+      result.group_indices.emplace(static_cast<feed::instrument_id_type>(instruments[i]), static_cast<std::size_t>(it - result.groups.begin()));
+      if(it == result.groups.end())
+        result.groups.push_back(groups[i]);
+    }
+    result.nb_subscribed.resize(result.groups.size());
+    return result;
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return groups.empty(); }
+
+  // the group to join, if the instrument is the first of it subscribed to
+  std::optional<config::string_type> subscribe(feed::instrument_id_type instrument) noexcept
+  {
+    const auto it = group_indices.find(instrument);
+    if(it == group_indices.end() || !subscribed.insert(instrument).second)
+      return std::nullopt;
+    return nb_subscribed[it->second]++ ? std::nullopt : std::make_optional(groups[it->second]);
+  }
+
+  // the group to leave, if the instrument was the last of it subscribed to
+  std::optional<config::string_type> unsubscribe(feed::instrument_id_type instrument) noexcept
+  {
+    const auto it = group_indices.find(instrument);
+    if(it == group_indices.end() || !subscribed.erase(instrument))
+      return std::nullopt;
+    return --nb_subscribed[it->second] ? std::nullopt : std::make_optional(groups[it->second]);
+  }
+
+private:
+  std::vector<config::string_type> groups {};
+  std::vector<std::size_t> nb_subscribed {}; // per group
+  std::unordered_map<feed::instrument_id_type, std::size_t> group_indices {};
+  std::unordered_set<feed::instrument_id_type> subscribed {};
+};
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+
+#  include <string_view>
+
+TEST_SUITE("group_membership")
+{
+  using namespace config::literals;
+  using namespace std::string_view_literals;
+
+  TEST_CASE("join and leave")
+  {
+    boost::leaf::try_handle_all(
+      [&]() noexcept -> boost::leaf::result<void> {
+        const auto properties = BOOST_LEAF_TRYX(config::properties::create("\
+\"feed.sharded_instruments\": [1, 2, 3],\n\
+\"feed.sharded_groups\": [\"239.0.0.1\", \"239.0.0.1\", \"239.0.0.2\"]\n\n"sv));
+        auto memberships = BOOST_LEAF_TRYX(group_membership::create(properties["feed"_hs]));
+
+        CHECK(!memberships.empty());
+        CHECK(memberships.subscribe(1) == "239.0.0.1");
+        CHECK(!memberships.subscribe(1));  // already
+        CHECK(!memberships.subscribe(2));  // already joined
+        CHECK(!memberships.subscribe(42)); // not sharded
+        CHECK(memberships.subscribe(3) == "239.0.0.2");
+        CHECK(!memberships.unsubscribe(1));
+        CHECK(memberships.unsubscribe(2) == "239.0.0.1");
+        CHECK(!memberships.unsubscribe(2));
+        return {};
+      },
+      [&]([[maybe_unused]] const boost::leaf::error_info &unmatched) noexcept { CHECK(false); });
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
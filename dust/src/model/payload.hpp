@@ -3,6 +3,9 @@
 #include "../config/config_reader.hpp"
 
 #include <boilerplate/leaf.hpp>
+#if defined(USE_IO_URING)
+#  include <boilerplate/socket.hpp>
+#endif // defined(USE_IO_URING)
 
 #include <asio/buffer.hpp>
 
@@ -11,6 +14,9 @@
 #include <algorithm>
 #include <cstddef>
 #include <memory>
+#if defined(USE_IO_URING)
+#  include <optional>
+#endif // defined(USE_IO_URING)
 #include <type_traits>
 
 namespace detail
@@ -55,6 +61,18 @@ struct payload final
 {
   /*const*/ detail::owning_aligned_buffer stream_payload = {};
   [[no_unique_address]] /*const*/ std::conditional_t<send_datagram, detail::owning_aligned_buffer, detail::null_buffer> datagram_payload = {};
+#if defined(USE_IO_URING)
+  // the copies registered with the batched send path, made when the payload is set (not on the fast path): they go with the payload
+  std::optional<uring_sender::registration> stream_registration = {}, datagram_registration = {};
+
+  boost::leaf::result<void> register_with(uring_sender &sender) noexcept
+  {
+    stream_registration = BOOST_LEAF_TRYX(sender.register_payload(stream_payload));
+    if constexpr(send_datagram)
+      datagram_registration = BOOST_LEAF_TRYX(sender.register_payload(datagram_payload));
+    return {};
+  }
+#endif // defined(USE_IO_URING)
 };
 
 template<bool send_datagram>
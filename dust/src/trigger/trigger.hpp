@@ -176,6 +176,40 @@ public:
   static_assert(sizeof(upstream) <= std::hardware_destructive_interference_size);
 };
 
+// A move trigger on a tick ladder (see feed::tick_rule): the prices are tick indices, so the threshold is a number of ticks at any price level
+template<typename value_type, typename tick_rule_type, typename period_type = std::chrono::nanoseconds>
+class tick_move_trigger
+{
+public:
+  using index_type = typename tick_rule_type::index_type;
+
+  tick_move_trigger(const tick_rule_type &rule, const value_type &initial_value, const index_type &threshold, const period_type &period) noexcept:
+    rule(rule), upstream(rule.to_index(initial_value), threshold, period)
+  {
+  }
+
+  constexpr auto actual_period() const noexcept { return upstream.actual_period(); }
+
+  void reset(const value_type &initial_value) noexcept { upstream.reset(rule.to_index(initial_value)); }
+
+  void warm_up() noexcept { upstream.warm_up(); }
+
+  template<typename continuation_type, typename timestamp_type, typename... args_types>
+  [[using gnu : always_inline, flatten, hot]] inline auto operator()(continuation_type &continuation, const timestamp_type &timestamp, const value_type &value, args_types &&...args) noexcept
+  {
+    return upstream(continuation, timestamp, rule.to_index(value), std::forward<args_types>(args)...);
+  }
+
+private:
+  tick_rule_type rule;
+  move_trigger<index_type, period_type> upstream;
+};
+
+template<typename value_type, typename tick_rule_type>
+struct fmt::formatter<tick_move_trigger<value_type, tick_rule_type>, char> : default_formatter<tick_move_trigger<value_type, tick_rule_type>, char>
+{
+};
+
 namespace reference_implementation
 {
 template<typename value_type, typename period_type=std::chrono::nanoseconds>
@@ -295,6 +329,30 @@ TEST_SUITE("trigger")
     }
   }
 
+  TEST_CASE("tick_move_trigger")
+  {
+    // a tick of 1 below 10, of 5 above
+    struct two_steps_rule
+    {
+      using index_type = int;
+      constexpr index_type to_index(int price) const noexcept { return price < 10 ? price : 10 + (price - 10) / 5; }
+    };
+    const auto moved = [&](int from, int to)
+    {
+      tick_move_trigger<int, two_steps_rule, std::chrono::high_resolution_clock::duration> trigger({}, from, 2, 10ms);
+      std::chrono::high_resolution_clock::time_point timestamp;
+      trigger(continuation, timestamp, from);
+      return trigger(continuation, timestamp + 3ms, to);
+    };
+    CHECK(!moved(8, 10));
+    // 3 ticks: 2 up to 10, 1 above
+    CHECK(moved(8, 15));
+    CHECK(!moved(10, 20));
+    CHECK(moved(10, 25));
+    CHECK(!moved(20, 10));
+    CHECK(moved(20, 9));
+  }
+
   TEST_CASE("move_trigger ext")
   {
     move_trigger<int, std::chrono::high_resolution_clock::duration> trigger(10, 2, 10ms);
@@ -13,6 +13,7 @@
 
 #include "trigger.hpp"
 
+#include <optional>
 #include <tuple>
 
 // trigger_map_type = tuple<tuple<tuple<fields...>, trigger>>;
@@ -111,6 +112,22 @@ struct invalid_trigger_config
   const config::walker &walker;
 };
 
+#if defined(TICK_PRICE)
+// "tick_rule": a named ladder, or "tick_size": a uniform one
+inline std::optional<feed::tick_rule<>> decode_tick_rule(const config::walker &tick_rule, const config::walker &tick_size) noexcept
+{
+  if(tick_size)
+  {
+    const config::numeric_type tick = *tick_size;
+    if(feed::tick_price(tick) > feed::tick_price {}) [[likely]]
+      return feed::tick_rules::uniform(tick);
+  }
+  else if(const config::string_type &name = *tick_rule; name == "equity")
+    return feed::tick_rules::equity;
+  return std::nullopt;
+}
+#endif // defined(TICK_PRICE)
+
 decltype(auto) with_trigger(const config::walker &config, boilerplate::observer_ptr<logger::logger> logger,
                   auto continuation) noexcept
 {
@@ -148,6 +165,19 @@ decltype(auto) with_trigger(const config::walker &config, boilerplate::observer_
     const auto period = config["period"_hs];
     const auto base = config["base"_hs];
     const auto tick_size = config["tick_size"_hs];
+#if defined(TICK_PRICE)
+    // on a tick ladder, the threshold is a number of ticks
+    if(const auto tick_rule = config["tick_rule"_hs]; threshold && period && (tick_rule || tick_size))
+    {
+      const auto rule = decode_tick_rule(tick_rule, tick_size);
+      if(!rule) [[unlikely]]
+        return BOOST_LEAF_NEW_ERROR(invalid_trigger_config {config});
+      const config::numeric_type nb_ticks = *threshold;
+      const std::chrono::nanoseconds trigger_period = *period;
+      return continuation(add_trigger(std::forward<decltype(triggers)>(triggers), price_fields,
+                                      tick_move_trigger<feed::price_t, feed::tick_rule<>>(*rule, {}, static_cast<feed::tick_rule<>::index_type>(nb_ticks), trigger_period)));
+    }
+#endif // defined(TICK_PRICE)
     if(threshold && period)
       /*if((int(base) == 3500) && (float(tick_size) == 0.5))
       {
@@ -231,6 +261,39 @@ TEST_SUITE("trigger_dispatcher")
       },
       [&]([[maybe_unused]] const boost::leaf::error_info &unmatched) noexcept { CHECK(false); });
   }
+#if defined(TICK_PRICE)
+  TEST_CASE("tick_move_trigger")
+  {
+    using namespace config::literals;
+    using namespace std::string_view_literals;
+
+    const auto config = "\n\
+\"entrypoint.threshold\": 2,\n\
+\"entrypoint.period\": 10,\n\
+\"entrypoint.tick_rule\": \"equity\",\n\
+\"wrong_ladder.threshold\": 2,\n\
+\"wrong_ladder.period\": 10,\n\
+\"wrong_ladder.tick_rule\": \"bond\""sv;
+
+    boost::leaf::try_handle_all(
+      [&]() noexcept -> boost::leaf::result<void> {
+        const auto props = BOOST_LEAF_TRYX(config::properties::create(config));
+        CHECK(!with_trigger(props["wrong_ladder"_hs], nullptr, [](auto &&) -> boost::leaf::result<void> { return {}; })());
+        return with_trigger(props["entrypoint"_hs], nullptr, [](auto &&trigger) -> boost::leaf::result<void> {
+          auto continuation = []([[maybe_unused]] auto timestamp, auto for_real) { return bool(for_real); };
+          auto send = [&](std::int64_t timestamp, double price) {
+            return trigger(continuation, std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(timestamp)), feed::encode_update(feed::field::b0, feed::price_t(price)));
+          };
+          CHECK(!send(100, 10.));
+          // 2 ticks of .005 above 10, then 1 tick of .001 below 10
+          CHECK(!send(103, 10.01));
+          CHECK(send(106, 9.999));
+          return {};
+        })();
+      },
+      [&]([[maybe_unused]] const boost::leaf::error_info &unmatched) noexcept { CHECK(false); });
+  }
+#endif // defined(TICK_PRICE)
 }
 
 // GCOVR_EXCL_STOP
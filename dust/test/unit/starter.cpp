@@ -19,9 +19,18 @@ void throw_exception(const exception_type &exception)
 } // namespace asio::detail
 #endif // defined(ASIO_NO_EXCEPTIONS)
 
+#include <feed/binary/feed_filter.hpp>
+#include <feed/binary/feed_pcap.hpp>
+#include <feed/binary/feed_recorder.hpp>
+#include <feed/binary/feed_replay.hpp>
+
 #include "config/config_reader.hpp"
 #include "config/dispatch.hpp"
+#include "model/arbitration.hpp"
 #include "model/automata.hpp"
+#include "model/decoder.hpp"
+#include "model/fan_out.hpp"
+#include "model/group_membership.hpp"
 #include "model/payload.hpp"
 #include "trigger/trigger.hpp"
 #include "trigger/trigger_dispatcher.hpp"
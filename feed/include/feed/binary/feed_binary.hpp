@@ -1,5 +1,6 @@
 #pragma once
 
+#include <feed/decoder.hpp>
 #include <feed/feed_structures.hpp>
 
 #include <boilerplate/boilerplate.hpp>
@@ -29,9 +30,15 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <bitset>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace feed
 {
@@ -59,11 +66,256 @@ struct snapshot_request final
 };
 static_assert(sizeof(snapshot_request) == 2); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 
+// a snapshot request for this (invalid) instrument introduces a bulk request
+constexpr instrument_id_type bulk_snapshot_instrument = 0;
+
+struct bulk_snapshot_request final
+{
+  endian::big_uint16_buf_t marker {bulk_snapshot_instrument};
+  endian::big_uint16_buf_t nb_instruments {}; // followed by as many snapshot_request, or none for all the instruments known to the server
+};
+static_assert(sizeof(bulk_snapshot_request) == 4); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+struct bulk_snapshot_reply final
+{
+  endian::big_uint32_buf_t nb_messages {}; // followed by as many messages
+};
+static_assert(sizeof(bulk_snapshot_reply) == 4); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+enum struct wire_version : std::uint8_t
+{
+  v1 = 1,
+  v2 = 2,
+};
+
+// a bulk request for this many instruments is a version request instead: the client tells the highest version it decodes, the server replies
+// the one it publishes the updates with (the snapshots are always v1). The count is reserved, a bulk request is for fewer instruments.
+constexpr std::uint16_t version_request_marker = std::numeric_limits<std::uint16_t>::max();
+constexpr std::size_t bulk_snapshot_max_instruments = version_request_marker - 1;
+
+struct version_request final
+{
+  endian::big_uint16_buf_t marker {bulk_snapshot_instrument};
+  endian::big_uint16_buf_t request {version_request_marker};
+  std::uint8_t max_version = std::to_underlying(wire_version::v2);
+};
+static_assert(sizeof(version_request) == 5); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+struct version_reply final
+{
+  std::uint8_t version = std::to_underlying(wire_version::v1);
+};
+
 
 constexpr std::size_t packet_max_size = 65'536;
 constexpr std::size_t message_max_size = sizeof(message) + (std::to_underlying(field_index::_count) - 1) * sizeof(update);
 constexpr std::size_t packet_header_size = offsetof(packet, message);
 
+constexpr std::size_t bulk_snapshot_chunk_size = 65'536;
+
+constexpr std::size_t default_mtu = 1'500;
+constexpr std::size_t ip_udp_headers_size = 20 + 8; // IPv4 without options + UDP
+
+//
+// v2 encoding: a field-presence bitmap per message, and the values as zigzag varint deltas against the last published ones of the instrument.
+// The packet starts with a zero byte (an empty v1 packet, skipped by v1 decoders), then the version, the flags and the number of messages,
+// optionally followed by an instrument base (varint). Each message is:
+//   - the instrument, as the zigzag varint of its difference to the base (0 without base)
+//   - the presence bitmap: one bit per field_index, and key_message
+//   - the sequence id: a varint in a key message, its low byte otherwise (the previous sequence id of the instrument plus one)
+//   - the values of the present fields, in field_index order, as the zigzag varint of their difference to the reference (0 in a key message)
+// A key message carries all the fields of the instrument: it is the starting point of the deltas after a loss.
+
+struct packet_v2_header final
+{
+  std::uint8_t marker = 0;
+  std::uint8_t version = std::to_underlying(wire_version::v2);
+  std::uint8_t flags = 0;
+  std::uint8_t nb_messages = 0;
+};
+static_assert(sizeof(packet_v2_header) == 4); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+constexpr std::uint8_t has_instrument_base = 0x01;
+constexpr std::uint8_t key_message = 0x80;
+static_assert(std::to_underlying(field_index::_count) < 8, "the presence bitmap is a byte, key_message included");
+
+constexpr std::size_t varint_max_size = 5;
+constexpr std::size_t instrument_varint_max_size = 3; // the zigzag of a 16 bits difference
+constexpr std::size_t packet_v2_header_max_size = sizeof(packet_v2_header) + instrument_varint_max_size;
+constexpr std::size_t message_v2_max_size = instrument_varint_max_size + 1 + varint_max_size + std::to_underlying(field_index::_count) * varint_max_size;
+
+// a key message every so many messages of an instrument bounds the recovery after a loss
+constexpr std::uint32_t default_key_interval = 64;
+
+constexpr std::size_t index_of(enum field field) noexcept
+{
+  return static_cast<std::size_t>(std::find(all_fields.begin(), all_fields.end(), field) - all_fields.begin());
+}
+
+constexpr std::uint32_t zigzag_encode(std::int32_t value) noexcept { return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31); }
+constexpr std::int32_t zigzag_decode(std::uint32_t value) noexcept { return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1); }
+
+// the differences wrap around: they are taken on the wire representation of the values
+constexpr std::uint32_t delta_encode(std::uint32_t value, std::uint32_t reference) noexcept { return zigzag_encode(static_cast<std::int32_t>(value - reference)); }
+constexpr std::uint32_t delta_decode(std::uint32_t delta, std::uint32_t reference) noexcept { return reference + static_cast<std::uint32_t>(zigzag_decode(delta)); }
+
+[[using gnu : always_inline]] inline std::byte *write_varint(std::byte *target, std::uint32_t value) noexcept
+{
+  for(; value >= 0x80; value >>= 7)
+    *target++ = std::byte(value | 0x80); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  *target++ = std::byte(value); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  return target;
+}
+
+[[using gnu : always_inline]] inline const std::byte *read_varint(const std::byte *source, std::uint32_t &value) noexcept
+{
+  value = 0;
+  for(unsigned shift = 0; shift < 7 * varint_max_size; shift += 7)
+  {
+    const auto byte = std::to_integer<std::uint32_t>(*source++); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    value |= (byte & 0x7f) << shift;
+    if(!(byte & 0x80))
+      break;
+  }
+  return source;
+}
+
+inline bool is_v2(const asio::const_buffer &buffer) noexcept
+{
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto *header = reinterpret_cast<const packet_v2_header *>(buffer.data());
+  return buffer.size() >= sizeof(packet_v2_header) && header->marker == 0 && header->version == std::to_underlying(wire_version::v2);
+}
+
+// The decoder side of the deltas: the values last received per instrument. A lost message leaves the instrument without reference until its
+// next key message, or a snapshot (see reset).
+class delta_references
+{
+public:
+  struct instrument final
+  {
+    std::array<std::uint32_t, std::to_underlying(field_index::_count)> values {};
+    sequence_id_type sequence_id = 0;
+    bool valid = false;
+  };
+
+  instrument &operator[](instrument_id_type instrument_id) noexcept
+  {
+    if(instrument_id >= instruments.size()) [[unlikely]]
+      instruments.resize(instrument_id + 1);
+    return instruments[instrument_id];
+  }
+
+  // the deltas following a snapshot apply to its values
+  void reset(instrument_id_type instrument_id, const instrument_state &state) noexcept
+  {
+    auto &instrument = (*this)[instrument_id];
+    instrument.values = {};
+    visit_state([&](auto field, auto value) noexcept { instrument.values[index_of(field)] = endian::big_to_native(encode_update(field, value).value); }, state);
+    instrument.sequence_id = state.sequence_id;
+    instrument.valid = true;
+  }
+
+private:
+  std::vector<instrument> instruments {};
+};
+
+struct message_v2 final
+{
+  instrument_id_type instrument_id = 0;
+  std::uint8_t presence = 0;
+  std::uint32_t sequence_id = 0; // its low byte only, out of a key message
+  std::size_t nb_values = 0;
+  std::array<std::uint32_t, std::to_underlying(field_index::_count)> deltas;
+};
+
+// returns the first message, base gets the instrument base
+[[using gnu : always_inline]] inline const std::byte *read_packet_v2_header(const asio::const_buffer &buffer, std::uint32_t &base) noexcept
+{
+  REQUIRES(is_v2(buffer));
+  const auto *header = static_cast<const packet_v2_header *>(buffer.data());
+  const auto *current = static_cast<const std::byte *>(buffer.data()) + sizeof(packet_v2_header); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  base = 0;
+  if(header->flags & has_instrument_base)
+    current = read_varint(current, base);
+  return current;
+}
+
+[[using gnu : always_inline]] inline const std::byte *read_message_v2(const std::byte *current, std::uint32_t base, message_v2 &message) noexcept
+{
+  std::uint32_t instrument_offset = 0;
+  current = read_varint(current, instrument_offset);
+  message.instrument_id = static_cast<instrument_id_type>(base + static_cast<std::uint32_t>(zigzag_decode(instrument_offset)));
+  message.presence = std::to_integer<std::uint8_t>(*current++); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  if(message.presence & key_message)
+    current = read_varint(current, message.sequence_id);
+  else
+    message.sequence_id = std::to_integer<std::uint8_t>(*current++); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+  message.nb_values = static_cast<std::size_t>(std::popcount(static_cast<std::uint8_t>(message.presence & ~key_message)));
+  for(std::size_t j = 0; j < message.nb_values; ++j)
+    current = read_varint(current, message.deltas[j]);
+  return current;
+}
+
+// without references, the packet is only walked through (see packet_size)
+[[using gnu : always_inline, flatten, hot]] inline std::size_t decode_v2(delta_references *references, auto &&message_header_handler, auto &&update_handler,
+                                                                         const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept
+{
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  const auto *buffer_begin = reinterpret_cast<const std::byte *>(buffer.data()), *buffer_end = buffer_begin + buffer.size();
+  const auto nb_messages = static_cast<const packet_v2_header *>(buffer.data())->nb_messages;
+  std::uint32_t base;
+  const auto *current = read_packet_v2_header(buffer, base);
+
+  for(auto i = 0; i < nb_messages; ++i)
+  {
+    ASSERTS(current < buffer_end);
+    message_v2 message;
+    current = read_message_v2(current, base, message);
+    if(!references)
+      continue;
+
+    const auto instrument_id = message.instrument_id;
+    const bool key = message.presence & key_message;
+    auto sequence_id = message.sequence_id;
+    auto &reference = (*references)[instrument_id];
+    if(key)
+    {
+      reference.values = {};
+      reference.valid = true;
+    }
+    else
+    {
+      if(UNLIKELY(!reference.valid))
+        continue; // until the next key message
+      sequence_id = reference.sequence_id + static_cast<std::uint8_t>(sequence_id - reference.sequence_id);
+      if(UNLIKELY(sequence_id != reference.sequence_id + 1))
+      {
+        // the values are deltas against lost ones: only the gap is reported
+        reference.valid = false;
+        message_header_handler(instrument_id, sequence_id);
+        continue;
+      }
+    }
+    reference.sequence_id = sequence_id;
+
+    const auto instrument_closure = message_header_handler(instrument_id, sequence_id);
+    for(std::size_t index = 0, j = 0; index < all_fields.size(); ++index)
+    {
+      if(!(message.presence & (1u << index)))
+        continue;
+      auto &value = reference.values[index];
+      value = delta_decode(message.deltas[j++], value);
+      if(LIKELY(instrument_closure))
+        update_handler(timestamp, update {.field = all_fields[index], .value = endian::native_to_big(value)}, instrument_closure);
+    }
+  }
+
+  ASSERTS(current <= buffer_end);
+  return static_cast<std::size_t>(current - buffer_begin);
+}
+
 inline auto encode_message(instrument_id_type instrument, const instrument_state &state, const asio::mutable_buffer &buffer) noexcept
 {
   const auto nb_updates = feed::nb_updates(state);
@@ -96,9 +348,74 @@ inline boost::leaf::awaitable<boost::leaf::result<instrument_state>> co_request_
   co_return state;
 }
 
+// streams the snapshots of the requested instruments (all of them if empty) through a single read loop, instead of one round trip each
+inline boost::leaf::awaitable<boost::leaf::result<void>> co_request_bulk_snapshot(asio::ip::tcp::socket &socket, ranges::span<const instrument_id_type> instruments,
+                                                                                  auto on_snapshot) noexcept
+{
+  if(static_cast<std::size_t>(instruments.size()) > bulk_snapshot_max_instruments) [[unlikely]]
+    co_return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"co_request_bulk_snapshot"});
+
+  std::vector<std::byte> request(sizeof(bulk_snapshot_request) + static_cast<std::size_t>(instruments.size()) * sizeof(snapshot_request));
+  new(request.data()) bulk_snapshot_request {.nb_instruments = endian::big_uint16_buf_t(static_cast<std::uint16_t>(instruments.size()))};
+  auto *instrument_request = reinterpret_cast<snapshot_request *>(request.data() + sizeof(bulk_snapshot_request)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  for(auto instrument: instruments)
+    new(instrument_request++) snapshot_request {.instrument = endian::big_uint16_buf_t(instrument)};
+  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_write(socket, asio::buffer(request), _));
+
+  bulk_snapshot_reply reply;
+  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_read(socket, asio::buffer(&reply, sizeof(reply)), _));
+
+  std::vector<std::byte> buffer(bulk_snapshot_chunk_size);
+  std::size_t pending_bytes = 0;
+  for(auto remaining = reply.nb_messages.value(); remaining;)
+  {
+    pending_bytes += BOOST_LEAF_ASIO_CO_TRYX(co_await socket.async_read_some(asio::buffer(buffer.data() + pending_bytes, buffer.size() - pending_bytes), _));
+
+    std::size_t offset = 0;
+    while(remaining && pending_bytes - offset >= offsetof(message, updates))
+    {
+      const auto *message = reinterpret_cast<const struct message *>(buffer.data() + offset); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      const auto message_size = offsetof(struct message, updates) + message->nb_updates * sizeof(update);
+      if(pending_bytes - offset < message_size)
+        break;
+
+      instrument_state state {.sequence_id = message->sequence_id.value()};
+      update_state(state, *message);
+      on_snapshot(message->instrument.value(), std::move(state));
+
+      offset += message_size;
+      --remaining;
+    }
+
+    std::memmove(buffer.data(), buffer.data() + offset, pending_bytes - offset);
+    pending_bytes -= offset;
+  }
+
+  co_return boost::leaf::success();
+}
+
+// the version the server publishes the updates with, an error if it is above max_version
+inline boost::leaf::awaitable<boost::leaf::result<wire_version>> co_request_version(asio::ip::tcp::socket &socket,
+                                                                                     wire_version max_version = wire_version::v2) noexcept
+{
+  const version_request request {.max_version = std::to_underlying(max_version)};
+  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_write(socket, asio::const_buffer(&request, sizeof(request)), _));
+
+  version_reply reply;
+  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_read(socket, asio::buffer(&reply, sizeof(reply)), _));
+  if(reply.version < std::to_underlying(wire_version::v1) || reply.version > std::to_underlying(max_version)) [[unlikely]]
+    co_return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::protocol_not_supported), ::boilerplate::statement {"co_request_version"});
+
+  co_return wire_version {reply.version};
+}
+
 [[using gnu : always_inline, flatten, hot]] inline std::size_t decode(auto &&message_header_handler, auto &&update_handler,
                                                                       const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept
  {
+  // a v2 packet cannot be decoded without the references of the deltas: it is skipped
+  if(UNLIKELY(is_v2(buffer)))
+    return decode_v2(nullptr, message_header_handler, update_handler, timestamp, buffer);
+
   REQUIRES(buffer.size() >= sizeof(packet));
 
   // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, cppcoreguidelines-pro-bounds-pointer-arithmetic)
@@ -128,6 +445,44 @@ inline boost::leaf::awaitable<boost::leaf::result<instrument_state>> co_request_
   return static_cast<std::size_t>(reinterpret_cast<const std::byte*>(message) - buffer_begin);
 }
 
+// decodes both versions, keeping track of the deltas references of the v2 packets
+[[using gnu : always_inline, flatten, hot]] inline std::size_t decode(delta_references &references, auto &&message_header_handler, auto &&update_handler,
+                                                                      const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept
+{
+  if(is_v2(buffer))
+    return decode_v2(&references, message_header_handler, update_handler, timestamp, buffer);
+  return decode(message_header_handler, update_handler, timestamp, buffer);
+}
+
+// number of updates of the packet at the beginning of the buffer, what a decoding gives at most
+inline std::size_t packet_nb_updates(const asio::const_buffer &buffer) noexcept
+{
+  std::size_t result = 0;
+  if(!is_v2(buffer))
+  {
+    decode([]([[maybe_unused]] auto instrument, [[maybe_unused]] auto sequence_id) noexcept { return true; },
+           [&result]([[maybe_unused]] auto &&...args) noexcept { ++result; }, network_clock::time_point(), buffer);
+    return result;
+  }
+
+  std::uint32_t base;
+  const auto *current = read_packet_v2_header(buffer, base);
+  for(auto i = 0; i < static_cast<const packet_v2_header *>(buffer.data())->nb_messages; ++i)
+  {
+    message_v2 message;
+    current = read_message_v2(current, base, message);
+    result += message.nb_values;
+  }
+  return result;
+}
+
+// size of the packet at the beginning of the buffer, walking the message headers only
+inline std::size_t packet_size(const asio::const_buffer &buffer) noexcept
+{
+  return decode([]([[maybe_unused]] auto instrument, [[maybe_unused]] auto sequence_id) noexcept { return false; }, []([[maybe_unused]] auto &&...args) noexcept {},
+                network_clock::time_point(), buffer);
+}
+
 std::size_t sanitize(auto &&value_sanitizer, const asio::mutable_buffer &buffer) noexcept
 {
   if(buffer.size() < sizeof(packet))
@@ -176,33 +531,213 @@ std::size_t sanitize(auto &&value_sanitizer, const asio::mutable_buffer &buffer)
 
 } // namespace detail
 
+using detail::wire_version;
+
 class state_map
 {
 public:
+  explicit state_map(std::size_t mtu = detail::default_mtu) noexcept { set_mtu(mtu); }
+
+  // packets are cut on message boundaries so that no datagram exceeds the MTU (and gets IP-fragmented)
+  void set_mtu(std::size_t mtu) noexcept
+  {
+    REQUIRES(mtu > detail::ip_udp_headers_size);
+    max_datagram_size = std::clamp(mtu - detail::ip_udp_headers_size,
+                                   std::max(detail::packet_header_size + detail::message_max_size, detail::packet_v2_header_max_size + detail::message_v2_max_size),
+                                   detail::packet_max_size);
+  }
+
+  std::size_t datagram_max_size() const noexcept { return max_datagram_size; }
+
+  // the instrument base saves bytes on the instrument ids when a packet holds neighbouring ones
+  void set_version(wire_version version, bool instrument_base = true, std::uint32_t key_interval = detail::default_key_interval) noexcept
+  {
+    published_version = version;
+    this->instrument_base = instrument_base;
+    this->key_interval = std::max(key_interval, std::uint32_t {1});
+    // the receivers have no reference yet
+    for(auto &&[_, state]: states)
+      state.keyed = false;
+  }
+
+  wire_version version() const noexcept { return published_version; }
+
   void reset(instrument_id_type instrument, instrument_state &&state = {}) noexcept
   {
     using state_struct = struct state;
     states.emplace(instrument, (struct state) {std::move(state), state.updates});
   }
 
+  // returns the encoded packets, valid until the next call
   auto update(const auto &states) noexcept // TODO requires is_iterable<decltype(states), std::tuple<instrument_id_type, instrument_state>>
   {
-    asio::mutable_buffer buffer(&storage, detail::packet_max_size);
-    auto packet = new(buffer.data()) detail::packet {0, {}};
+    encode(states, 0,
+           [&](std::size_t size) noexcept
+           {
+             if(storage.size() < size) [[unlikely]]
+               storage.resize(std::max(2 * storage.size(), size));
+             return storage.data();
+           });
+
+    // the storage may have grown since the first packets were closed: the buffers point into it once it is complete
+    packets.clear();
+    for(auto &&[offset, size]: packet_bounds)
+      packets.emplace_back(storage.data() + offset, size);
+    return ranges::span<const asio::const_buffer>(packets.data(), static_cast<std::ptrdiff_t>(packets.size()));
+  }
+
+  // the bytes update_into may write for that many states
+  static constexpr std::size_t max_encoded_size(std::size_t nb_states, std::size_t packet_gap) noexcept
+  {
+    return std::max(nb_states, std::size_t {1})
+           * (packet_gap + std::max(sizeof(detail::packet), detail::packet_v2_header_max_size) + detail::instrument_varint_max_size
+              + std::max(detail::message_max_size, detail::message_v2_max_size));
+  }
+
+  // update, without the copy: the packets are encoded in place into target (of max_encoded_size bytes at least), each one packet_gap bytes after
+  // the end of the previous one (e.g. room for an event header). Returns the offsets and sizes of the packets in target, valid until the next call
+  const auto &update_into(const auto &states, std::byte *target, std::size_t target_size, std::size_t packet_gap) noexcept
+  {
+    encode(states, packet_gap,
+           [&](std::size_t size) noexcept
+           {
+             ASSERTS(size <= target_size);
+             return target;
+           });
+    return packet_bounds;
+  }
+
+  // keeps track of packets encoded elsewhere (e.g. replayed as is)
+  void apply(const asio::const_buffer &packet) noexcept
+  {
+    detail::decode(
+      [&](instrument_id_type instrument, sequence_id_type sequence_id) noexcept
+      {
+        auto *state_ptr = &states[instrument];
+        state_ptr->state.sequence_id = sequence_id;
+        state_ptr->keyed = false;
+        return state_ptr;
+      },
+      []([[maybe_unused]] const auto &timestamp, const struct update &update, auto *state_ptr) noexcept
+      {
+        update_state(state_ptr->state, update);
+        state_ptr->accumulated_updates |= std::exchange(state_ptr->state.updates, {});
+      },
+      network_clock::time_point(), packet);
+  }
+
+  std::size_t size() const noexcept { return states.size(); }
+
+  void each_instrument(auto continuation) const noexcept
+  {
+    for(auto &&[instrument, _]: states)
+      continuation(instrument);
+  }
+
+  instrument_state at(instrument_id_type instrument) const noexcept
+  {
+    const auto it = states.find(instrument);
+    if(it == states.end())
+      return {};
+    auto result = it->second.state;
+    result.updates = it->second.accumulated_updates;
+    return result;
+  }
+
+private:
+  struct state
+  {
+    instrument_state state {};
+    decltype(instrument_state::updates) accumulated_updates {};
+
+    // v2: the values as last published, the references of the deltas
+    std::array<std::uint32_t, std::to_underlying(field_index::_count)> published {};
+    std::uint32_t nb_since_key = 0;
+    bool keyed = false;
+  };
+
+  // allocate(size) returns the buffer to encode into, of size bytes at least: the packets are in it, packet_gap bytes apart, at packet_bounds
+  void encode(const auto &states, std::size_t packet_gap, auto &&allocate) noexcept
+  {
+    packet_bounds.clear();
+
+    const bool v2 = published_version == wire_version::v2;
+    const auto message_max_size = v2 ? detail::message_v2_max_size : detail::message_max_size;
 
-    auto current = buffer + offsetof(detail::packet, message);
+    std::size_t packet_offset = 0, current_offset = 0;
+    std::byte *data = allocate(0);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto packet = [&]() noexcept { return reinterpret_cast<detail::packet *>(data + packet_offset); };
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto packet_v2 = [&]() noexcept { return reinterpret_cast<detail::packet_v2_header *>(data + packet_offset); };
+    const auto nb_messages = [&]() noexcept -> std::uint8_t & { return v2 ? packet_v2()->nb_messages : packet()->nb_messages; };
+    const auto reserve = [&](std::size_t size) noexcept { data = allocate(current_offset + size); };
+    const auto open_packet = [&]() noexcept
+    {
+      reserve(packet_gap + (v2 ? detail::packet_v2_header_max_size : sizeof(detail::packet)));
+      current_offset += packet_gap;
+      packet_offset = current_offset;
+      if(v2)
+      {
+        current_offset += sizeof(detail::packet_v2_header);
+        new(packet_v2()) detail::packet_v2_header {};
+        return;
+      }
+      current_offset += detail::packet_header_size;
+      new(packet()) detail::packet {0, {}};
+    };
+    const auto close_packet = [&]() noexcept
+    {
+      if(nb_messages())
+        packet_bounds.emplace_back(packet_offset, current_offset - packet_offset);
+    };
+
+    std::uint32_t base = 0;
+    open_packet();
     for(auto &&[instrument, new_state]: states)
     {
-      auto &[state, valid_updates] = this->states[instrument];
+      if(nb_messages() == std::numeric_limits<std::uint8_t>::max() || current_offset + message_max_size > packet_offset + max_datagram_size)
+      {
+        close_packet();
+        open_packet();
+      }
+      reserve(detail::instrument_varint_max_size + message_max_size);
+
+      if(v2)
+      {
+        std::array<std::byte, detail::message_v2_max_size> body;
+        const auto body_size = encode_body_v2(body.data(), new_state, this->states[instrument]);
+        if(!body_size)
+          continue;
+
+        if(!nb_messages() && instrument_base)
+        {
+          base = instrument;
+          packet_v2()->flags |= detail::has_instrument_base;
+          current_offset = static_cast<std::size_t>(detail::write_varint(data + current_offset, base) - data);
+        }
+        else if(!nb_messages())
+          base = 0;
+
+        auto *target = detail::write_varint(data + current_offset, detail::zigzag_encode(static_cast<std::int32_t>(instrument - base)));
+        std::memcpy(target, body.data(), body_size);
+        current_offset = static_cast<std::size_t>(target - data) + body_size;
+        ++nb_messages();
+        continue;
+      }
+
+      auto &published = this->states[instrument];
+      auto &state = published.state;
+      auto &valid_updates = published.accumulated_updates;
 
       if(new_state.sequence_id)
         state.sequence_id = new_state.sequence_id;
 
-      auto *message = new (current.data()) (struct message) {.instrument = endian::big_uint16_buf_t(instrument),
-                                                             .sequence_id = endian::big_uint32_buf_t(state.sequence_id),
-                                                             .nb_updates = 0};
+      auto *message = new (data + current_offset) (struct message) {.instrument = endian::big_uint16_buf_t(instrument),
+                                                                    .sequence_id = endian::big_uint32_buf_t(state.sequence_id),
+                                                                    .nb_updates = 0};
 
-      visit_state([&, &state = state](auto field, auto value) { 
+      visit_state([&](auto field, auto value) { 
           if(update_state_test(state, field, value))
             message->updates[message->nb_updates++] = encode_update(field, value);
         }, new_state);
@@ -216,38 +751,103 @@ public:
 
       message->sequence_id = state.sequence_id;
 
-      ++packet->nb_messages;
-      current += sizeof(struct message) + sizeof(struct update) * (message->nb_updates - 1); 
+      ++packet()->nb_messages;
+      current_offset += sizeof(struct message) + sizeof(struct update) * (message->nb_updates - 1);
 
       valid_updates |= std::exchange(state.updates, {});
     }
+    close_packet();
+  }
 
-    return packet->nb_messages ? asio::const_buffer(buffer.data(), static_cast<std::size_t>(static_cast<std::byte*>(current.data()) - static_cast<std::byte*>(buffer.data()))) : asio::const_buffer();
+  // everything but the instrument, or nothing if no field changed
+  std::size_t encode_body_v2(std::byte *target, const instrument_state &new_state, struct state &published) const noexcept
+  {
+    auto &state = published.state;
+    auto &valid_updates = published.accumulated_updates;
+
+    const auto previous_sequence_id = state.sequence_id;
+    if(new_state.sequence_id)
+      state.sequence_id = new_state.sequence_id;
+
+    visit_state([&](auto field, auto value) noexcept { update_state_test(state, field, value); }, new_state);
+    if(state.updates.none())
+      return 0;
+
+    if(!new_state.sequence_id)
+      ++state.sequence_id;
+
+    // the receivers check the sequence ids to apply the deltas: a jump in the sequence ids needs a key message as well
+    const bool key = !published.keyed || state.sequence_id != previous_sequence_id + 1 || published.nb_since_key + 1 >= key_interval;
+    published.nb_since_key = key ? 0 : published.nb_since_key + 1;
+    published.keyed = true;
+
+    auto fields = state;
+    fields.updates = key ? valid_updates | state.updates : state.updates;
+
+    auto *const presence = target++; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    *presence = std::byte {key ? detail::key_message : std::uint8_t {}};
+    if(key)
+      target = detail::write_varint(target, state.sequence_id);
+    else
+      *target++ = std::byte(state.sequence_id); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+    visit_state(
+      [&](auto field, auto value) noexcept
+      {
+        constexpr auto index = detail::index_of(decltype(field)::value);
+        const auto wire_value = endian::big_to_native(encode_update(field, value).value);
+        *presence |= std::byte(1u << index);
+        target = detail::write_varint(target, detail::delta_encode(wire_value, key ? 0 : published.published[index]));
+        published.published[index] = wire_value;
+      },
+      fields);
+
+    valid_updates |= std::exchange(state.updates, {});
+    return static_cast<std::size_t>(target - presence);
   }
 
-  instrument_state at(instrument_id_type instrument) const noexcept
+  std::size_t max_datagram_size = detail::packet_max_size;
+  wire_version published_version = wire_version::v1;
+  bool instrument_base = true;
+  std::uint32_t key_interval = detail::default_key_interval;
+  std::vector<std::byte> storage = std::vector<std::byte>(detail::packet_max_size);
+  std::vector<std::pair<std::size_t, std::size_t>> packet_bounds {}; // offset and size in the storage (or the target of update_into)
+  std::vector<asio::const_buffer> packets {};
+  std::unordered_map<instrument_id_type, state> states {};
+};
+
+// the binary format as a decoder (see feed::decoder): v1 only, stateless
+struct binary_v1_decoder
+{
+  [[using gnu : always_inline, flatten, hot]] std::size_t operator()(auto &&message_header_handler, auto &&update_handler,
+                                                                     const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept
   {
-    const auto it = states.find(instrument);
-    if(it == states.end())
-      return {};
-    auto result = it->second.state;
-    result.updates = it->second.accumulated_updates;
-    return result;
+    return detail::decode(message_header_handler, update_handler, timestamp, buffer);
   }
 
-private:
-  struct state
+  void reset([[maybe_unused]] instrument_id_type instrument, [[maybe_unused]] const instrument_state &snapshot) noexcept {}
+};
+static_assert(decoder<binary_v1_decoder>);
+
+// both versions, the v2 deltas applying to the previous messages and the snapshots
+struct binary_decoder
+{
+  [[using gnu : always_inline, flatten, hot]] std::size_t operator()(auto &&message_header_handler, auto &&update_handler,
+                                                                     const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept
   {
-    instrument_state state {};
-    decltype(instrument_state::updates) accumulated_updates {};
-  };
+    return detail::decode(references, message_header_handler, update_handler, timestamp, buffer);
+  }
 
-  std::aligned_storage_t<detail::packet_max_size, alignof(detail::packet)> storage {};
-  std::unordered_map<instrument_id_type, state> states {};
+  void reset(instrument_id_type instrument, const instrument_state &snapshot) noexcept { references.reset(instrument, snapshot); }
+
+  detail::delta_references references {};
 };
+static_assert(decoder<binary_decoder>);
 
 using detail::decode;
 using detail::co_request_snapshot;
+using detail::co_request_bulk_snapshot;
+using detail::co_request_version;
 
 namespace sample_packets
 {
@@ -282,6 +882,107 @@ TEST_SUITE("feed_binary")
     //  decode([](feed:instrument_instrument_id_type instrument, feed::sequence_id_type sequence_id){ CHECK(instrument == 1); CHECK(sequence_id == 0); return 0;},
     //        [](network_clock::time_point timestamp, const feed::update &update, int instrument_closure){ CHECK(timestamp == 0); CHECK(instrument_closure == 0); }, 0, packet_0);
   }
+
+  TEST_CASE("state_map_mtu")
+  {
+    constexpr std::size_t mtu = 128, nb_instruments = 1'000;
+
+    feed::state_map state_map(mtu);
+    std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states;
+    for(std::size_t i = 0; i < nb_instruments; ++i)
+    {
+      feed::instrument_state state;
+      feed::update_state(state, feed::bq0_v, feed::quantity_t {1});
+      feed::update_state(state, feed::oq0_v, feed::quantity_t {2});
+      states.emplace_back(static_cast<feed::instrument_id_type>(i + 1), state);
+    }
+    const auto packets = state_map.update(states);
+
+    std::size_t nb_messages = 0;
+    for(auto &&packet: packets)
+    {
+      CHECK(packet.size() <= mtu - feed::detail::ip_udp_headers_size);
+      CHECK(feed::decode([&](auto, auto) { ++nb_messages; return true; }, [](auto &&...) {}, network_clock::time_point(), packet) == packet.size());
+    }
+    CHECK(packets.size() > 1);
+    CHECK(nb_messages == nb_instruments);
+  }
+
+  TEST_CASE("state_map_large_batch")
+  {
+    // more than the initial storage: the packets closed before it grew still decode
+    constexpr std::size_t nb_instruments = 10'000;
+
+    feed::state_map state_map;
+    std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states;
+    for(std::size_t i = 0; i < nb_instruments; ++i)
+    {
+      feed::instrument_state state;
+      feed::update_state(state, feed::bq0_v, static_cast<feed::quantity_t>(i % 100 + 1));
+      feed::update_state(state, feed::oq0_v, feed::quantity_t {2});
+      states.emplace_back(static_cast<feed::instrument_id_type>(i + 1), state);
+    }
+    const auto packets = state_map.update(states);
+
+    std::size_t nb_bytes = 0;
+    std::unordered_map<feed::instrument_id_type, feed::instrument_state> decoded;
+    for(auto &&packet: packets)
+    {
+      nb_bytes += packet.size();
+      CHECK(feed::decode([&](auto instrument, auto sequence_id) { return &(decoded[instrument].sequence_id = sequence_id, decoded[instrument]); },
+                         [](auto, const feed::update &update, auto *state) { feed::update_state(*state, update); }, network_clock::time_point(), packet)
+            == packet.size());
+    }
+    CHECK(nb_bytes > feed::detail::packet_max_size);
+    CHECK(decoded.size() == nb_instruments);
+    for(auto &&[instrument, state]: states)
+      CHECK(decoded[instrument].bq0 == state.bq0);
+  }
+
+  TEST_CASE("wire_v2")
+  {
+    static_assert(feed::detail::zigzag_decode(feed::detail::zigzag_encode(-3)) == -3);
+    static_assert(feed::detail::delta_decode(feed::detail::delta_encode(1, 0xffff'ffff), 0xffff'ffff) == 1);
+
+    feed::state_map v1, v2;
+    v2.set_version(feed::wire_version::v2, true, 4);
+    feed::detail::delta_references references;
+    std::unordered_map<feed::instrument_id_type, feed::instrument_state> decoded;
+    std::size_t v1_size = 0, v2_size = 0;
+
+    for(std::uint32_t i = 0; i < 100; ++i)
+    {
+      std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states;
+      for(feed::instrument_id_type instrument = 1'000; instrument < 1'010; ++instrument)
+      {
+        feed::instrument_state state;
+        feed::update_state(state, feed::bq0_v, feed::quantity_t {100 + (i + instrument) % 3});
+        states.emplace_back(instrument, state);
+      }
+      for(auto &&packet: v1.update(states))
+        v1_size += packet.size();
+      for(auto &&packet: v2.update(states))
+      {
+        v2_size += packet.size();
+        CHECK(feed::detail::packet_size(packet) == packet.size());
+        CHECK(feed::detail::packet_nb_updates(packet) == states.size());
+        if(i == 10) // lost: the instruments get back on track with their next key message
+          continue;
+        CHECK(feed::decode(
+                references, [&](auto instrument, auto sequence_id) { return &(decoded[instrument].sequence_id = sequence_id, decoded[instrument]); },
+                [](auto, const feed::update &update, auto *state) { feed::update_state(*state, update); }, network_clock::time_point(), packet)
+              == packet.size());
+      }
+    }
+
+    CHECK(2 * v2_size <= v1_size);
+    v2.each_instrument(
+      [&](auto instrument)
+      {
+        CHECK(decoded[instrument].sequence_id == v2.at(instrument).sequence_id);
+        CHECK(decoded[instrument].bq0 == v2.at(instrument).bq0);
+      });
+  }
 }
 
 // GCOVR_EXCL_STOP
@@ -0,0 +1,552 @@
+#pragma once
+
+#include <feed/binary/feed_binary.hpp>
+
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/likely.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+
+#include <gsl/util>
+
+#include <range/v3/span.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Indexed capture file:
+//
+//  +--------------------+ 0
+//  | capture_header     |
+//  +--------------------+ data_offset (huge page aligned, and so is its address once mapped)
+//  | detail::event...   |   the usual event stream, cut in blocks on event boundaries
+//  +--------------------+ index_offset (page aligned)
+//  | capture_block...   |   sorted by time
+//  | capture_instrument |   sorted by instrument
+//  | block numbers...   |   per instrument, sorted by time
+//  +--------------------+
+//
+// Integers are native endian: captures are meant to be read on the box that wrote them.
+
+namespace feed
+{
+constexpr std::array<char, 8> capture_magic = {'F', 'E', 'E', 'D', 'C', 'A', 'P', '1'};
+constexpr std::uint32_t capture_version = 1;
+
+constexpr std::size_t capture_page_size = 4'096;
+constexpr std::size_t capture_data_alignment = 2 * 1'024 * 1'024; // huge page
+constexpr std::size_t default_capture_block_size = 64 * 1'024;
+
+struct capture_header final
+{
+  std::array<char, 8> magic = capture_magic;
+  std::uint32_t version = capture_version;
+  std::uint32_t reserved = 0;
+  std::uint64_t nb_events = 0;
+  std::uint64_t data_offset = 0;
+  std::uint64_t data_size = 0;
+  std::uint64_t index_offset = 0;
+  std::uint64_t nb_blocks = 0;
+  std::uint64_t nb_instruments = 0;
+  std::uint64_t first_timestamp = 0;
+  std::uint64_t last_timestamp = 0;
+};
+
+struct capture_block final
+{
+  std::uint64_t first_timestamp = 0;
+  std::uint64_t last_timestamp = 0; // running maximum, so that blocks are sorted even if the capture is not monotonic
+  std::uint64_t offset = 0;         // relative to data_offset
+  std::uint64_t size = 0;
+};
+
+struct capture_instrument final
+{
+  std::uint64_t first_block_number = 0; // index of its first block number
+  std::uint32_t nb_blocks = 0;
+  instrument_id_type instrument = 0;
+  std::uint16_t reserved = 0;
+};
+
+namespace detail
+{
+constexpr std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment) noexcept { return (value + alignment - 1) / alignment * alignment; }
+
+inline auto errno_error(const char *statement) noexcept { return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {statement}); }
+
+inline boost::leaf::result<void> pwrite_all(int fd, const void *data, std::size_t size, std::uint64_t offset) noexcept
+{
+  for(const auto *first = static_cast<const std::byte *>(data); size;)
+  {
+    const auto written = ::pwrite(fd, first, size, static_cast<off_t>(offset));
+    if(written < 0) [[unlikely]]
+    {
+      if(errno == EINTR)
+        continue;
+      return errno_error("pwrite");
+    }
+    first += written;
+    size -= static_cast<std::size_t>(written);
+    offset += static_cast<std::uint64_t>(written);
+  }
+  return boost::leaf::success();
+}
+
+template<typename value_type>
+inline boost::leaf::result<void> pwrite_all(int fd, const std::vector<value_type> &values, std::uint64_t offset) noexcept
+{
+  return pwrite_all(fd, values.data(), values.size() * sizeof(value_type), offset);
+}
+
+// read-only private mapping of a whole file, at an address aligned on alignment (a power of 2, at least a page): an offset of the file aligned
+// on a huge page is then at an address huge pages can back
+class mapped_file
+{
+public:
+  static boost::leaf::result<mapped_file> open(const char *path, std::size_t alignment = capture_page_size) noexcept
+  {
+    const auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) [[unlikely]]
+      return errno_error("open");
+    const auto _ = gsl::finally([&]() { ::close(fd); });
+
+    struct stat stat;
+    if(::fstat(fd, &stat) < 0) [[unlikely]]
+      return errno_error("fstat");
+    const auto size = static_cast<std::size_t>(stat.st_size);
+    if(!size)
+      return mapped_file(nullptr, 0);
+
+    // an address range reserved with room to align the start, the file mapped over it, then what is left of the reservation given back
+    const auto reserved_size = size + alignment;
+    auto *const reserved = ::mmap(nullptr, reserved_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(reserved == MAP_FAILED) [[unlikely]]
+      return errno_error("mmap");
+    const auto reserved_begin = reinterpret_cast<std::uintptr_t>(reserved), reserved_end = reserved_begin + reserved_size;
+    const auto begin = align_up(reserved_begin, alignment), end = align_up(begin + size, capture_page_size);
+
+    auto *const data = ::mmap(reinterpret_cast<void *>(begin), size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0); // NOLINT(performance-no-int-to-ptr)
+    if(data == MAP_FAILED) [[unlikely]]
+    {
+      const auto error = errno_error("mmap");
+      ::munmap(reserved, reserved_size);
+      return error;
+    }
+    if(begin != reserved_begin)
+      ::munmap(reserved, begin - reserved_begin);
+    if(end < reserved_end)
+      ::munmap(reinterpret_cast<void *>(end), reserved_end - end); // NOLINT(performance-no-int-to-ptr)
+    return mapped_file(static_cast<const std::byte *>(data), size);
+  }
+
+  mapped_file(mapped_file &&other) noexcept: data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+  mapped_file &operator=(mapped_file &&) = delete;
+
+  ~mapped_file() noexcept
+  {
+    if(data_)
+      ::munmap(const_cast<std::byte *>(data_), size_);
+  }
+
+  const std::byte *data() const noexcept { return data_; }
+  std::size_t size() const noexcept { return size_; }
+  asio::const_buffer buffer() const noexcept { return asio::const_buffer(data_, size_); }
+
+  void advise(std::size_t offset, std::size_t size, int advice) const noexcept { ::madvise(const_cast<std::byte *>(data_ + offset), size, advice); }
+
+private:
+  mapped_file(const std::byte *data, std::size_t size) noexcept: data_(data), size_(size) {}
+
+  const std::byte *data_ = nullptr;
+  std::size_t size_ = 0;
+};
+} // namespace detail
+
+//
+//
+// WRITER
+
+class capture_writer
+{
+public:
+  static boost::leaf::result<capture_writer> create(const char *path, std::size_t block_size = default_capture_block_size) noexcept
+  {
+    const auto fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) [[unlikely]]
+      return detail::errno_error("open");
+    return capture_writer(fd, block_size);
+  }
+
+  capture_writer(capture_writer &&other) noexcept:
+    fd(std::exchange(other.fd, -1)), block_size(other.block_size), header(other.header), pending(std::move(other.pending)), scratch(std::move(other.scratch)),
+    flushed_bytes(other.flushed_bytes), block_bytes(other.block_bytes), blocks(std::move(other.blocks)), block_instruments(std::move(other.block_instruments)),
+    instrument_blocks(std::move(other.instrument_blocks))
+  {
+  }
+
+  capture_writer &operator=(capture_writer &&) = delete;
+
+  ~capture_writer() noexcept
+  {
+    if(fd >= 0)
+      static_cast<void>(close());
+  }
+
+  // any number of whole events
+  boost::leaf::result<void> write(const asio::const_buffer &events) noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto *current = reinterpret_cast<const std::byte *>(events.data()), *const end = current + events.size();
+    while(static_cast<std::size_t>(end - current) >= sizeof(detail::event))
+    {
+      const auto *event = reinterpret_cast<const detail::event *>(current); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      const auto packet = asio::const_buffer(&event->packet, static_cast<std::size_t>(end - current) - offsetof(detail::event, packet));
+      const auto event_size = offsetof(detail::event, packet) + detail::packet_size(packet);
+      BOOST_LEAF_CHECK(write_event(event->timestamp, asio::const_buffer(current, event_size)));
+      current += event_size;
+    }
+    return boost::leaf::success();
+  }
+
+  boost::leaf::result<void> write(std::uint64_t timestamp, const asio::const_buffer &packet) noexcept
+  {
+    scratch.resize(offsetof(detail::event, packet) + packet.size());
+    std::memcpy(scratch.data(), &timestamp, sizeof(timestamp));
+    std::memcpy(scratch.data() + offsetof(detail::event, packet), packet.data(), packet.size());
+    return write_event(timestamp, asio::const_buffer(scratch.data(), scratch.size()));
+  }
+
+  // writes the index and the header
+  boost::leaf::result<void> close() noexcept
+  {
+    const auto _ = gsl::finally([&]() { ::close(std::exchange(fd, -1)); });
+
+    close_block();
+    BOOST_LEAF_CHECK(flush());
+
+    std::vector<capture_instrument> instruments;
+    std::vector<std::uint32_t> block_numbers;
+    for(auto &&[instrument, numbers]: instrument_blocks)
+    {
+      instruments.push_back({.first_block_number = block_numbers.size(), .nb_blocks = static_cast<std::uint32_t>(numbers.size()), .instrument = instrument});
+      block_numbers.insert(block_numbers.end(), numbers.begin(), numbers.end());
+    }
+
+    header.nb_blocks = blocks.size();
+    header.nb_instruments = instruments.size();
+    header.index_offset = detail::align_up(header.data_offset + header.data_size, capture_page_size);
+
+    auto offset = header.index_offset;
+    BOOST_LEAF_CHECK(detail::pwrite_all(fd, blocks, offset));
+    offset += blocks.size() * sizeof(capture_block);
+    BOOST_LEAF_CHECK(detail::pwrite_all(fd, instruments, offset));
+    offset += instruments.size() * sizeof(capture_instrument);
+    BOOST_LEAF_CHECK(detail::pwrite_all(fd, block_numbers, offset));
+
+    return detail::pwrite_all(fd, &header, sizeof(header), 0);
+  }
+
+private:
+  static constexpr std::size_t flush_threshold = 1'024 * 1'024;
+
+  capture_writer(int fd, std::size_t block_size) noexcept: fd(fd), block_size(block_size) { header.data_offset = capture_data_alignment; }
+
+  boost::leaf::result<void> write_event(std::uint64_t timestamp, const asio::const_buffer &event) noexcept
+  {
+    if(block_bytes && block_bytes + event.size() > block_size)
+      close_block();
+
+    if(!block_bytes)
+      blocks.push_back({.first_timestamp = timestamp, .last_timestamp = std::max(timestamp, header.last_timestamp), .offset = header.data_size});
+    auto &block = blocks.back();
+    block.first_timestamp = std::min(block.first_timestamp, timestamp);
+    block.last_timestamp = std::max(block.last_timestamp, timestamp);
+
+    if(!header.nb_events)
+      header.first_timestamp = timestamp;
+    header.first_timestamp = std::min(header.first_timestamp, timestamp);
+    header.last_timestamp = std::max(header.last_timestamp, timestamp);
+    ++header.nb_events;
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto &packet = reinterpret_cast<const detail::event *>(event.data())->packet;
+    detail::decode(
+      [&](instrument_id_type instrument, [[maybe_unused]] sequence_id_type sequence_id) noexcept
+      {
+        block_instruments.insert(instrument);
+        return false;
+      },
+      []([[maybe_unused]] auto &&...args) noexcept {}, network_clock::time_point(), asio::const_buffer(&packet, event.size() - offsetof(detail::event, packet)));
+
+    const auto *first = static_cast<const std::byte *>(event.data());
+    pending.insert(pending.end(), first, first + event.size());
+    block_bytes += event.size();
+    header.data_size += event.size();
+
+    if(pending.size() >= flush_threshold)
+      return flush();
+    return boost::leaf::success();
+  }
+
+  void close_block() noexcept
+  {
+    if(!block_bytes)
+      return;
+    blocks.back().size = block_bytes;
+    const auto block_number = static_cast<std::uint32_t>(blocks.size() - 1);
+    for(auto instrument: block_instruments)
+      instrument_blocks[instrument].push_back(block_number);
+    block_instruments.clear();
+    block_bytes = 0;
+  }
+
+  boost::leaf::result<void> flush() noexcept
+  {
+    BOOST_LEAF_CHECK(detail::pwrite_all(fd, pending, header.data_offset + flushed_bytes));
+    flushed_bytes += pending.size();
+    pending.clear();
+    return boost::leaf::success();
+  }
+
+  int fd = -1;
+  std::size_t block_size = default_capture_block_size;
+  capture_header header {};
+
+  std::vector<std::byte> pending {};
+  std::vector<std::byte> scratch {};
+  std::uint64_t flushed_bytes = 0;
+  std::size_t block_bytes = 0;
+
+  std::vector<capture_block> blocks {};
+  boost::container::flat_set<instrument_id_type> block_instruments {};
+  boost::container::flat_map<instrument_id_type, std::vector<std::uint32_t>> instrument_blocks {};
+};
+
+//
+//
+// READER
+
+// Read-only mapping of a capture. All the buffers returned are views on the mapping.
+class capture_reader
+{
+public:
+  static boost::leaf::result<capture_reader> open(const char *path) noexcept
+  {
+    BOOST_LEAF_AUTO(file, detail::mapped_file::open(path, capture_data_alignment));
+    if(file.size() < sizeof(capture_header)) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"capture too small"});
+    capture_reader result(std::move(file));
+
+    const auto &header = result.header();
+    if(header.magic != capture_magic || header.version != capture_version) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"not a capture"});
+    const auto file_size = result.file.size();
+    if(header.data_offset > file_size || header.data_size > file_size - header.data_offset || header.index_offset > file_size
+       || header.nb_blocks > (file_size - header.index_offset) / sizeof(capture_block)
+       || header.nb_instruments > (file_size - header.index_offset - header.nb_blocks * sizeof(capture_block)) / sizeof(capture_instrument)) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"truncated capture"});
+
+    // the block numbers follow the instruments: as many as their blocks, each of them a block of the capture
+    const auto instruments = result.instruments();
+    const auto blocks_size = file_size - header.index_offset - header.nb_blocks * sizeof(capture_block) - header.nb_instruments * sizeof(capture_instrument);
+    std::uint64_t nb_block_numbers = 0;
+    for(const auto &instrument: instruments)
+    {
+      if(instrument.first_block_number != nb_block_numbers) [[unlikely]]
+        return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"corrupt capture index"});
+      nb_block_numbers += instrument.nb_blocks;
+    }
+    if(nb_block_numbers > blocks_size / sizeof(std::uint32_t)) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"truncated capture"});
+    const auto *block_numbers = reinterpret_cast<const std::uint32_t *>(instruments.data() + instruments.size()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    if(std::any_of(block_numbers, block_numbers + nb_block_numbers, [&](auto block_number) noexcept { return block_number >= header.nb_blocks; })
+       || std::any_of(result.blocks().begin(), result.blocks().end(),
+                      [&](const auto &block) noexcept { return block.offset > header.data_size || block.size > header.data_size - block.offset; })) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"corrupt capture index"});
+
+    // the data section is huge page aligned, in the file and in memory
+    result.file.advise(header.data_offset, header.data_size, MADV_HUGEPAGE);
+    result.file.advise(header.data_offset, header.data_size, MADV_SEQUENTIAL);
+
+    return result;
+  }
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const capture_header &header() const noexcept { return *reinterpret_cast<const capture_header *>(data); }
+
+  asio::const_buffer events() const noexcept { return asio::const_buffer(data + header().data_offset, header().data_size); }
+
+  ranges::span<const capture_block> blocks() const noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return {reinterpret_cast<const capture_block *>(data + header().index_offset), static_cast<std::ptrdiff_t>(header().nb_blocks)};
+  }
+
+  asio::const_buffer block(const capture_block &block) const noexcept { return asio::const_buffer(data + header().data_offset + block.offset, block.size); }
+
+  // events from the first one stamped at or after timestamp to the end of the capture: O(log(nb_blocks)) + a scan of one block
+  asio::const_buffer seek(std::uint64_t timestamp) const noexcept
+  {
+    const auto blocks = this->blocks();
+    const auto it = std::partition_point(blocks.begin(), blocks.end(), [&](const auto &block) noexcept { return block.last_timestamp < timestamp; });
+    if(it == blocks.end())
+      return asio::const_buffer();
+
+    auto result = events() + it->offset;
+    for(auto remaining = it->size; remaining;)
+    {
+      const auto *event = static_cast<const detail::event *>(result.data());
+      if(event->timestamp >= timestamp)
+        break;
+      const auto event_size
+        = offsetof(detail::event, packet) + detail::packet_size(asio::const_buffer(&event->packet, result.size() - offsetof(detail::event, packet)));
+      result += event_size;
+      remaining -= event_size;
+    }
+    return result;
+  }
+
+  // the blocks holding at least one message for the instrument, sorted by time: O(log(nb_instruments))
+  ranges::span<const std::uint32_t> blocks_of(instrument_id_type instrument) const noexcept
+  {
+    const auto instruments = this->instruments();
+    const auto it = std::lower_bound(instruments.begin(), instruments.end(), instrument,
+                                     [](const auto &entry, instrument_id_type instrument) noexcept { return entry.instrument < instrument; });
+    if(it == instruments.end() || it->instrument != instrument)
+      return {};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto *block_numbers = reinterpret_cast<const std::uint32_t *>(instruments.data() + instruments.size());
+    return {block_numbers + it->first_block_number, static_cast<std::ptrdiff_t>(it->nb_blocks)};
+  }
+
+  // calls continuation with the blocks holding the instrument, from the first one that may hold events stamped at or after timestamp
+  void each_block(instrument_id_type instrument, std::uint64_t timestamp, auto continuation) const noexcept
+  {
+    const auto blocks = this->blocks();
+    const auto block_numbers = blocks_of(instrument);
+    const auto first = std::partition_point(block_numbers.begin(), block_numbers.end(),
+                                            [&](auto block_number) noexcept { return blocks[block_number].last_timestamp < timestamp; });
+    for(auto it = first; it != block_numbers.end(); ++it)
+      continuation(block(blocks[*it]));
+  }
+
+private:
+  explicit capture_reader(detail::mapped_file &&file) noexcept: file(std::move(file)), data(this->file.data()) {}
+
+  ranges::span<const capture_instrument> instruments() const noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return {reinterpret_cast<const capture_instrument *>(data + header().index_offset + header().nb_blocks * sizeof(capture_block)),
+            static_cast<std::ptrdiff_t>(header().nb_instruments)};
+  }
+
+  detail::mapped_file file;
+  const std::byte *data = nullptr;
+};
+
+} // namespace feed
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+#include <cstdint>
+#include <cstdlib>
+
+TEST_SUITE("feed_capture")
+{
+  TEST_CASE("capture_roundtrip")
+  {
+    char path[] = "/tmp/feed_capture_XXXXXX";
+    ::close(::mkstemp(path));
+    const auto _ = gsl::finally([&]() { ::unlink(path); });
+
+    // 2 events per block
+    const auto write = [&]() -> boost::leaf::result<void>
+    {
+      BOOST_LEAF_AUTO(writer, feed::capture_writer::create(path, 2 * sizeof(feed::detail::event)));
+      for(auto i = 0u; i < 5; ++i)
+      {
+        feed::detail::packet packet {.nb_messages = 1};
+        packet.message.instrument = static_cast<feed::instrument_id_type>(i % 2);
+        packet.message.nb_updates = 1;
+        BOOST_LEAF_CHECK(writer.write(100 * (i + 1), asio::const_buffer(&packet, sizeof(packet))));
+      }
+      return writer.close();
+    };
+    REQUIRE(write());
+
+    auto reader = feed::capture_reader::open(path);
+    REQUIRE(reader);
+    CHECK(reader->header().nb_events == 5);
+    CHECK(reader->blocks().size() == 3);
+    CHECK(reader->events().size() == 5 * sizeof(feed::detail::event));
+
+    const auto from_250 = reader->seek(250);
+    REQUIRE(from_250.size() == 3 * sizeof(feed::detail::event));
+    CHECK(static_cast<const feed::detail::event *>(from_250.data())->timestamp == 300);
+    CHECK(reader->seek(501).size() == 0);
+
+    CHECK(reader->blocks_of(0).size() == 3);
+    CHECK(reader->blocks_of(1).size() == 2);
+    CHECK(reader->blocks_of(2).empty());
+
+    std::size_t nb_blocks = 0;
+    reader->each_block(1, 350, [&](const asio::const_buffer &) { ++nb_blocks; });
+    CHECK(nb_blocks == 1);
+
+    // the data section at a huge page boundary in memory too
+    CHECK(reinterpret_cast<std::uintptr_t>(reader->events().data()) % feed::capture_data_alignment == 0); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  }
+
+  TEST_CASE("capture_corrupt_index")
+  {
+    char path[] = "/tmp/feed_capture_XXXXXX";
+    ::close(::mkstemp(path));
+    const auto _ = gsl::finally([&]() { ::unlink(path); });
+
+    const auto write = [&]() -> boost::leaf::result<void>
+    {
+      BOOST_LEAF_AUTO(writer, feed::capture_writer::create(path, sizeof(feed::detail::event)));
+      for(auto i = 0u; i < 3; ++i)
+      {
+        feed::detail::packet packet {.nb_messages = 1};
+        packet.message.nb_updates = 1;
+        BOOST_LEAF_CHECK(writer.write(100 * (i + 1), asio::const_buffer(&packet, sizeof(packet))));
+      }
+      return writer.close();
+    };
+    REQUIRE(write());
+    struct stat stat;
+    REQUIRE(::stat(path, &stat) == 0);
+
+    // the last block number cut off
+    REQUIRE(::truncate(path, stat.st_size - 1) == 0);
+    CHECK(!feed::capture_reader::open(path));
+
+    // a block number past the blocks
+    REQUIRE(write());
+    const auto fd = ::open(path, O_WRONLY);
+    REQUIRE(fd >= 0);
+    const std::uint32_t block_number = 3;
+    CHECK(::pwrite(fd, &block_number, sizeof(block_number), stat.st_size - static_cast<off_t>(sizeof(block_number))) == sizeof(block_number));
+    ::close(fd);
+    CHECK(!feed::capture_reader::open(path));
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
@@ -0,0 +1,177 @@
+#pragma once
+
+#if defined(LINUX)
+
+#include <feed/binary/feed_binary.hpp>
+
+#include <range/v3/view/span.hpp>
+
+#include <linux/filter.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A classic BPF socket filter on the binary packets: the kernel drops a v1 packet unless one of its messages is for one of the instruments, before
+// the copy to user space. There is no loop in classic BPF: the first messages are walked unrolled, and a packet with more is kept, as is a v2
+// packet (varints, and deltas that the decoder wants anyway). Past so many instruments there is no filter (an empty program).
+
+namespace feed
+{
+constexpr std::size_t socket_filter_max_instruments = 200; // a jump over the comparisons is 8 bits
+constexpr std::size_t socket_filter_nb_messages = 8;
+
+// payload_offset: where the datagram starts in what the filter is given (the UDP header for a UDP socket)
+inline std::vector<::sock_filter> make_socket_filter(ranges::span<const instrument_id_type> instruments, std::uint32_t payload_offset = 8)
+{
+  if(static_cast<std::size_t>(instruments.size()) > socket_filter_max_instruments)
+    return {};
+
+  constexpr std::uint32_t keep = 0x40000, drop = 0;
+  constexpr std::uint32_t message_header_size = offsetof(struct message, updates);
+  const auto nb_instruments = static_cast<std::uint8_t>(instruments.size());
+  const auto at = [&](std::size_t offset) noexcept { return static_cast<std::uint32_t>(payload_offset + offset); };
+
+  std::vector<::sock_filter> program {
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, at(offsetof(detail::packet, nb_messages))),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1), // the marker of a v2 packet (or an empty v1 one)
+    BPF_STMT(BPF_RET | BPF_K, keep),
+    BPF_STMT(BPF_ST, 0),                                                          // M[0] = the messages left
+    BPF_STMT(BPF_LDX | BPF_IMM, offsetof(detail::packet, message)),               // X = the offset of the message
+  };
+  program.reserve(program.size() + socket_filter_nb_messages * (nb_instruments + 13) + 4);
+
+  for(std::size_t i = 0; i != socket_filter_nb_messages; ++i)
+  {
+    program.insert(program.end(), {
+      BPF_STMT(BPF_LD | BPF_MEM, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, drop), // none of the messages
+      BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 1),
+      BPF_STMT(BPF_ST, 0),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, at(offsetof(struct message, instrument))),
+    });
+    for(std::uint8_t j = 0; j != nb_instruments; ++j)
+      program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, instruments[j], static_cast<std::uint8_t>(nb_instruments - j), 0));
+    program.insert(program.end(), {
+      BPF_STMT(BPF_JMP | BPF_JA, 1),
+      BPF_STMT(BPF_RET | BPF_K, keep),
+      // X += the size of the message
+      BPF_STMT(BPF_LD | BPF_B | BPF_IND, at(offsetof(struct message, nb_updates))),
+      BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, sizeof(struct update)),
+      BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, message_header_size),
+      BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+      BPF_STMT(BPF_MISC | BPF_TAX, 0),
+    });
+  }
+  program.insert(program.end(), {
+    BPF_STMT(BPF_LD | BPF_MEM, 0),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, drop),
+    BPF_STMT(BPF_RET | BPF_K, keep), // more messages than walked
+  });
+  return program;
+}
+
+} // namespace feed
+
+#  if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+
+#    include <boost/endian/conversion.hpp>
+
+#    include <netinet/in.h>
+#    include <sys/socket.h>
+#    include <unistd.h>
+
+#    include <array>
+#    include <initializer_list>
+
+TEST_SUITE("feed_filter")
+{
+  // the kernel runs the program: a datagram is sent on the loopback to a socket filtered with it, then one that is always kept (an empty packet)
+  struct filtered_socket final
+  {
+    explicit filtered_socket(const std::vector<::sock_filter> &program)
+    {
+      ::sockaddr_in address {.sin_family = AF_INET, .sin_port = 0, .sin_addr = {.s_addr = boost::endian::native_to_big(std::uint32_t {INADDR_LOOPBACK})}};
+      ::socklen_t address_size = sizeof(address);
+      REQUIRE(::bind(receiver, reinterpret_cast<const ::sockaddr *>(&address), sizeof(address)) == 0); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      REQUIRE(::getsockname(receiver, reinterpret_cast<::sockaddr *>(&address), &address_size) == 0); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      REQUIRE(::connect(sender, reinterpret_cast<const ::sockaddr *>(&address), sizeof(address)) == 0); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      if(!program.empty())
+      {
+        const ::sock_fprog fprog {.len = static_cast<unsigned short>(program.size()), .filter = const_cast<::sock_filter *>(program.data())};
+        REQUIRE(::setsockopt(receiver, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == 0);
+      }
+    }
+    ~filtered_socket()
+    {
+      ::close(sender);
+      ::close(receiver);
+    }
+
+    bool kept(const std::vector<std::byte> &packet) const
+    {
+      const std::byte empty_packet {0};
+      CHECK(::send(sender, packet.data(), packet.size(), 0) == static_cast<::ssize_t>(packet.size()));
+      CHECK(::send(sender, &empty_packet, sizeof(empty_packet), 0) == 1);
+      std::array<std::byte, 1'024> buffer;
+      const auto size = ::recv(receiver, buffer.data(), buffer.size(), 0);
+      if(size == static_cast<::ssize_t>(packet.size()))
+        return ::recv(receiver, buffer.data(), buffer.size(), 0) == 1;
+      return false;
+    }
+
+    int sender = ::socket(AF_INET, SOCK_DGRAM, 0), receiver = ::socket(AF_INET, SOCK_DGRAM, 0);
+  };
+
+  // a v1 packet, a message with an update per instrument
+  std::vector<std::byte> make_packet(std::initializer_list<feed::instrument_id_type> instruments)
+  {
+    std::vector<std::byte> packet {std::byte(instruments.size())};
+    for(const auto instrument: instruments)
+    {
+      const feed::message message {.instrument = boost::endian::big_uint16_buf_t(instrument), .sequence_id = boost::endian::big_uint32_buf_t(1), .nb_updates = 1};
+      const auto *bytes = reinterpret_cast<const std::byte *>(&message); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      packet.insert(packet.end(), bytes, bytes + sizeof(message));
+    }
+    return packet;
+  }
+
+  TEST_CASE("socket_filter")
+  {
+    const std::array<feed::instrument_id_type, 3> instruments {42, 7, 1'000};
+    const filtered_socket socket(feed::make_socket_filter(instruments));
+
+    CHECK(socket.kept(make_packet({42})));
+    CHECK(socket.kept(make_packet({1'000})));
+    CHECK(!socket.kept(make_packet({43})));
+    CHECK(socket.kept(make_packet({1, 2, 3, 4, 5, 6, 7, 8})));
+    CHECK(!socket.kept(make_packet({1, 2, 3, 4, 5, 6, 8, 9})));
+    // more messages than walked: kept whatever the instruments
+    CHECK(socket.kept(make_packet({1, 2, 3, 4, 5, 6, 8, 9, 10})));
+    CHECK(socket.kept(make_packet({1, 2, 3, 4, 5, 6, 8, 9, 42})));
+  }
+
+  TEST_CASE("socket_filter_fallback")
+  {
+    std::vector<feed::instrument_id_type> instruments(feed::socket_filter_max_instruments + 1);
+    for(std::size_t i = 0; i != instruments.size(); ++i)
+      instruments[i] = static_cast<feed::instrument_id_type>(i + 1);
+    const auto program = feed::make_socket_filter(instruments);
+    CHECK(program.empty());
+    const filtered_socket socket(program);
+    CHECK(socket.kept(make_packet({1'000})));
+
+    instruments.pop_back();
+    const filtered_socket last_filtered(feed::make_socket_filter(instruments));
+    CHECK(last_filtered.kept(make_packet({200})));
+    CHECK(!last_filtered.kept(make_packet({201})));
+  }
+}
+
+// GCOVR_EXCL_STOP
+#  endif // defined(DOCTEST_LIBRARY_INCLUDED)
+
+#endif // defined(LINUX)
@@ -0,0 +1,720 @@
+#pragma once
+
+#include <feed/binary/feed_binary.hpp>
+#include <feed/binary/feed_capture.hpp>
+
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/likely.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <boost/container/flat_map.hpp>
+#include <boost/endian/conversion.hpp>
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+
+#include <gsl/util>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// pcap and pcapng ingest: the payloads of the updates datagrams and of the snapshot replies are turned into feed::detail::event records,
+// stamped with the capture time in nanoseconds.
+//
+// Supported link layers: ethernet (with 802.1Q/802.1ad tags), linux cooked v1/v2 (tcpdump -i any), raw IPv4, BSD loopback.
+// IPv4 only; fragmented datagrams are skipped (the feed never sends datagrams over the MTU).
+
+namespace feed
+{
+struct pcap_parameters final
+{
+  std::uint16_t updates_port = 4401;
+  std::uint16_t snapshot_port = 4400;
+  bool updates = true;   // UDP datagrams sent to updates_port
+  bool snapshots = true; // TCP replies sent from snapshot_port
+};
+
+struct pcap_statistics final
+{
+  std::uint64_t nb_frames = 0;
+  std::uint64_t nb_updates = 0;   // datagrams
+  std::uint64_t nb_snapshots = 0; // messages
+  std::uint64_t nb_skipped = 0;   // truncated, fragmented or unsupported frames
+  std::uint64_t nb_gaps = 0;      // TCP segments lost by the capture
+};
+
+namespace detail
+{
+namespace pcap
+{
+constexpr std::uint32_t magic_microseconds = 0xa1b2c3d4, magic_nanoseconds = 0xa1b23c4d;
+constexpr std::uint32_t section_header_block = 0x0a0d0d0a, interface_description_block = 1, simple_packet_block = 3, enhanced_packet_block = 6;
+constexpr std::uint32_t byte_order_magic = 0x1a2b3c4d;
+constexpr std::uint16_t if_tsresol = 9;
+
+enum link_type : std::uint32_t
+{
+  null = 0,
+  ethernet = 1,
+  raw = 101,
+  loop = 108,
+  linux_sll = 113,
+  ipv4 = 228,
+  linux_sll2 = 276,
+};
+
+constexpr std::uint16_t ethertype_ipv4 = 0x0800, ethertype_vlan = 0x8100, ethertype_qinq = 0x88a8;
+constexpr std::uint8_t protocol_tcp = 6, protocol_udp = 17;
+constexpr std::uint8_t tcp_syn = 0x02;
+
+// the capture may be written in either byte order
+class reader final
+{
+public:
+  explicit reader(bool swapped) noexcept: swapped(swapped) {}
+
+  template<typename value_type>
+  value_type load(const std::byte *data) const noexcept
+  {
+    value_type value;
+    std::memcpy(&value, data, sizeof(value));
+    return swapped ? boost::endian::endian_reverse(value) : value;
+  }
+
+  bool swapped;
+};
+
+template<typename value_type>
+inline value_type load_big(const std::byte *data) noexcept
+{
+  value_type value;
+  std::memcpy(&value, data, sizeof(value));
+  return boost::endian::big_to_native(value);
+}
+
+// timestamp resolution: 10^-n, or 2^-n if the high bit is set
+inline std::uint64_t to_nanoseconds(std::uint64_t timestamp, std::uint8_t resolution) noexcept
+{
+  if(resolution & 0x80)
+    return static_cast<std::uint64_t>((static_cast<unsigned __int128>(timestamp) * 1'000'000'000) >> (resolution & 0x7f));
+  auto exponent = static_cast<int>(resolution);
+  for(; exponent < 9; ++exponent)
+    timestamp *= 10;
+  for(; exponent > 9; --exponent)
+    timestamp /= 10;
+  return timestamp;
+}
+
+struct tcp_flow final
+{
+  bool synchronized = false;
+  std::uint32_t next_sequence = 0;
+  std::map<std::uint32_t, std::vector<std::byte>> out_of_order {};
+  std::vector<std::byte> pending {};
+};
+
+// one direction of a snapshot connection, keyed by addresses and ports
+using flow_key = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t, std::uint16_t>;
+
+enum struct reply_kind : std::uint8_t
+{
+  snapshot,
+  bulk,
+  version,
+};
+
+struct snapshot_connection final
+{
+  tcp_flow requests {}, replies {};
+  std::deque<reply_kind> expected {}; // one entry per request
+  std::uint32_t bulk_remaining = 0;
+  bool bulk_header_read = false;
+};
+
+} // namespace pcap
+
+template<typename on_event_type>
+class pcap_ingest final
+{
+public:
+  pcap_ingest(const pcap_parameters &parameters, on_event_type &on_event) noexcept: parameters(parameters), on_event(on_event) {}
+
+  boost::leaf::result<pcap_statistics> operator()(const asio::const_buffer &capture) noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto *data = static_cast<const std::byte *>(capture.data());
+    if(capture.size() < sizeof(std::uint32_t)) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"capture too small"});
+
+    std::uint32_t magic;
+    std::memcpy(&magic, data, sizeof(magic));
+    if(magic == pcap::section_header_block)
+      BOOST_LEAF_CHECK(parse_pcapng(capture));
+    else
+      BOOST_LEAF_CHECK(parse_pcap(capture));
+    return statistics;
+  }
+
+private:
+  boost::leaf::result<void> parse_pcap(const asio::const_buffer &capture) noexcept
+  {
+    constexpr std::size_t file_header_size = 24, record_header_size = 16;
+    const auto *current = static_cast<const std::byte *>(capture.data()), *const end = current + capture.size();
+    if(capture.size() < file_header_size) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"truncated pcap header"});
+
+    const auto magic = pcap::reader(false).load<std::uint32_t>(current);
+    const auto swapped_magic = boost::endian::endian_reverse(magic);
+    if(magic != pcap::magic_microseconds && magic != pcap::magic_nanoseconds && swapped_magic != pcap::magic_microseconds
+       && swapped_magic != pcap::magic_nanoseconds) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"not a pcap"});
+    const pcap::reader reader(magic != pcap::magic_microseconds && magic != pcap::magic_nanoseconds);
+    const auto nanoseconds = reader.load<std::uint32_t>(current) == pcap::magic_nanoseconds;
+    const auto link_type = reader.load<std::uint32_t>(current + 20) & 0x0fff'ffff; // the high bits hold the FCS length
+    current += file_header_size;
+
+    while(static_cast<std::size_t>(end - current) >= record_header_size)
+    {
+      const std::uint64_t seconds = reader.load<std::uint32_t>(current), fraction = reader.load<std::uint32_t>(current + 4);
+      const auto captured_length = reader.load<std::uint32_t>(current + 8), length = reader.load<std::uint32_t>(current + 12);
+      current += record_header_size;
+      if(static_cast<std::size_t>(end - current) < captured_length) [[unlikely]]
+        break; // the capture was cut while writing
+
+      frame(seconds * 1'000'000'000 + (nanoseconds ? fraction : fraction * 1'000), link_type, current, captured_length, length);
+      current += captured_length;
+    }
+    return boost::leaf::success();
+  }
+
+  boost::leaf::result<void> parse_pcapng(const asio::const_buffer &capture) noexcept
+  {
+    struct interface_description final
+    {
+      std::uint32_t link_type;
+      std::uint8_t resolution;
+    };
+    std::vector<interface_description> interfaces;
+    pcap::reader reader(false);
+
+    const auto *current = static_cast<const std::byte *>(capture.data()), *const end = current + capture.size();
+    while(static_cast<std::size_t>(end - current) >= 3 * sizeof(std::uint32_t))
+    {
+      if(pcap::reader(false).load<std::uint32_t>(current) == pcap::section_header_block)
+      {
+        const auto byte_order = pcap::reader(false).load<std::uint32_t>(current + 8);
+        if(byte_order != pcap::byte_order_magic && boost::endian::endian_reverse(byte_order) != pcap::byte_order_magic) [[unlikely]]
+          return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"not a pcapng"});
+        reader = pcap::reader(byte_order != pcap::byte_order_magic);
+        interfaces.clear(); // interface ids are scoped to the section
+      }
+
+      const auto type = reader.load<std::uint32_t>(current), total_length = reader.load<std::uint32_t>(current + 4);
+      if(total_length < 3 * sizeof(std::uint32_t) || static_cast<std::size_t>(end - current) < total_length) [[unlikely]]
+        break;
+      const auto *const body = current + 2 * sizeof(std::uint32_t), *const body_end = current + total_length - sizeof(std::uint32_t);
+
+      switch(type)
+      {
+      case pcap::interface_description_block:
+      {
+        interface_description interface {.link_type = reader.load<std::uint16_t>(body), .resolution = 6};
+        for(const auto *option = body + 8; body_end - option >= 4;)
+        {
+          const auto code = reader.load<std::uint16_t>(option), length = reader.load<std::uint16_t>(option + 2);
+          if(!code)
+            break;
+          if(code == pcap::if_tsresol && length == 1)
+            interface.resolution = static_cast<std::uint8_t>(option[4]);
+          option += 4 + (length + 3u) / 4 * 4;
+        }
+        interfaces.push_back(interface);
+        break;
+      }
+      case pcap::enhanced_packet_block:
+      {
+        const auto interface_id = reader.load<std::uint32_t>(body);
+        const std::uint64_t timestamp = std::uint64_t(reader.load<std::uint32_t>(body + 4)) << 32 | reader.load<std::uint32_t>(body + 8);
+        const auto captured_length = reader.load<std::uint32_t>(body + 12), length = reader.load<std::uint32_t>(body + 16);
+        if(interface_id < interfaces.size() && 20 + captured_length <= static_cast<std::size_t>(body_end - body)) [[likely]]
+          frame(pcap::to_nanoseconds(timestamp, interfaces[interface_id].resolution), interfaces[interface_id].link_type, body + 20, captured_length, length);
+        else
+          ++statistics.nb_skipped;
+        break;
+      }
+      case pcap::simple_packet_block:
+        ++statistics.nb_skipped; // no timestamp
+        break;
+      default:
+        break;
+      }
+
+      current += total_length;
+    }
+    return boost::leaf::success();
+  }
+
+  void frame(std::uint64_t timestamp, std::uint32_t link_type, const std::byte *data, std::size_t captured_length, std::size_t length) noexcept
+  {
+    ++statistics.nb_frames;
+    if(captured_length < length) [[unlikely]]
+    {
+      ++statistics.nb_skipped; // snaplen too small
+      return;
+    }
+
+    const auto *const end = data + captured_length;
+    std::uint16_t ethertype = 0;
+    switch(link_type)
+    {
+    case pcap::ethernet:
+      if(captured_length < 14)
+        return skip();
+      ethertype = pcap::load_big<std::uint16_t>(data + 12);
+      data += 14;
+      while((ethertype == pcap::ethertype_vlan || ethertype == pcap::ethertype_qinq) && end - data >= 4)
+      {
+        ethertype = pcap::load_big<std::uint16_t>(data + 2);
+        data += 4;
+      }
+      break;
+    case pcap::linux_sll:
+      if(captured_length < 16)
+        return skip();
+      ethertype = pcap::load_big<std::uint16_t>(data + 14);
+      data += 16;
+      break;
+    case pcap::linux_sll2:
+      if(captured_length < 20)
+        return skip();
+      ethertype = pcap::load_big<std::uint16_t>(data);
+      data += 20;
+      break;
+    case pcap::raw:
+    case pcap::ipv4:
+      ethertype = pcap::ethertype_ipv4;
+      break;
+    case pcap::null:
+    case pcap::loop:
+      if(captured_length < 4)
+        return skip();
+      ethertype = pcap::ethertype_ipv4; // the family is checked through the IP version below
+      data += 4;
+      break;
+    default:
+      return skip();
+    }
+
+    if(ethertype != pcap::ethertype_ipv4 || end - data < 20 || (static_cast<std::uint8_t>(data[0]) >> 4) != 4)
+      return skip();
+    const std::size_t header_length = (static_cast<std::uint8_t>(data[0]) & 0x0f) * 4u, total_length = pcap::load_big<std::uint16_t>(data + 2);
+    const auto fragment = pcap::load_big<std::uint16_t>(data + 6) & 0x3fff; // more fragments or offset
+    if(fragment || header_length < 20 || total_length < header_length || static_cast<std::size_t>(end - data) < total_length)
+      return skip();
+
+    const auto protocol = static_cast<std::uint8_t>(data[9]);
+    const auto source = pcap::load_big<std::uint32_t>(data + 12), destination = pcap::load_big<std::uint32_t>(data + 16);
+    const auto *const segment = data + header_length, *const segment_end = data + total_length; // ignores the ethernet padding
+
+    if(protocol == pcap::protocol_udp && parameters.updates && segment_end - segment >= 8)
+    {
+      if(pcap::load_big<std::uint16_t>(segment + 2) != parameters.updates_port)
+        return;
+      const auto udp_length = pcap::load_big<std::uint16_t>(segment + 4);
+      if(udp_length < 8 || static_cast<std::ptrdiff_t>(udp_length) > segment_end - segment)
+        return skip();
+      ++statistics.nb_updates;
+      on_event(timestamp, asio::const_buffer(segment + 8, udp_length - 8u));
+    }
+    else if(protocol == pcap::protocol_tcp && parameters.snapshots && segment_end - segment >= 20)
+    {
+      const auto source_port = pcap::load_big<std::uint16_t>(segment), destination_port = pcap::load_big<std::uint16_t>(segment + 2);
+      const auto sequence = pcap::load_big<std::uint32_t>(segment + 4);
+      const std::size_t data_offset = (static_cast<std::uint8_t>(segment[12]) >> 4) * 4u;
+      const auto syn = (static_cast<std::uint8_t>(segment[13]) & pcap::tcp_syn) != 0;
+      if(data_offset < 20 || static_cast<std::ptrdiff_t>(data_offset) > segment_end - segment)
+        return skip();
+      const auto payload = asio::const_buffer(segment + data_offset, static_cast<std::size_t>(segment_end - segment) - data_offset);
+
+      if(source_port == parameters.snapshot_port)
+      {
+        auto &connection = connections[{destination, source, destination_port, source_port}];
+        if(reassemble(connection.replies, sequence, syn, payload))
+          replies(timestamp, connection);
+      }
+      else if(destination_port == parameters.snapshot_port)
+      {
+        auto &connection = connections[{source, destination, source_port, destination_port}];
+        if(reassemble(connection.requests, sequence, syn, payload))
+          requests(connection);
+      }
+    }
+  }
+
+  void skip() noexcept { ++statistics.nb_skipped; }
+
+  // appends the in-order bytes to flow.pending, returns true if some were
+  bool reassemble(pcap::tcp_flow &flow, std::uint32_t sequence, bool syn, const asio::const_buffer &payload) noexcept
+  {
+    if(syn)
+    {
+      flow = {.synchronized = true, .next_sequence = sequence + 1};
+      return false;
+    }
+    if(!flow.synchronized)
+      flow = {.synchronized = true, .next_sequence = sequence}; // the capture started mid-connection
+
+    const auto *const first = static_cast<const std::byte *>(payload.data());
+    const auto size = payload.size();
+    const auto offset = static_cast<std::int32_t>(flow.next_sequence - sequence);
+    if(offset < 0)
+    {
+      flow.out_of_order.try_emplace(sequence, first, first + size);
+      if(flow.out_of_order.size() <= max_out_of_order)
+        return false;
+
+      // a hole that never fills up: the capture dropped a segment, resume at the next one
+      ++statistics.nb_gaps;
+      flow.pending.clear();
+      flow.next_sequence = flow.out_of_order.begin()->first;
+    }
+    else if(static_cast<std::size_t>(offset) < size)
+    {
+      flow.pending.insert(flow.pending.end(), first + offset, first + size);
+      flow.next_sequence += static_cast<std::uint32_t>(size - static_cast<std::size_t>(offset));
+    }
+    else
+      return false; // retransmission or pure ack
+
+    // drain whatever was waiting for this segment
+    for(auto it = flow.out_of_order.begin(); it != flow.out_of_order.end(); it = flow.out_of_order.erase(it))
+    {
+      const auto overlap = static_cast<std::int32_t>(flow.next_sequence - it->first);
+      if(overlap < 0)
+        break;
+      if(static_cast<std::size_t>(overlap) < it->second.size())
+      {
+        flow.pending.insert(flow.pending.end(), it->second.begin() + overlap, it->second.end());
+        flow.next_sequence += static_cast<std::uint32_t>(it->second.size() - static_cast<std::size_t>(overlap));
+      }
+    }
+    return true;
+  }
+
+  // the requests tell the replies apart: a single message per snapshot_request, a header and messages per bulk_snapshot_request, a version_reply
+  // per version_request
+  void requests(pcap::snapshot_connection &connection) noexcept
+  {
+    auto &pending = connection.requests.pending;
+    std::size_t consumed = 0;
+    while(pending.size() - consumed >= sizeof(snapshot_request))
+    {
+      const auto instrument = pcap::load_big<std::uint16_t>(pending.data() + consumed);
+      if(instrument != bulk_snapshot_instrument)
+      {
+        connection.expected.push_back(pcap::reply_kind::snapshot);
+        consumed += sizeof(snapshot_request);
+        continue;
+      }
+      if(pending.size() - consumed < sizeof(bulk_snapshot_request))
+        break;
+      const auto nb_instruments = pcap::load_big<std::uint16_t>(pending.data() + consumed + sizeof(snapshot_request));
+      const auto version = nb_instruments == version_request_marker;
+      const auto request_size = version ? sizeof(version_request) : sizeof(bulk_snapshot_request) + nb_instruments * sizeof(snapshot_request);
+      if(pending.size() - consumed < request_size)
+        break;
+      connection.expected.push_back(version ? pcap::reply_kind::version : pcap::reply_kind::bulk);
+      consumed += request_size;
+    }
+    pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(consumed));
+  }
+
+  // complete messages are packed in packets of at most 255 messages, stamped with the segment that completed them
+  void replies(std::uint64_t timestamp, pcap::snapshot_connection &connection) noexcept
+  {
+    auto &pending = connection.replies.pending;
+    std::size_t consumed = 0;
+
+    packet_storage.assign(packet_header_size, std::byte {0});
+    std::uint8_t nb_messages = 0;
+    const auto flush = [&]()
+    {
+      if(!nb_messages)
+        return;
+      packet_storage[0] = std::byte {nb_messages};
+      statistics.nb_snapshots += nb_messages;
+      on_event(timestamp, asio::const_buffer(packet_storage.data(), packet_storage.size()));
+      packet_storage.resize(packet_header_size);
+      nb_messages = 0;
+    };
+
+    // without the requests (capture started mid-connection, or one direction only), the replies are taken as single snapshots
+    for(;;)
+    {
+      if(!connection.expected.empty() && connection.expected.front() == pcap::reply_kind::version)
+      {
+        if(pending.size() - consumed < sizeof(version_reply))
+          break;
+        consumed += sizeof(version_reply);
+        connection.expected.pop_front();
+        continue;
+      }
+
+      if(!connection.bulk_remaining && !connection.expected.empty() && connection.expected.front() == pcap::reply_kind::bulk && !connection.bulk_header_read)
+      {
+        if(pending.size() - consumed < sizeof(bulk_snapshot_reply))
+          break;
+        connection.bulk_remaining = pcap::load_big<std::uint32_t>(pending.data() + consumed);
+        connection.bulk_header_read = true;
+        consumed += sizeof(bulk_snapshot_reply);
+        if(!connection.bulk_remaining)
+        {
+          connection.expected.pop_front();
+          connection.bulk_header_read = false;
+          continue;
+        }
+      }
+
+      constexpr auto message_header_size = offsetof(message, updates);
+      if(pending.size() - consumed < message_header_size)
+        break;
+      const auto nb_updates = static_cast<std::uint8_t>(pending[consumed + offsetof(message, nb_updates)]);
+      const auto message_size = message_header_size + nb_updates * sizeof(update);
+      if(pending.size() - consumed < message_size)
+        break;
+
+      const auto *const first = pending.data() + consumed;
+      packet_storage.insert(packet_storage.end(), first, first + message_size);
+      consumed += message_size;
+      if(++nb_messages == std::numeric_limits<std::uint8_t>::max())
+        flush();
+
+      if(connection.bulk_remaining)
+      {
+        if(!--connection.bulk_remaining)
+        {
+          connection.expected.pop_front();
+          connection.bulk_header_read = false;
+        }
+      }
+      else if(!connection.expected.empty())
+        connection.expected.pop_front();
+    }
+    flush();
+
+    pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(consumed));
+  }
+
+  static constexpr std::size_t packet_header_size = offsetof(packet, message);
+  static constexpr std::size_t max_out_of_order = 64;
+
+  pcap_parameters parameters;
+  on_event_type &on_event;
+  pcap_statistics statistics {};
+  std::map<pcap::flow_key, pcap::snapshot_connection> connections {};
+  std::vector<std::byte> packet_storage {};
+};
+
+// buffered append of events to a file descriptor
+class event_file_writer final
+{
+public:
+  explicit event_file_writer(int fd) noexcept: fd(fd) { buffer.reserve(flush_threshold + sizeof(event) + datagram_max_size); }
+
+  boost::leaf::result<void> write(std::uint64_t timestamp, const asio::const_buffer &packet) noexcept
+  {
+    const auto *const stamp = reinterpret_cast<const std::byte *>(&timestamp); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    buffer.insert(buffer.end(), stamp, stamp + sizeof(timestamp));
+    buffer.insert(buffer.end(), static_cast<const std::byte *>(packet.data()), static_cast<const std::byte *>(packet.data()) + packet.size());
+    if(buffer.size() >= flush_threshold)
+      return flush();
+    return boost::leaf::success();
+  }
+
+  boost::leaf::result<void> flush() noexcept
+  {
+    BOOST_LEAF_CHECK(pwrite_all(fd, buffer, offset));
+    offset += buffer.size();
+    buffer.clear();
+    return boost::leaf::success();
+  }
+
+private:
+  static constexpr std::size_t flush_threshold = 4 * 1'024 * 1'024;
+  static constexpr std::size_t datagram_max_size = 65'536;
+
+  int fd;
+  std::uint64_t offset = 0;
+  std::vector<std::byte> buffer {};
+};
+
+} // namespace detail
+
+// calls on_event(timestamp, packet) for each updates datagram and each group of snapshot messages, in capture order
+inline boost::leaf::result<pcap_statistics> read_pcap(const asio::const_buffer &capture, const pcap_parameters &parameters, auto on_event) noexcept
+{
+  return detail::pcap_ingest(parameters, on_event)(capture);
+}
+
+inline boost::leaf::result<pcap_statistics> read_pcap(const char *path, const pcap_parameters &parameters, auto on_event) noexcept
+{
+  BOOST_LEAF_AUTO(file, detail::mapped_file::open(path));
+  file.advise(0, file.size(), MADV_SEQUENTIAL);
+  file.advise(0, file.size(), MADV_WILLNEED);
+  return read_pcap(file.buffer(), parameters, std::move(on_event));
+}
+
+// pcap to the raw event stream, as consumed by feed::replay
+inline boost::leaf::result<pcap_statistics> pcap_to_events(const char *pcap_path, const char *events_path, const pcap_parameters &parameters) noexcept
+{
+  const auto fd = ::open(events_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd < 0) [[unlikely]]
+    return detail::errno_error("open");
+  const auto _ = gsl::finally([&]() { ::close(fd); });
+
+  detail::event_file_writer writer(fd);
+  boost::leaf::result<void> status;
+  BOOST_LEAF_AUTO(statistics, read_pcap(pcap_path, parameters,
+                                        [&](std::uint64_t timestamp, const asio::const_buffer &packet) noexcept
+                                        {
+                                          if(status) [[likely]]
+                                            status = writer.write(timestamp, packet);
+                                        }));
+  BOOST_LEAF_CHECK(status);
+  BOOST_LEAF_CHECK(writer.flush());
+  return statistics;
+}
+
+// pcap to the indexed capture format
+inline boost::leaf::result<pcap_statistics> pcap_to_capture(const char *pcap_path, const char *capture_path, const pcap_parameters &parameters,
+                                                              std::size_t block_size = default_capture_block_size) noexcept
+{
+  BOOST_LEAF_AUTO(writer, capture_writer::create(capture_path, block_size));
+  boost::leaf::result<void> status;
+  BOOST_LEAF_AUTO(statistics, read_pcap(pcap_path, parameters,
+                                        [&](std::uint64_t timestamp, const asio::const_buffer &packet) noexcept
+                                        {
+                                          if(status) [[likely]]
+                                            status = writer.write(timestamp, packet);
+                                        }));
+  BOOST_LEAF_CHECK(status);
+  BOOST_LEAF_CHECK(writer.close());
+  return statistics;
+}
+
+} // namespace feed
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+
+TEST_SUITE("feed_pcap")
+{
+  TEST_CASE("pcap_raw_ipv4")
+  {
+    std::vector<std::byte> capture;
+    const auto append = [&]<typename value_type>(value_type value) noexcept
+    {
+      const auto *bytes = reinterpret_cast<const std::byte *>(&value); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      capture.insert(capture.end(), bytes, bytes + sizeof(value));
+    };
+    const auto append_big = [&]<typename value_type>(value_type value) noexcept { append(boost::endian::native_to_big(value)); };
+
+    // nanosecond pcap, raw IPv4
+    append(feed::detail::pcap::magic_nanoseconds);
+    append(std::uint16_t {2});
+    append(std::uint16_t {4});
+    append(std::uint64_t {0});
+    append(std::uint32_t {65'535});
+    append(std::uint32_t {feed::detail::pcap::raw});
+
+    feed::detail::packet packet {.nb_messages = 1};
+    packet.message.instrument = 42;
+    packet.message.nb_updates = 1;
+
+    const auto append_frame = [&](std::uint32_t nanoseconds, std::uint8_t protocol, std::uint16_t source_port, std::uint16_t destination_port,
+                                  std::uint32_t sequence, const void *payload, std::size_t payload_size, bool to_server = false)
+    {
+      const std::size_t transport_size = protocol == feed::detail::pcap::protocol_udp ? 8 : 20, size = 20 + transport_size + payload_size;
+      append(std::uint32_t {1});
+      append(nanoseconds);
+      append(static_cast<std::uint32_t>(size));
+      append(static_cast<std::uint32_t>(size));
+
+      append(std::uint8_t {0x45});
+      append(std::uint8_t {0});
+      append_big(static_cast<std::uint16_t>(size));
+      append(std::uint32_t {0});
+      append(std::uint8_t {64});
+      append(protocol);
+      append(std::uint16_t {0});
+      append_big(to_server ? std::uint32_t {0xe000'0001} : std::uint32_t {0x7f00'0001});
+      append_big(to_server ? std::uint32_t {0x7f00'0001} : std::uint32_t {0xe000'0001});
+
+      append_big(source_port);
+      append_big(destination_port);
+      if(protocol == feed::detail::pcap::protocol_udp)
+      {
+        append_big(static_cast<std::uint16_t>(8 + payload_size));
+        append(std::uint16_t {0});
+      }
+      else
+      {
+        append_big(sequence);
+        append(std::uint32_t {0});
+        append(std::uint8_t {0x50});
+        append(std::uint8_t {0x18});
+        append(std::uint16_t {0});
+        append(std::uint32_t {0});
+      }
+      const auto *bytes = static_cast<const std::byte *>(payload);
+      capture.insert(capture.end(), bytes, bytes + payload_size);
+    };
+
+    append_frame(10, feed::detail::pcap::protocol_udp, 1'234, 4'401, 0, &packet, sizeof(packet));
+    append_frame(20, feed::detail::pcap::protocol_udp, 1'234, 9'999, 0, &packet, sizeof(packet)); // filtered out
+    // a snapshot reply split across two segments, the first one retransmitted
+    const auto *message = reinterpret_cast<const std::byte *>(&packet.message); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    append_frame(30, feed::detail::pcap::protocol_tcp, 4'400, 5'678, 1'000, message, 5);
+    append_frame(35, feed::detail::pcap::protocol_tcp, 4'400, 5'678, 1'000, message, 5);
+    append_frame(40, feed::detail::pcap::protocol_tcp, 4'400, 5'678, 1'005, message + 5, sizeof(packet.message) - 5);
+
+    // a version exchange, then a bulk snapshot of one instrument, on another connection
+    std::vector<std::byte> requests(sizeof(feed::detail::version_request) + sizeof(feed::detail::bulk_snapshot_request) + sizeof(feed::detail::snapshot_request));
+    new(requests.data()) feed::detail::version_request {};
+    new(requests.data() + sizeof(feed::detail::version_request)) feed::detail::bulk_snapshot_request {.nb_instruments = boost::endian::big_uint16_buf_t(1)};
+    new(requests.data() + sizeof(feed::detail::version_request) + sizeof(feed::detail::bulk_snapshot_request))
+      feed::detail::snapshot_request {.instrument = boost::endian::big_uint16_buf_t(42)};
+    std::vector<std::byte> replies(sizeof(feed::detail::version_reply) + sizeof(feed::detail::bulk_snapshot_reply));
+    new(replies.data()) feed::detail::version_reply {.version = std::to_underlying(feed::wire_version::v2)};
+    new(replies.data() + sizeof(feed::detail::version_reply)) feed::detail::bulk_snapshot_reply {.nb_messages = boost::endian::big_uint32_buf_t(1)};
+    replies.insert(replies.end(), message, message + sizeof(packet.message));
+    append_frame(50, feed::detail::pcap::protocol_tcp, 5'679, 4'400, 2'000, requests.data(), requests.size(), true);
+    append_frame(60, feed::detail::pcap::protocol_tcp, 4'400, 5'679, 3'000, replies.data(), replies.size());
+
+    std::vector<std::pair<std::uint64_t, std::size_t>> events;
+    const auto statistics = feed::read_pcap(asio::const_buffer(capture.data(), capture.size()), {},
+                                            [&](std::uint64_t timestamp, const asio::const_buffer &packet) noexcept
+                                            { events.emplace_back(timestamp, packet.size()); });
+    REQUIRE(statistics);
+    CHECK(statistics->nb_frames == 7);
+    CHECK(statistics->nb_updates == 1);
+    CHECK(statistics->nb_snapshots == 2);
+    REQUIRE(events.size() == 3);
+    CHECK(events[0] == std::pair<std::uint64_t, std::size_t> {1'000'000'010, sizeof(packet)});
+    CHECK(events[1] == std::pair<std::uint64_t, std::size_t> {1'000'000'040, sizeof(packet)});
+    CHECK(events[2] == std::pair<std::uint64_t, std::size_t> {1'000'000'060, sizeof(packet)});
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <feed/binary/feed_binary.hpp>
+#include <feed/binary/feed_capture.hpp>
+
+#include <boilerplate/chrono.hpp>
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/likely.hpp>
+#include <boilerplate/spsc_ring_buffer.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <gsl/util>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// Records the datagrams as received, with their RX timestamps, as the raw event stream (see feed::replay): the receiving thread only copies
+// them into a ring, a background thread drains the ring into preallocated files of file_size bytes, <path>.0, <path>.1...
+
+namespace feed
+{
+struct recorder_parameters final
+{
+  std::string path;
+  std::size_t file_size = 1'024 * 1'024 * 1'024;
+  spsc_ring_buffer::size_t ring_size = 64 * 1'024 * 1'024;
+  bool direct_io = true;
+};
+
+class recorder : boost::noncopyable
+{
+  struct record_header
+  {
+    std::uint32_t size; // of the datagram
+    std::uint64_t timestamp;
+  } __attribute__((packed));
+
+  static constexpr std::size_t datagram_max_size = 65'536;
+  static constexpr std::size_t block_size = 4'096; // O_DIRECT alignment
+  static constexpr std::size_t staging_size = 1'024 * 1'024;
+
+public:
+  static boost::leaf::result<std::unique_ptr<recorder>> create(recorder_parameters parameters) noexcept
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    std::unique_ptr<recorder> result(new(std::nothrow) recorder(std::move(parameters)));
+    if(!result || !result->staging) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::not_enough_memory), ::boilerplate::statement {"recorder"});
+    BOOST_LEAF_CHECK(result->open_file());
+    result->thread = std::thread([recorder_ptr = result.get()]() noexcept { recorder_ptr->drain(); });
+    return result;
+  }
+
+  ~recorder() noexcept
+  {
+    queue.producer_flush();
+    leave.store(true, std::memory_order_release);
+    if(thread.joinable())
+      thread.join();
+    else if(fd >= 0)
+      ::close(fd);
+    std::free(staging); // NOLINT(cppcoreguidelines-no-malloc,cppcoreguidelines-owning-memory)
+  }
+
+  // fast path: a copy into the ring, or a drop if the writer lags behind
+  [[using gnu: always_inline, hot]] inline void operator()(const network_clock::time_point &timestamp, const asio::const_buffer &datagram) noexcept
+  {
+    const auto size = sizeof(record_header) + datagram.size();
+    auto *const address = queue.producer_allocate(static_cast<spsc_ring_buffer::size_t>(size));
+    if(!address) [[unlikely]]
+    {
+      ++nb_dropped_;
+      return;
+    }
+    const record_header header {.size = static_cast<std::uint32_t>(datagram.size()),
+                                .timestamp = static_cast<std::uint64_t>(std::chrono::nanoseconds(timestamp.time_since_epoch()).count())};
+    std::memcpy(address, &header, sizeof(header));
+    std::memcpy(address + sizeof(header), datagram.data(), datagram.size());
+    queue.producer_commit(static_cast<spsc_ring_buffer::size_t>(size));
+  }
+
+  // out of the fast path, along with the logger
+  void flush() noexcept { queue.producer_flush(); }
+
+  std::uint64_t nb_dropped() const noexcept { return nb_dropped_; }
+  std::uint64_t nb_written() const noexcept { return nb_written_.load(std::memory_order_relaxed); }
+  std::uint64_t nb_write_errors() const noexcept { return nb_write_errors_.load(std::memory_order_relaxed); }
+
+private:
+  explicit recorder(recorder_parameters &&parameters) noexcept:
+    parameters(std::move(parameters)), queue(this->parameters.ring_size, sizeof(record_header) + datagram_max_size + 1),
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    staging(static_cast<std::byte *>(
+      std::aligned_alloc(block_size, detail::align_up(staging_size + block_size + sizeof(record_header) + datagram_max_size, block_size))))
+  {
+  }
+
+  void drain() noexcept
+  {
+    using namespace std::chrono_literals;
+
+    for(;;)
+    {
+      const auto leaving = leave.load(std::memory_order_acquire);
+      std::size_t nb_records = 0;
+      while(const auto *header_address = queue.consumer_peek(sizeof(record_header)))
+      {
+        record_header header;
+        std::memcpy(&header, header_address, sizeof(header));
+        const auto *const record = queue.consumer_peek(static_cast<spsc_ring_buffer::size_t>(sizeof(header) + header.size));
+        if(!record)
+          break;
+        append(header.timestamp, record + sizeof(header), header.size);
+        queue.consumer_commit(static_cast<spsc_ring_buffer::size_t>(sizeof(header) + header.size));
+        ++nb_records;
+      }
+      queue.consumer_flush();
+
+      if(leaving)
+        break;
+      if(!nb_records)
+        std::this_thread::sleep_for(100us);
+    }
+
+    close_file();
+  }
+
+  void append(std::uint64_t timestamp, const std::byte *packet, std::size_t size) noexcept
+  {
+    const auto event_size = sizeof(timestamp) + size;
+    // an event larger than a file goes alone in a fresh one
+    if(file_offset + staging_used && file_offset + staging_used + event_size > parameters.file_size)
+    {
+      close_file();
+      ++file_index;
+      if(!open_file()) [[unlikely]]
+        nb_write_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::memcpy(staging + staging_used, &timestamp, sizeof(timestamp));
+    std::memcpy(staging + staging_used + sizeof(timestamp), packet, size);
+    staging_used += event_size;
+    nb_written_.fetch_add(1, std::memory_order_relaxed);
+
+    if(staging_used >= staging_size)
+      write_blocks(false);
+  }
+
+  // writes the whole blocks of the staging area, or everything (padded) if last
+  void write_blocks(bool last) noexcept
+  {
+    const auto size = last ? detail::align_up(staging_used, block_size) : staging_used / block_size * block_size;
+    if(!size)
+      return;
+    std::memset(staging + staging_used, 0, size > staging_used ? size - staging_used : 0);
+    if(fd < 0 || !detail::pwrite_all(fd, staging, size, file_offset)) [[unlikely]]
+      nb_write_errors_.fetch_add(1, std::memory_order_relaxed);
+
+    const auto written = std::min(size, staging_used);
+    file_offset += written;
+    staging_used -= written;
+    std::memmove(staging, staging + written, staging_used);
+  }
+
+  boost::leaf::result<void> open_file() noexcept
+  {
+    const auto path = parameters.path + "." + std::to_string(file_index);
+    const auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    fd = parameters.direct_io ? ::open(path.c_str(), flags | O_DIRECT, 0644) : -1;
+    if(fd < 0) // O_DIRECT is not supported everywhere (tmpfs)
+      fd = ::open(path.c_str(), flags, 0644);
+    if(fd < 0) [[unlikely]]
+      return detail::errno_error("open");
+    file_offset = 0;
+    // preallocated, so that the writes do not allocate extents
+    if(const auto rc = ::posix_fallocate(fd, 0, static_cast<off_t>(parameters.file_size)); rc) [[unlikely]]
+    {
+      errno = rc;
+      return detail::errno_error("posix_fallocate");
+    }
+    return boost::leaf::success();
+  }
+
+  void close_file() noexcept
+  {
+    const auto size = file_offset + staging_used;
+    write_blocks(true);
+    if(fd < 0)
+      return;
+    // drop the padding and the preallocated tail
+    if(::ftruncate(fd, static_cast<off_t>(size)) < 0) [[unlikely]]
+      nb_write_errors_.fetch_add(1, std::memory_order_relaxed);
+    ::close(std::exchange(fd, -1));
+  }
+
+  recorder_parameters parameters;
+  spsc_ring_buffer queue;
+
+  // producer side
+  std::uint64_t nb_dropped_ = 0;
+
+  // consumer side
+  std::byte *staging = nullptr;
+  std::size_t staging_used = 0;
+  int fd = -1;
+  std::size_t file_index = 0;
+  std::uint64_t file_offset = 0;
+  std::atomic_uint64_t nb_written_ = 0;
+  std::atomic_uint64_t nb_write_errors_ = 0;
+
+  std::atomic_bool leave {};
+  static_assert(decltype(leave)::is_always_lock_free);
+  std::thread thread {};
+};
+
+} // namespace feed
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+#include <array>
+#include <cstdlib>
+#include <vector>
+
+TEST_SUITE("feed_recorder")
+{
+  TEST_CASE("recorder_rotation")
+  {
+    char directory[] = "/tmp/feed_recorder_XXXXXX";
+    REQUIRE(::mkdtemp(directory));
+    const auto path = std::string(directory) + "/capture";
+    std::vector<std::string> paths;
+    const auto _ = gsl::finally([&]() {
+      for(const auto &file_path: paths)
+        ::unlink(file_path.c_str());
+      ::rmdir(directory);
+    });
+
+    // about 190 events per file
+    constexpr std::size_t file_size = 4'096;
+    constexpr std::uint32_t nb_events = 1'000;
+    {
+      auto recorder = feed::recorder::create({.path = path, .file_size = file_size, .ring_size = 1'024 * 1'024});
+      REQUIRE(recorder);
+      for(std::uint32_t i = 0; i != nb_events; ++i)
+      {
+        feed::detail::packet packet {.nb_messages = 1};
+        packet.message.sequence_id = i;
+        packet.message.nb_updates = 1;
+        (**recorder)(network_clock::time_point(std::chrono::nanoseconds(i + 1)), asio::const_buffer(&packet, sizeof(packet)));
+      }
+      CHECK((*recorder)->nb_dropped() == 0);
+    } // drained, the last file closed
+
+    std::uint32_t nb_read = 0;
+    for(std::size_t index = 0;; ++index)
+    {
+      const auto file_path = path + "." + std::to_string(index);
+      const auto fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+      if(fd < 0)
+        break;
+      paths.push_back(file_path);
+      std::vector<std::byte> content(file_size + 1);
+      const auto size = ::read(fd, content.data(), content.size());
+      ::close(fd);
+      CHECK(size > 0);
+      CHECK(size <= static_cast<::ssize_t>(file_size));
+      CHECK(size % sizeof(feed::detail::event) == 0);
+
+      for(::ssize_t offset = 0; offset + static_cast<::ssize_t>(sizeof(feed::detail::event)) <= size; offset += sizeof(feed::detail::event))
+      {
+        feed::detail::event event;
+        std::memcpy(&event, content.data() + offset, sizeof(event));
+        CHECK(event.timestamp == nb_read + 1);
+        CHECK(event.packet.message.sequence_id.value() == nb_read);
+        ++nb_read;
+      }
+    }
+    CHECK(paths.size() > 1);
+    CHECK(nb_read == nb_events);
+  }
+
+  TEST_CASE("recorder_oversized_events")
+  {
+    char directory[] = "/tmp/feed_recorder_XXXXXX";
+    REQUIRE(::mkdtemp(directory));
+    const auto path = std::string(directory) + "/capture";
+    std::vector<std::string> paths;
+    const auto _ = gsl::finally([&]() {
+      for(const auto &file_path: paths)
+        ::unlink(file_path.c_str());
+      ::rmdir(directory);
+    });
+
+    // smaller than an event: one event per file, none empty
+    constexpr std::size_t file_size = 16;
+    constexpr std::uint32_t nb_events = 5;
+    {
+      auto recorder = feed::recorder::create({.path = path, .file_size = file_size, .ring_size = 1'024 * 1'024});
+      REQUIRE(recorder);
+      for(std::uint32_t i = 0; i != nb_events; ++i)
+      {
+        feed::detail::packet packet {.nb_messages = 1};
+        packet.message.sequence_id = i;
+        (**recorder)(network_clock::time_point(std::chrono::nanoseconds(i + 1)), asio::const_buffer(&packet, sizeof(packet)));
+      }
+    }
+
+    for(std::size_t index = 0;; ++index)
+    {
+      const auto file_path = path + "." + std::to_string(index);
+      const auto fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+      if(fd < 0)
+        break;
+      paths.push_back(file_path);
+      std::array<std::byte, sizeof(feed::detail::event) + 1> content;
+      const auto size = ::read(fd, content.data(), content.size());
+      ::close(fd);
+      REQUIRE(size == static_cast<::ssize_t>(sizeof(feed::detail::event)));
+      feed::detail::event event;
+      std::memcpy(&event, content.data(), sizeof(event));
+      CHECK(event.packet.message.sequence_id.value() == index);
+    }
+    CHECK(paths.size() == nb_events);
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <feed/binary/feed_binary.hpp>
+
+#include <boilerplate/chrono.hpp>
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/likely.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <emmintrin.h>
+#include <optional>
+#include <poll.h>
+#include <span>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace feed
+{
+enum struct replay_mode : std::uint8_t
+{
+  real_time,
+  scaled,
+  as_fast_as_possible,
+  burst_preserving, // gaps within a burst are kept, idle gaps between bursts are compressed
+};
+
+struct replay_parameters
+{
+  replay_mode mode = replay_mode::real_time;
+  double rate = 1.; // scaled mode only, from x0.1 to x100
+  std::chrono::nanoseconds burst_gap = std::chrono::microseconds(100);
+  std::chrono::nanoseconds compressed_idle_gap = std::chrono::microseconds(10);
+  std::chrono::nanoseconds idle_threshold = std::chrono::microseconds(50); // waits longer than that call the idle hook instead of spinning
+  std::size_t batch_size = 32;
+};
+
+struct replay_statistics
+{
+  std::size_t nb_packets = 0;
+  std::size_t nb_batches = 0;
+  // pacing error: how late packets left compared to their schedule
+  std::chrono::nanoseconds max_lateness {};
+  std::chrono::nanoseconds total_lateness {};
+
+  std::chrono::nanoseconds mean_lateness() const noexcept { return nb_packets ? total_lateness / static_cast<std::int64_t>(nb_packets) : std::chrono::nanoseconds {}; }
+};
+
+namespace detail
+{
+constexpr double min_replay_rate = 0.1, max_replay_rate = 100.;
+
+// maps capture timestamps to send offsets from the start of the replay
+class replay_schedule
+{
+public:
+  explicit replay_schedule(const replay_parameters &parameters) noexcept:
+    mode(parameters.mode), rate(std::clamp(parameters.rate, min_replay_rate, max_replay_rate)), burst_gap(parameters.burst_gap),
+    compressed_idle_gap(parameters.compressed_idle_gap)
+  {
+  }
+
+  std::chrono::nanoseconds operator()(std::uint64_t timestamp) noexcept
+  {
+    if(!first_timestamp) [[unlikely]]
+      first_timestamp = previous_timestamp = timestamp;
+    // captures are not always monotonic
+    const auto gap = std::chrono::nanoseconds(timestamp > previous_timestamp ? timestamp - previous_timestamp : 0);
+    previous_timestamp = std::max(previous_timestamp, timestamp);
+
+    switch(mode)
+    {
+    case replay_mode::real_time: offset += gap; break;
+    case replay_mode::scaled: offset += std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(static_cast<double>(gap.count()) / rate)); break;
+    case replay_mode::as_fast_as_possible: break;
+    case replay_mode::burst_preserving: offset += gap <= burst_gap ? gap : compressed_idle_gap; break;
+    }
+    return offset;
+  }
+
+private:
+  const replay_mode mode;
+  const double rate;
+  const std::chrono::nanoseconds burst_gap, compressed_idle_gap;
+
+  std::optional<std::uint64_t> first_timestamp {};
+  std::uint64_t previous_timestamp = 0;
+  std::chrono::nanoseconds offset {};
+};
+} // namespace detail
+
+// Sends the packets of a buffer of ``detail::event`` as they were captured, byte for byte, through ``send_batch`` (given the packets due, as
+// iovecs). Pacing is a busy-wait on the TSC; packets already due are batched. ``on_packet`` is called with every packet sent, ``idle`` during long
+// waits.
+inline boost::leaf::result<replay_statistics> replay_with(auto &&send_batch, const asio::const_buffer &events, const replay_parameters &parameters,
+                                                          auto &&on_packet, auto &&idle) noexcept
+{
+  struct pending
+  {
+    const detail::event *event;
+    std::size_t size;
+    std::uint64_t target;
+  };
+
+  const auto batch_size = std::max(parameters.batch_size, std::size_t(1));
+  std::vector<iovec> iovecs(batch_size);
+  std::vector<std::uint64_t> targets(batch_size);
+
+  replay_statistics statistics;
+  detail::replay_schedule schedule(parameters);
+  const auto tsc = tsc_clock::calibrate();
+  const auto idle_threshold = tsc.to_ticks(parameters.idle_threshold);
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const auto *current = reinterpret_cast<const std::byte *>(events.data()), *const end = current + events.size();
+  const auto start = tsc_clock::ticks();
+  const auto fetch = [&]() noexcept -> std::optional<pending>
+  {
+    if(static_cast<std::size_t>(end - current) < sizeof(detail::event))
+      return std::nullopt;
+    const auto *event = reinterpret_cast<const detail::event *>(current); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto size = detail::packet_size(asio::const_buffer(&event->packet, static_cast<std::size_t>(end - current) - offsetof(detail::event, packet)));
+    current += offsetof(detail::event, packet) + size;
+    return pending {event, size, start + tsc.to_ticks(schedule(event->timestamp))};
+  };
+
+  for(auto next = fetch(); next;)
+  {
+    for(auto now = tsc_clock::ticks(); now < next->target; now = tsc_clock::ticks())
+    {
+      if(next->target - now > idle_threshold)
+        idle();
+      else
+        _mm_pause();
+    }
+
+    std::size_t nb_packets = 0;
+    do
+    {
+      iovecs[nb_packets] = iovec {.iov_base = const_cast<detail::packet *>(&next->event->packet), .iov_len = next->size};
+      targets[nb_packets++] = next->target;
+      next = fetch();
+    } while(next && nb_packets < batch_size && next->target <= tsc_clock::ticks());
+
+    BOOST_LEAF_CHECK(send_batch(std::span<const iovec>(iovecs.data(), nb_packets)));
+
+    const auto sent = tsc_clock::ticks();
+    ++statistics.nb_batches;
+    for(std::size_t i = 0; i < nb_packets; ++i)
+    {
+      const auto lateness = tsc.to_duration(static_cast<std::int64_t>(sent - targets[i]));
+      statistics.max_lateness = std::max(statistics.max_lateness, lateness);
+      statistics.total_lateness += lateness;
+      on_packet(asio::const_buffer(iovecs[i].iov_base, iovecs[i].iov_len));
+    }
+    statistics.nb_packets += nb_packets;
+  }
+
+  return statistics;
+}
+
+// on a connected datagram socket, a batch in a single sendmmsg. A full socket buffer is waited on: idle, then a short poll for POLLOUT, until there
+// is room
+inline boost::leaf::result<replay_statistics> replay(int fd, const asio::const_buffer &events, const replay_parameters &parameters, auto &&on_packet,
+                                                     auto &&idle) noexcept
+{
+  std::vector<mmsghdr> msgvec(std::max(parameters.batch_size, std::size_t(1)));
+  return replay_with(
+    [&](std::span<const iovec> batch) noexcept -> boost::leaf::result<void>
+    {
+      for(std::size_t i = 0; i < batch.size(); ++i)
+        msgvec[i] = mmsghdr {.msg_hdr = {.msg_iov = const_cast<iovec *>(&batch[i]), .msg_iovlen = 1}, .msg_len = 0};
+      for(auto [first, last] = std::tuple {msgvec.data(), msgvec.data() + batch.size()}; first != last;)
+      {
+        const auto nb_sent = ::sendmmsg(fd, first, static_cast<unsigned int>(last - first), 0);
+        if(nb_sent < 0) [[unlikely]]
+        {
+          if(errno == EINTR)
+            continue;
+          if(errno != EAGAIN && errno != EWOULDBLOCK)
+            return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"sendmmsg"});
+          idle();
+          ::pollfd pollfd {.fd = fd, .events = POLLOUT, .revents = 0};
+          if(::poll(&pollfd, 1, 1) < 0 && errno != EINTR) [[unlikely]]
+            return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"poll"});
+          continue;
+        }
+        first += nb_sent;
+      }
+      return boost::leaf::success();
+    },
+    events, parameters, std::forward<decltype(on_packet)>(on_packet), std::forward<decltype(idle)>(idle));
+}
+
+} // namespace feed
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+#  include <array>
+#  include <cstring>
+#  include <unistd.h>
+
+TEST_SUITE("feed_replay")
+{
+  TEST_CASE("replay_schedule")
+  {
+    using namespace std::chrono_literals;
+
+    feed::detail::replay_schedule real_time({.mode = feed::replay_mode::real_time});
+    CHECK(real_time(1'000) == 0ns);
+    CHECK(real_time(2'000) == 1'000ns);
+
+    feed::detail::replay_schedule scaled({.mode = feed::replay_mode::scaled, .rate = 1'000.});
+    CHECK(scaled(0) == 0ns);
+    CHECK(scaled(1'000) == 10ns); // rate clamped to x100
+
+    feed::detail::replay_schedule burst({.mode = feed::replay_mode::burst_preserving, .burst_gap = 100ns, .compressed_idle_gap = 10ns});
+    CHECK(burst(0) == 0ns);
+    CHECK(burst(50) == 50ns);
+    CHECK(burst(1'000'000) == 60ns);
+    CHECK(burst(1'000'020) == 80ns);
+  }
+
+  TEST_CASE("replay_full_socket_buffer")
+  {
+    // the receiver only drained from idle: the sender waits for room instead of spinning on EAGAIN
+    std::array<int, 2> fds {};
+    REQUIRE(::socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds.data()) == 0);
+    const int buffer_size = 4'096;
+    REQUIRE(::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size)) == 0);
+
+    constexpr std::size_t nb_events = 1'000;
+    const auto packet = feed::sample_packets::make_packet(0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x01, 0x14, 0x00, 0x00, 0x00, 0x01); // one update
+    static_assert(packet.size() == sizeof(feed::detail::packet));
+    std::vector<std::byte> events(nb_events * sizeof(feed::detail::event));
+    for(std::size_t i = 0; i < nb_events; ++i)
+    {
+      const std::uint64_t timestamp = i;
+      std::memcpy(events.data() + i * sizeof(feed::detail::event), &timestamp, sizeof(timestamp));
+      std::memcpy(events.data() + i * sizeof(feed::detail::event) + sizeof(timestamp), packet.data(), packet.size());
+    }
+
+    std::size_t nb_idle = 0, nb_received = 0;
+    const auto statistics = feed::replay(
+      fds[0], asio::buffer(events), {.mode = feed::replay_mode::as_fast_as_possible, .batch_size = 64}, [](const asio::const_buffer &) {},
+      [&]()
+      {
+        ++nb_idle;
+        std::array<std::byte, 64> datagram {};
+        while(::recv(fds[1], datagram.data(), datagram.size(), 0) > 0)
+          ++nb_received;
+      });
+    REQUIRE(statistics);
+    CHECK(statistics->nb_packets == nb_events);
+    CHECK(nb_idle > 0);
+
+    std::array<std::byte, 64> datagram {};
+    while(::recv(fds[1], datagram.data(), datagram.size(), 0) > 0)
+      ++nb_received;
+    CHECK(nb_received == nb_events);
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
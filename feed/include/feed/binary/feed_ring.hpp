@@ -0,0 +1,357 @@
+#pragma once
+
+#include <feed/binary/feed_binary.hpp>
+#include <feed/binary/feed_capture.hpp>
+
+#include <boilerplate/chrono.hpp>
+#include <boilerplate/contracts.hpp>
+#include <boilerplate/leaf.hpp>
+#include <boilerplate/likely.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+
+#include <gsl/util>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <new>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Shared memory broadcast ring, from a publisher to the consumers on the same box: the packets as they would be sent, no syscall on either side.
+//
+//  +--------------------+ 0
+//  | ring_header        |   the positions: claimed before a packet is written, published after
+//  +--------------------+ sizeof(ring_header)
+//  | ring_record...     |   a timestamp and a size, then the packet, 16 bytes aligned. A record does not wrap: the end of the lap is skipped
+//  +--------------------+ sizeof(ring_header) + capacity
+//
+// The positions only grow, their offset in the ring is modulo the capacity. The publisher never waits for the readers: each one has its own
+// cursor, and a reader lapped (more than the capacity behind) loses what was overwritten, jumps to the last published position and counts an
+// overrun. A packet is copied out, then checked not to have been overwritten meanwhile, before it is passed on.
+//
+// Integers are native endian: the ring is shared on one box.
+
+namespace feed
+{
+constexpr std::array<char, 8> ring_magic = {'F', 'E', 'E', 'D', 'R', 'N', 'G', '1'};
+
+constexpr std::size_t default_ring_capacity = 16 * 1'024 * 1'024;
+constexpr std::size_t ring_cache_line_size = 64; // fixed: the layout is shared between processes
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+struct ring_header final
+{
+  std::array<char, 8> magic = {}; // written last, once the ring is ready
+  std::uint64_t capacity = 0;
+  std::uint64_t max_packet_size = 0;
+  alignas(ring_cache_line_size) std::atomic<std::uint64_t> claimed = 0;
+  std::atomic<std::uint64_t> published = 0;
+};
+
+struct ring_record final
+{
+  std::uint64_t timestamp = 0; // nanoseconds, network_clock
+  std::uint32_t size = 0;      // of the packet
+  std::uint32_t reserved = 0;
+};
+static_assert(sizeof(ring_record) == 16); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+namespace detail
+{
+// the size of the record that skips the rest of the lap
+constexpr std::uint32_t ring_padding = std::numeric_limits<std::uint32_t>::max();
+
+constexpr std::uint64_t ring_record_size(std::size_t packet_size) noexcept { return align_up(sizeof(ring_record) + packet_size, sizeof(ring_record)); }
+
+// shared mapping of a POSIX shared memory object: the one created is unlinked with its mapping
+class shared_mapping
+{
+public:
+  static boost::leaf::result<shared_mapping> create(const std::string &name, std::size_t size) noexcept
+  {
+    // a ring left by a previous run: its readers stay on it, the new ones open this one
+    ::shm_unlink(name.c_str());
+    const auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if(fd < 0) [[unlikely]]
+      return errno_error("shm_open");
+    const auto _ = gsl::finally([&]() { ::close(fd); });
+
+    auto *const data = ::ftruncate(fd, static_cast<off_t>(size)) < 0 ? MAP_FAILED : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if(data == MAP_FAILED) [[unlikely]]
+    {
+      auto error = errno_error("mmap");
+      ::shm_unlink(name.c_str());
+      return error;
+    }
+    return shared_mapping(static_cast<std::byte *>(data), size, name);
+  }
+
+  static boost::leaf::result<shared_mapping> open(const std::string &name) noexcept
+  {
+    const auto fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if(fd < 0) [[unlikely]]
+      return errno_error("shm_open");
+    const auto _ = gsl::finally([&]() { ::close(fd); });
+
+    struct stat stat;
+    if(::fstat(fd, &stat) < 0) [[unlikely]]
+      return errno_error("fstat");
+    const auto size = static_cast<std::size_t>(stat.st_size);
+    auto *const data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if(data == MAP_FAILED) [[unlikely]]
+      return errno_error("mmap");
+
+    return shared_mapping(static_cast<std::byte *>(data), size, {});
+  }
+
+  shared_mapping(shared_mapping &&other) noexcept:
+    data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)), owned_name(std::move(other.owned_name))
+  {
+    other.owned_name.clear();
+  }
+  shared_mapping &operator=(shared_mapping &&) = delete;
+
+  ~shared_mapping() noexcept
+  {
+    if(data_)
+      ::munmap(data_, size_);
+    if(!owned_name.empty())
+      ::shm_unlink(owned_name.c_str());
+  }
+
+  std::byte *data() const noexcept { return data_; }
+  std::size_t size() const noexcept { return size_; }
+
+private:
+  shared_mapping(std::byte *data, std::size_t size, std::string owned_name) noexcept: data_(data), size_(size), owned_name(std::move(owned_name)) {}
+
+  std::byte *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::string owned_name {};
+};
+} // namespace detail
+
+//
+//
+// WRITER
+
+class ring_writer
+{
+public:
+  // the capacity is rounded up to a power of 2, of 4 of the largest records at least
+  static boost::leaf::result<ring_writer> create(std::string_view name, std::size_t capacity = default_ring_capacity,
+                                                 std::size_t max_packet_size = detail::packet_max_size) noexcept
+  {
+    capacity = std::bit_ceil(std::max<std::size_t>(capacity, 4 * detail::ring_record_size(max_packet_size)));
+    BOOST_LEAF_AUTO(mapping, detail::shared_mapping::create(std::string(name), sizeof(ring_header) + capacity));
+
+    auto *const header = new(mapping.data()) ring_header {.capacity = capacity, .max_packet_size = max_packet_size};
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = ring_magic;
+    return ring_writer(std::move(mapping));
+  }
+
+  ring_writer(ring_writer &&) noexcept = default;
+  ring_writer &operator=(ring_writer &&) = delete;
+
+  // never waits: the readers lapped lose the packets overwritten
+  [[using gnu: hot]] void publish(const asio::const_buffer &packet, const network_clock::time_point &timestamp = network_clock::now()) noexcept
+  {
+    REQUIRES(packet.size() <= header().max_packet_size);
+    const auto size = detail::ring_record_size(packet.size());
+    if(const auto left = capacity - (position & mask); left < size) [[unlikely]]
+    {
+      write({.size = detail::ring_padding}, {}, position + left + size);
+      position += left;
+    }
+    write({.timestamp = static_cast<std::uint64_t>(timestamp.time_since_epoch().count()), .size = static_cast<std::uint32_t>(packet.size())}, packet,
+          position + size);
+    position += size;
+    header().published.store(position, std::memory_order_release);
+  }
+
+  [[nodiscard]] std::uint64_t nb_published_bytes() const noexcept { return position; }
+
+private:
+  explicit ring_writer(detail::shared_mapping &&mapping) noexcept:
+    mapping(std::move(mapping)), capacity(header().capacity), mask(capacity - 1), ring(this->mapping.data() + sizeof(ring_header))
+  {
+  }
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  ring_header &header() const noexcept { return *reinterpret_cast<ring_header *>(mapping.data()); }
+
+  // the readers see the claim before any of the bytes (stores are not reordered on x86)
+  void write(const ring_record &record, const asio::const_buffer &packet, std::uint64_t claimed) noexcept
+  {
+    header().claimed.store(claimed, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto *const destination = ring + (position & mask);
+    std::memcpy(destination, &record, sizeof(record));
+    if(packet.size())
+      std::memcpy(destination + sizeof(record), packet.data(), packet.size());
+  }
+
+  detail::shared_mapping mapping;
+  std::uint64_t capacity, mask;
+  std::byte *ring;
+  std::uint64_t position = 0;
+};
+
+//
+//
+// READER
+
+// the receive interface of multicast_udp_reader, from the last position published
+class ring_reader
+{
+public:
+  static boost::leaf::result<ring_reader> open(std::string_view name) noexcept
+  {
+    BOOST_LEAF_AUTO(mapping, detail::shared_mapping::open(std::string(name)));
+    if(mapping.size() < sizeof(ring_header)) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"ring too small"});
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto &header = *reinterpret_cast<const ring_header *>(mapping.data());
+    if(header.magic != ring_magic) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"not a ring, or not ready"});
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(!std::has_single_bit(header.capacity) || sizeof(ring_header) + header.capacity != mapping.size()) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"truncated ring"});
+    return ring_reader(std::move(mapping));
+  }
+
+  ring_reader(ring_reader &&) noexcept = default;
+  ring_reader &operator=(ring_reader &&) = delete;
+
+  [[using gnu: always_inline, flatten, hot]] inline auto operator()(std::invocable<const network_clock::time_point &, asio::const_buffer &&> auto continuation) noexcept
+    -> boost::leaf::result<void>
+  {
+    const auto published = header().published.load(std::memory_order_acquire);
+    if(published - cursor > capacity) [[unlikely]]
+      return overrun(published);
+
+    while(cursor != published)
+    {
+      const auto offset = cursor & mask;
+      ring_record record;
+      std::memcpy(&record, ring + offset, sizeof(record));
+      // bounded, in case the record is being overwritten
+      const auto size = std::min<std::size_t>({record.size, buffer.size(), capacity - offset - sizeof(record)});
+      std::memcpy(buffer.data(), ring + offset + sizeof(record), size);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(header().claimed.load(std::memory_order_relaxed) - cursor > capacity) [[unlikely]]
+        return overrun(header().published.load(std::memory_order_acquire));
+
+      if(record.size == detail::ring_padding) [[unlikely]]
+      {
+        cursor += capacity - offset;
+        continue;
+      }
+      cursor += detail::ring_record_size(size);
+      continuation(network_clock::time_point(std::chrono::nanoseconds(record.timestamp)), asio::const_buffer(buffer.data(), size));
+    }
+    return {};
+  }
+
+  [[nodiscard]] std::uint64_t nb_overruns() const noexcept { return nb_overruns_; }
+  [[nodiscard]] std::uint64_t nb_lost_bytes() const noexcept { return nb_lost_bytes_; }
+
+private:
+  explicit ring_reader(detail::shared_mapping &&mapping) noexcept:
+    mapping(std::move(mapping)), capacity(header().capacity), mask(capacity - 1), ring(this->mapping.data() + sizeof(ring_header)),
+    buffer(header().max_packet_size), cursor(header().published.load(std::memory_order_acquire))
+  {
+  }
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const ring_header &header() const noexcept { return *reinterpret_cast<const ring_header *>(mapping.data()); }
+
+  [[using gnu: cold]] boost::leaf::result<void> overrun(std::uint64_t published) noexcept
+  {
+    ++nb_overruns_;
+    nb_lost_bytes_ += published - cursor;
+    cursor = published;
+    return {};
+  }
+
+  detail::shared_mapping mapping;
+  std::uint64_t capacity, mask;
+  const std::byte *ring;
+  std::vector<std::byte> buffer;
+  std::uint64_t cursor;
+  std::uint64_t nb_overruns_ = 0, nb_lost_bytes_ = 0;
+};
+
+} // namespace feed
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+#include <string>
+
+TEST_SUITE("feed_ring")
+{
+  TEST_CASE("ring_roundtrip")
+  {
+    const auto name = "/feed_ring_" + std::to_string(::getpid());
+    // the smallest ring: 4 records of the largest packet
+    auto writer = feed::ring_writer::create(name, 0, 48);
+    REQUIRE(writer);
+    auto reader = feed::ring_reader::open(name);
+    REQUIRE(reader);
+
+    std::vector<std::uint8_t> received;
+    const auto receive = [&]() {
+      received.clear();
+      REQUIRE((*reader)([&](const network_clock::time_point &, asio::const_buffer &&packet) {
+        received.push_back(*static_cast<const std::uint8_t *>(packet.data()));
+      }));
+    };
+
+    // 48 bytes per record, over 2 laps of 256 bytes: the end of a lap is padding
+    std::array<std::uint8_t, 24> packet {};
+    for(std::uint8_t i = 0; i != 12; ++i)
+    {
+      packet[0] = i;
+      writer->publish(asio::buffer(packet));
+      receive();
+      REQUIRE(received.size() == 1);
+      CHECK(received[0] == i);
+    }
+    CHECK(reader->nb_overruns() == 0);
+
+    // lapped
+    for(std::uint8_t i = 0; i != 6; ++i)
+      writer->publish(asio::buffer(packet));
+    receive();
+    CHECK(received.empty());
+    CHECK(reader->nb_overruns() == 1);
+    packet[0] = 42;
+    writer->publish(asio::buffer(packet));
+    receive();
+    CHECK(received == std::vector<std::uint8_t> {42});
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <feed/binary/feed_replay.hpp>
+#include <feed/binary/feed_ring.hpp>
 #include <feed/feed.hpp>
 
 #include <boilerplate/leaf.hpp>
@@ -12,10 +14,23 @@
 #include <asio/detached.hpp>
 #include <asio/ip/tcp.hpp>
 #include <asio/ip/udp.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/write.hpp>
 
 #include <boost/container/flat_map.hpp>
 
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <sys/socket.h>
+#include <tuple>
 #include <unordered_map>
+#include <vector>
 
 namespace feed
 {
@@ -23,57 +38,160 @@ struct server;
 
 namespace detail
 {
-struct session : public std::enable_shared_from_this<session>
+// a session serves requests until the peer disconnects. Requests may be pipelined: everything readable is decoded at once and the replies are
+// gathered in a single write. A bulk request streams the whole state_map (or the listed instruments) in chunks, a version request gets the wire
+// version of the updates.
+struct session
 {
+  static constexpr std::size_t max_pipelined_requests = 64;
+
   asio::ip::tcp::socket socket;
   boilerplate::not_null_observer_ptr<server> server_ptr;
 
   session(asio::ip::tcp::socket &&socket, boilerplate::not_null_observer_ptr<server> server_ptr) noexcept: socket(std::move(socket)), server_ptr(server_ptr) {}
 
+  session(session &&) noexcept = default;
+  session &operator=(session &&) noexcept = default;
+
   boost::leaf::awaitable<boost::leaf::result<void>> operator()() noexcept;
+
+private:
+  using reply_buffer = std::array<std::byte, message_max_size>;
+  using request_buffer = std::array<std::byte, max_pipelined_requests * sizeof(snapshot_request)>;
+
+  boost::leaf::awaitable<boost::leaf::result<void>> co_bulk_snapshot(std::size_t &pending_bytes) noexcept;
+  boost::leaf::awaitable<boost::leaf::result<void>> co_version(std::size_t &pending_bytes) noexcept;
+
+  // recycled from one batch to the other, allocated once per session
+  std::unique_ptr<request_buffer> requests = std::make_unique<request_buffer>();
+  std::unique_ptr<std::array<reply_buffer, max_pipelined_requests>> replies_pool = std::make_unique<std::array<reply_buffer, max_pipelined_requests>>();
+  std::vector<asio::const_buffer> replies = std::vector<asio::const_buffer>(max_pipelined_requests);
+  std::vector<std::byte> bulk_request {};
+  std::vector<instrument_id_type> bulk_instruments {};
+  std::vector<std::byte> bulk_chunk {};
 };
 } // namespace detail
 
 class server : public state_map
 {
 public:
-  explicit server(asio::io_context &service) noexcept: service(service), updates_socket(service), snapshot_acceptor(service) {}
+  explicit server(asio::io_context &service, std::size_t mtu = detail::default_mtu) noexcept:
+    state_map(mtu), service(service), updates_socket(service), snapshot_acceptor(service)
+  {
+  }
 
   boost::leaf::result<void> connect(const asio::ip::tcp::endpoint &snapshot_endpoint, const asio::ip::udp::endpoint &updates_endpoint) noexcept
   {
     BOOST_LEAF_EC_TRYV(updates_socket.open(updates_endpoint.protocol(), _));
     BOOST_LEAF_EC_TRYV(updates_socket.connect(updates_endpoint, _));
 
-    BOOST_LEAF_EC_TRYV(snapshot_acceptor.open(snapshot_endpoint.protocol(), _));
-    BOOST_LEAF_EC_TRYV(snapshot_acceptor.set_option(asio::ip::tcp::socket::reuse_address(true), _));
-    BOOST_LEAF_EC_TRYV(snapshot_acceptor.bind(snapshot_endpoint, _));
-    BOOST_LEAF_EC_TRYV(snapshot_acceptor.listen(asio::ip::tcp::socket::max_listen_connections, _));
+    return listen(snapshot_endpoint);
+  }
 
-    return boost::leaf::success();
+  // the updates published on a shared memory ring (see feed_ring.hpp) instead, for the consumers on the same box. The snapshots are still served
+  // over TCP
+  boost::leaf::result<void> connect(const asio::ip::tcp::endpoint &snapshot_endpoint, std::string_view updates_ring_name,
+                                    std::size_t ring_capacity = default_ring_capacity) noexcept
+  {
+    updates_ring.emplace(BOOST_LEAF_TRYX(ring_writer::create(updates_ring_name, ring_capacity, detail::packet_max_size)));
+
+    return listen(snapshot_endpoint);
   }
 
   boost::leaf::awaitable<boost::leaf::result<void>>
   update_async(const auto &states) noexcept // TODO requires is_iterable_v<decltype(states), std::tuple<instrument_id_type, instrument_state>>
   {
-    auto buffer = state_map::update(states);
-    if(buffer.size() > 0)
-      BOOST_LEAF_ASIO_CO_TRYV(co_await updates_socket.async_send(buffer, _));
+    const auto packets = state_map::update(states);
+
+    if(updates_ring)
+    {
+      for(auto &&packet: packets)
+        updates_ring->publish(asio::const_buffer(packet.data(), packet.size()));
+      co_return boost::leaf::success();
+    }
+
+    // the whole batch of MTU-sized packets goes out in one syscall. The vectors are the coroutine's own: another update may be sent while this one
+    // waits
+    std::vector<iovec> iovecs;
+    iovecs.reserve(packets.size());
+    for(auto &&packet: packets)
+      iovecs.push_back(iovec {.iov_base = const_cast<void *>(packet.data()), .iov_len = packet.size()});
+    std::vector<mmsghdr> msgvec;
+    msgvec.reserve(iovecs.size());
+    for(auto &iovec: iovecs)
+      msgvec.push_back(mmsghdr {.msg_hdr = {.msg_iov = &iovec, .msg_iovlen = 1}, .msg_len = 0});
+
+    std::vector<std::byte> pending {}; // the packets not sent yet, out of the state_map before it encodes the next update
+    for(auto [first, last] = std::tuple {msgvec.data(), msgvec.data() + msgvec.size()}; first != last;)
+    {
+      const auto nb_sent = ::sendmmsg(updates_socket.native_handle(), first, static_cast<unsigned int>(last - first), MSG_DONTWAIT);
+      if(nb_sent < 0) [[unlikely]]
+      {
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+          co_return BOOST_LEAF_NEW_ERROR(std::error_code(errno, std::generic_category()), ::boilerplate::statement {"sendmmsg"});
+        if(pending.empty())
+        {
+          std::size_t nb_bytes = 0;
+          for(auto *message = first; message != last; ++message)
+            nb_bytes += message->msg_hdr.msg_iov->iov_len;
+          pending.reserve(nb_bytes);
+          for(auto *message = first; message != last; ++message)
+          {
+            auto &iovec = *message->msg_hdr.msg_iov;
+            const auto *const bytes = static_cast<const std::byte *>(iovec.iov_base);
+            iovec.iov_base = pending.data() + pending.size();
+            pending.insert(pending.end(), bytes, bytes + iovec.iov_len);
+          }
+        }
+        BOOST_LEAF_ASIO_CO_TRYV(co_await updates_socket.async_wait(asio::ip::udp::socket::wait_write, _));
+        continue;
+      }
+      first += nb_sent;
+    }
+
     co_return boost::leaf::success();
   }
 
+  // sends the captured packets as is, keeping the state_map up to date for the snapshots, which are served while idle. on_idle is called there
+  // too, after them
+  boost::leaf::result<replay_statistics> replay(const asio::const_buffer &events, const replay_parameters &parameters, auto &&on_idle) noexcept
+  {
+    const auto on_packet = [this](const asio::const_buffer &packet) noexcept { state_map::apply(packet); };
+    const auto idle = [this, &on_idle]() noexcept
+    {
+      std::error_code ignored;
+      service.poll(ignored);
+      on_idle();
+    };
+    if(updates_ring)
+      return feed::replay_with(
+        [this](std::span<const iovec> batch) noexcept -> boost::leaf::result<void>
+        {
+          for(auto &&packet: batch)
+            updates_ring->publish(asio::const_buffer(packet.iov_base, packet.iov_len));
+          return boost::leaf::success();
+        },
+        events, parameters, on_packet, idle);
+    return feed::replay(updates_socket.native_handle(), events, parameters, on_packet, idle);
+  }
+
+  boost::leaf::result<replay_statistics> replay(const asio::const_buffer &events, const replay_parameters &parameters) noexcept
+  {
+    return replay(events, parameters, []() noexcept {});
+  }
+
   instrument_state snapshot(instrument_id_type instrument) const noexcept { return at(instrument); }
 
   boost::leaf::awaitable<boost::leaf::result<void>> accept_async() noexcept
   {
     asio::ip::tcp::socket socket(service);
     BOOST_LEAF_ASIO_CO_TRYV(co_await snapshot_acceptor.async_accept(socket, _));
-    auto session_ptr = std::make_shared<detail::session>(std::move(socket), boilerplate::make_strict_not_null(this));
     asio::co_spawn(
       service,
-      [session_ptr]() mutable noexcept -> boost::leaf::awaitable<void>
+      [session = detail::session(std::move(socket), boilerplate::make_strict_not_null(this))]() mutable noexcept -> boost::leaf::awaitable<void>
       {
         co_await boost::leaf::co_try_handle_all(
-          *session_ptr,
+          session,
           [&](const boost::leaf::error_info &unmatched) {
             // TODO
             // logger->log(logger::critical, "leaf_error_id={} exited"_format, ei.error());
@@ -86,22 +204,140 @@ public:
   }
 
 private:
+  boost::leaf::result<void> listen(const asio::ip::tcp::endpoint &snapshot_endpoint) noexcept
+  {
+    BOOST_LEAF_EC_TRYV(snapshot_acceptor.open(snapshot_endpoint.protocol(), _));
+    BOOST_LEAF_EC_TRYV(snapshot_acceptor.set_option(asio::ip::tcp::socket::reuse_address(true), _));
+    BOOST_LEAF_EC_TRYV(snapshot_acceptor.bind(snapshot_endpoint, _));
+    BOOST_LEAF_EC_TRYV(snapshot_acceptor.listen(asio::ip::tcp::socket::max_listen_connections, _));
+
+    return boost::leaf::success();
+  }
+
   asio::io_context &service;
   asio::ip::udp::socket updates_socket;
+  std::optional<ring_writer> updates_ring {};
   asio::ip::tcp::acceptor snapshot_acceptor;
 };
 
 inline boost::leaf::awaitable<boost::leaf::result<void>> detail::session::operator()() noexcept
 {
-  const auto self(shared_from_this());
+  auto *const request_bytes = requests->data();
+  std::size_t pending_bytes = 0;
+
+  for(;;)
+  {
+    std::size_t nb_replies = 0, consumed_bytes = 0;
+    bool bulk = false;
+    while(pending_bytes - consumed_bytes >= sizeof(snapshot_request))
+    {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      const auto instrument = reinterpret_cast<const snapshot_request *>(request_bytes + consumed_bytes)->instrument.value();
+      if(instrument == bulk_snapshot_instrument)
+      {
+        bulk = true;
+        break;
+      }
+
+      auto &reply = (*replies_pool)[nb_replies];
+      const auto actual_length = encode_message(instrument, server_ptr->snapshot(instrument), asio::mutable_buffer(reply.data(), reply.size()));
+      replies[nb_replies++] = asio::const_buffer(reply.data(), actual_length);
+      consumed_bytes += sizeof(snapshot_request);
+    }
+
+    // keep what has not been handled yet
+    std::memmove(request_bytes, request_bytes + consumed_bytes, pending_bytes - consumed_bytes);
+    pending_bytes -= consumed_bytes;
+
+    if(nb_replies)
+      BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_write(socket, ranges::make_span(replies.data(), static_cast<std::ptrdiff_t>(nb_replies)), _));
+
+    if(bulk)
+    {
+      BOOST_LEAF_CO_TRYV(co_await co_bulk_snapshot(pending_bytes));
+      continue;
+    }
+
+    std::error_code ec;
+    const auto nb_read = co_await socket.async_read_some(asio::buffer(request_bytes + pending_bytes, requests->size() - pending_bytes),
+                                                         asio::redirect_error(boost::leaf::use_awaitable, ec));
+    if(ec == asio::error::eof)
+      co_return boost::leaf::success();
+    if(ec) [[unlikely]]
+      co_return BOOST_LEAF_NEW_ERROR(ec, ::boilerplate::statement {"socket.async_read_some"});
+    pending_bytes += nb_read;
+  }
+}
+
+// the bulk request starts at the beginning of the request buffer
+inline boost::leaf::awaitable<boost::leaf::result<void>> detail::session::co_bulk_snapshot(std::size_t &pending_bytes) noexcept
+{
+  auto *const request_bytes = requests->data();
+  const auto read_at_least = [&](std::size_t size) noexcept -> boost::leaf::awaitable<boost::leaf::result<void>>
+  {
+    if(const auto already_read = bulk_request.size(); already_read < size)
+    {
+      bulk_request.resize(size);
+      BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_read(socket, asio::buffer(bulk_request.data() + already_read, size - already_read), _));
+    }
+    co_return boost::leaf::success();
+  };
+
+  bulk_request.assign(request_bytes, request_bytes + pending_bytes);
+  BOOST_LEAF_CO_TRYV(co_await read_at_least(sizeof(bulk_snapshot_request)));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  const std::size_t nb_instruments = reinterpret_cast<const bulk_snapshot_request *>(bulk_request.data())->nb_instruments.value();
+  if(nb_instruments == version_request_marker)
+    co_return co_await co_version(pending_bytes);
+  const auto request_size = sizeof(bulk_snapshot_request) + nb_instruments * sizeof(snapshot_request);
+  BOOST_LEAF_CO_TRYV(co_await read_at_least(request_size));
+
+  // give back whatever was pipelined behind the bulk request
+  pending_bytes = bulk_request.size() - request_size;
+  std::memcpy(request_bytes, bulk_request.data() + request_size, pending_bytes);
+
+  // the instrument list is captured upfront: the state_map may change while the replies are written
+  bulk_instruments.clear();
+  if(nb_instruments)
+    for(std::size_t i = 0; i < nb_instruments; ++i)
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      bulk_instruments.push_back(reinterpret_cast<const snapshot_request *>(bulk_request.data() + sizeof(bulk_snapshot_request))[i].instrument.value());
+  else
+    server_ptr->each_instrument([&](instrument_id_type instrument) noexcept { bulk_instruments.push_back(instrument); });
+
+  bulk_chunk.resize(bulk_snapshot_chunk_size);
+  new(bulk_chunk.data()) bulk_snapshot_reply {.nb_messages = endian::big_uint32_buf_t(static_cast<std::uint32_t>(bulk_instruments.size()))};
+  std::size_t offset = sizeof(bulk_snapshot_reply);
+  for(auto instrument: bulk_instruments)
+  {
+    if(bulk_chunk.size() - offset < message_max_size)
+    {
+      BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_write(socket, asio::buffer(bulk_chunk.data(), offset), _));
+      offset = 0;
+    }
+    offset += encode_message(instrument, server_ptr->snapshot(instrument), asio::mutable_buffer(bulk_chunk.data() + offset, bulk_chunk.size() - offset));
+  }
+  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_write(socket, asio::buffer(bulk_chunk.data(), offset), _));
+
+  co_return boost::leaf::success();
+}
+
+// the version request starts at the beginning of the bulk request buffer. The updates are published with a single version: the reply is the
+// same whatever the client supports, it is up to the client to give up
+inline boost::leaf::awaitable<boost::leaf::result<void>> detail::session::co_version(std::size_t &pending_bytes) noexcept
+{
+  auto *const request_bytes = requests->data();
+  if(const auto already_read = bulk_request.size(); already_read < sizeof(version_request))
+  {
+    bulk_request.resize(sizeof(version_request));
+    BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_read(socket, asio::buffer(bulk_request.data() + already_read, sizeof(version_request) - already_read), _));
+  }
 
-  detail::snapshot_request request;
-  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_read(socket, asio::buffer(&request, sizeof(request)), _));
+  pending_bytes = bulk_request.size() - sizeof(version_request);
+  std::memcpy(request_bytes, bulk_request.data() + sizeof(version_request), pending_bytes);
 
-  std::array<char, 128> buffer;
-  const auto actual_length = feed::detail::encode_message(request.instrument.value(), server_ptr->snapshot(request.instrument.value()),
-                                                          asio::mutable_buffer(buffer.data(), buffer.size()));
-  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_write(socket, asio::buffer(buffer.data(), actual_length), _));
+  const version_reply reply {.version = std::to_underlying(server_ptr->version())};
+  BOOST_LEAF_ASIO_CO_TRYV(co_await asio::async_write(socket, asio::const_buffer(&reply, sizeof(reply)), _));
 
   co_return boost::leaf::success();
 }
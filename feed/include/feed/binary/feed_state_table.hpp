@@ -0,0 +1,193 @@
+#pragma once
+
+#include <feed/binary/feed_ring.hpp>
+#include <feed/feed_structures.hpp>
+
+#include <boilerplate/leaf.hpp>
+
+#include <boost/leaf/error.hpp>
+#include <boost/leaf/result.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Shared memory table of the instrument states, from a feed handler to the consumers on the same box: a snapshot is a read, not a round trip.
+//
+//  +--------------------+ 0
+//  | state_table_header |
+//  +--------------------+ sizeof(state_table_header)
+//  | state_table_slot...|   one per instrument id, the whole range: a version, then the state
+//  +--------------------+
+//
+// A seqlock per slot: the writer makes the version odd, writes the state, then makes it even again. A reader copies the state out between two
+// reads of the same even version, and tries again otherwise. The writer never waits, a reader only while a state is being written.
+//
+// Integers are native endian, and the states are copied as they are in memory: the table is shared on one box, by the same build.
+
+namespace feed
+{
+constexpr std::array<char, 8> state_table_magic = {'F', 'E', 'E', 'D', 'T', 'B', 'L', '1'};
+
+constexpr std::size_t state_table_nb_instruments = std::size_t(std::numeric_limits<instrument_id_type>::max()) + 1;
+
+static_assert(std::is_trivially_copyable_v<instrument_state>);
+
+// a cache line: the slots after it aligned
+struct alignas(ring_cache_line_size) state_table_header final
+{
+  std::array<char, 8> magic = {}; // written last, once the table is ready
+  std::uint64_t nb_instruments = 0;
+  std::uint64_t state_size = 0; // of the build that wrote it
+};
+
+struct alignas(ring_cache_line_size) state_table_slot final
+{
+  std::atomic<std::uint64_t> version = 0; // odd while the state is being written, 0 if it never was
+  instrument_state state {};
+};
+static_assert(sizeof(state_table_header) % alignof(state_table_slot) == 0);
+
+//
+//
+// WRITER
+
+class state_table_writer
+{
+public:
+  static boost::leaf::result<state_table_writer> create(std::string_view name) noexcept
+  {
+    BOOST_LEAF_AUTO(mapping, detail::shared_mapping::create(std::string(name), sizeof(state_table_header) + state_table_nb_instruments * sizeof(state_table_slot)));
+
+    auto *const header = new(mapping.data()) state_table_header {.nb_instruments = state_table_nb_instruments, .state_size = sizeof(instrument_state)};
+    std::uninitialized_default_construct_n(reinterpret_cast<state_table_slot *>(mapping.data() + sizeof(state_table_header)), state_table_nb_instruments); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = state_table_magic;
+    return state_table_writer(std::move(mapping));
+  }
+
+  state_table_writer(state_table_writer &&) noexcept = default;
+  state_table_writer &operator=(state_table_writer &&) = delete;
+
+  [[using gnu: hot]] void store(instrument_id_type instrument, const instrument_state &state) noexcept
+  {
+    auto &slot = slots[instrument];
+    const auto version = slot.version.load(std::memory_order_relaxed);
+    slot.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot.state, &state, sizeof(state));
+    slot.version.store(version + 2, std::memory_order_release);
+  }
+
+private:
+  explicit state_table_writer(detail::shared_mapping &&mapping) noexcept:
+    mapping(std::move(mapping)), slots(reinterpret_cast<state_table_slot *>(this->mapping.data() + sizeof(state_table_header))) // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  {
+  }
+
+  detail::shared_mapping mapping;
+  state_table_slot *slots;
+};
+
+//
+//
+// READER
+
+class state_table_reader
+{
+public:
+  static boost::leaf::result<state_table_reader> open(std::string_view name) noexcept
+  {
+    BOOST_LEAF_AUTO(mapping, detail::shared_mapping::open(std::string(name)));
+    if(mapping.size() < sizeof(state_table_header)) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"state table too small"});
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto &header = *reinterpret_cast<const state_table_header *>(mapping.data());
+    if(header.magic != state_table_magic) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"not a state table, or not ready"});
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(header.state_size != sizeof(instrument_state) || header.nb_instruments != state_table_nb_instruments
+       || sizeof(state_table_header) + state_table_nb_instruments * sizeof(state_table_slot) != mapping.size()) [[unlikely]]
+      return BOOST_LEAF_NEW_ERROR(std::make_error_code(std::errc::invalid_argument), ::boilerplate::statement {"state table of another build"});
+    return state_table_reader(std::move(mapping));
+  }
+
+  state_table_reader(state_table_reader &&) noexcept = default;
+  state_table_reader &operator=(state_table_reader &&) = delete;
+
+  // the state as last stored (the default one, sequence id 0, if it never was)
+  [[using gnu: hot]] instrument_state load(instrument_id_type instrument) noexcept
+  {
+    const auto &slot = slots[instrument];
+    for(;;)
+    {
+      const auto version = slot.version.load(std::memory_order_acquire);
+      if(!(version & 1)) [[likely]]
+      {
+        instrument_state state;
+        std::memcpy(&state, &slot.state, sizeof(state));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot.version.load(std::memory_order_relaxed) == version) [[likely]]
+          return state;
+      }
+      ++nb_retries_;
+      _mm_pause();
+    }
+  }
+
+  [[nodiscard]] std::uint64_t nb_retries() const noexcept { return nb_retries_; }
+
+private:
+  explicit state_table_reader(detail::shared_mapping &&mapping) noexcept:
+    mapping(std::move(mapping)), slots(reinterpret_cast<const state_table_slot *>(this->mapping.data() + sizeof(state_table_header))) // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  {
+  }
+
+  detail::shared_mapping mapping;
+  const state_table_slot *slots;
+  std::uint64_t nb_retries_ = 0;
+};
+
+} // namespace feed
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+#include <string>
+
+TEST_SUITE("feed_state_table")
+{
+  TEST_CASE("state_table_roundtrip")
+  {
+    const auto name = "/feed_state_table_" + std::to_string(::getpid());
+    auto writer = feed::state_table_writer::create(name);
+    REQUIRE(writer);
+    auto reader = feed::state_table_reader::open(name);
+    REQUIRE(reader);
+
+    CHECK(reader->load(42).sequence_id == 0); // never stored
+
+    feed::instrument_state state {.sequence_id = 7};
+    feed::update_state(state, feed::bq0_v, feed::quantity_t {1});
+    writer->store(42, state);
+    const auto loaded = reader->load(42);
+    CHECK(loaded.sequence_id == 7);
+    CHECK(loaded.updates == state.updates);
+    CHECK(reader->load(43).sequence_id == 0);
+
+    state.sequence_id = 8;
+    writer->store(42, state);
+    CHECK(reader->load(42).sequence_id == 8);
+    CHECK(reader->nb_retries() == 0);
+  }
+}
+
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
@@ -1,44 +1,298 @@
-class decimal
+#pragma once
+
+#include <boilerplate/contracts.hpp>
+#include <boilerplate/likely.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+
+namespace feed
+{
+namespace detail
+{
+constexpr auto pow10 = []() {
+  std::array<std::int64_t, 19> result {1};
+  for(std::size_t i = 1; i < result.size(); ++i)
+    result[i] = result[i - 1] * 10;
+  return result;
+}();
+} // namespace detail
+
+//
+//
+// FIXED POINT PRICE
+//
+
+// An integral number of 10^-decimals: comparisons and additions are integer operations, and prices on a tick are exact.
+// The rep is 32 bits wide: |price| <= max_raw * 10^-decimals, i.e. 214'748.3647 at 4 decimals. Conversions saturate to that range, arithmetic does not.
+template<int decimals_>
+class fixed_price
 {
-	using underlying_type = std::uint32_t;
+public:
+  using rep = std::int32_t;
+  static constexpr int decimals = decimals_;
+  static constexpr rep scale = static_cast<rep>(detail::pow10[decimals]);
+  static constexpr rep max_raw = std::numeric_limits<rep>::max();
+
+  static_assert(decimals >= 0 && decimals < 10);
+
+  constexpr fixed_price() noexcept = default;
+  // rounded half away from zero, saturated (NaN is 0)
+  explicit constexpr fixed_price(double value) noexcept: value(saturate(value * scale + (value < 0 ? -.5 : .5))) {}
+
+  static constexpr fixed_price max() noexcept { return from_raw(max_raw); }
+  static constexpr fixed_price lowest() noexcept { return from_raw(-max_raw); }
+
+  static constexpr fixed_price from_raw(rep value) noexcept
+  {
+    fixed_price result;
+    result.value = value;
+    return result;
+  }
+  constexpr rep raw() const noexcept { return value; }
+
+  explicit constexpr operator double() const noexcept { return static_cast<double>(value) / scale; }
+  explicit constexpr operator float() const noexcept { return static_cast<float>(static_cast<double>(*this)); }
+
+  constexpr auto operator<=>(const fixed_price &) const noexcept = default;
+
+  constexpr fixed_price operator-() const noexcept { return from_raw(-value); }
+  constexpr fixed_price operator+(const fixed_price &other) const noexcept { return from_raw(value + other.value); }
+  constexpr fixed_price operator-(const fixed_price &other) const noexcept { return from_raw(value - other.value); }
+  constexpr fixed_price operator*(rep factor) const noexcept { return from_raw(value * factor); }
+  constexpr rep operator/(const fixed_price &other) const noexcept { return value / other.value; }
+  constexpr fixed_price &operator+=(const fixed_price &other) noexcept { return value += other.value, *this; }
+  constexpr fixed_price &operator-=(const fixed_price &other) noexcept { return value -= other.value, *this; }
+
+  //
+  // wire formats: IEEE 754 binary32 (LEAN_AND_MEAN builds) or decimal32 in binary integer decimal encoding (GCC std::decimal)
+
+  static fixed_price from_float_bits(std::uint32_t bits) noexcept { return fixed_price(static_cast<double>(std::bit_cast<float>(bits))); }
+
+  std::uint32_t to_float_bits() const noexcept { return std::bit_cast<std::uint32_t>(static_cast<float>(*this)); }
+
+  static constexpr fixed_price from_decimal32_bits(std::uint32_t bits) noexcept
+  {
+    constexpr std::uint32_t large_coefficient = 0b11 << 29;
+    ASSERTS((bits & (0b1111 << 27)) != (0b1111 << 27)); // neither infinity nor NaN
+
+    std::int64_t coefficient;
+    int exponent;
+    if((bits & large_coefficient) != large_coefficient)
+    {
+      exponent = static_cast<int>((bits >> 23) & 0xff) - decimal32_bias;
+      coefficient = bits & 0x7f'ffff;
+    }
+    else
+    {
+      exponent = static_cast<int>((bits >> 21) & 0xff) - decimal32_bias;
+      coefficient = 0x80'0000 | (bits & 0x1f'ffff);
+    }
+
+    // a price finer than the scale cannot be represented: it is rounded to the nearest, half away from zero (as the double constructor does);
+    // a price out of range saturates, checked before scaling (the coefficient has 24 bits: 10^10 times it still fits in 64 bits)
+    const auto shift = exponent + decimals;
+    std::int64_t result;
+    if(shift >= 0)
+      result = shift > 9 ? (coefficient ? max_raw : 0) : std::min<std::int64_t>(coefficient * detail::pow10[static_cast<std::size_t>(shift)], max_raw);
+    else
+    {
+      const auto divisor = detail::pow10[static_cast<std::size_t>(std::min(-shift, 18))];
+      result = (coefficient + divisor / 2) / divisor;
+    }
+    return from_raw(static_cast<rep>(bits >> 31 ? -result : result));
+  }
+
+  constexpr std::uint32_t to_decimal32_bits() const noexcept
+  {
+    std::uint32_t sign = value < 0 ? 1u << 31 : 0;
+    std::uint32_t coefficient = static_cast<std::uint32_t>(value < 0 ? -static_cast<std::int64_t>(value) : value);
+    int exponent = -decimals;
+    // decimal32 has 7 digits
+    while(coefficient > decimal32_max_coefficient && !(coefficient % 10))
+    {
+      coefficient /= 10;
+      ++exponent;
+    }
+    ASSERTS(coefficient <= decimal32_max_coefficient);
+
+    const auto biased_exponent = static_cast<std::uint32_t>(exponent + decimal32_bias);
+    if(coefficient < 0x80'0000)
+      return sign | biased_exponent << 23 | coefficient;
+    return sign | 0b11 << 29 | biased_exponent << 21 | (coefficient & 0x1f'ffff);
+  }
+
+private:
+  static constexpr rep saturate(double scaled) noexcept
+  {
+    if(scaled != scaled) [[unlikely]]
+      return 0;
+    return static_cast<rep>(std::clamp(scaled, -static_cast<double>(max_raw), static_cast<double>(max_raw)));
+  }
+
+  static constexpr int decimal32_bias = 101;
+  static constexpr std::uint32_t decimal32_max_coefficient = 9'999'999;
 
-	constexpr static auto exponent_digits = 10;
-	auto sign: 1;
-	auto exponent: exponent_digits; // in complement to 2
-	auto significant: std::numeric_limits<underlying_type>::digits() - exponent_digits - 1;
+  rep value = 0;
+};
+
+#if !defined(FEED_PRICE_DECIMALS)
+#  define FEED_PRICE_DECIMALS 4
+#endif // !defined(FEED_PRICE_DECIMALS)
+
+using tick_price = fixed_price<FEED_PRICE_DECIMALS>;
 
-  constexpr auto operator<=>(decimal other) const noexcept
-	{
-	}
+//
+//
+// TICK RULES
+//
 
-	template<typename value_type>
-	constexpr value_type max_for_exponent(exponent_type exponent)
-	{
-	}
+// From each `from` price (included) to the next one, the prices are multiples of `tick`.
+template<typename price_type>
+struct tick_step final
+{
+  price_type from;
+  price_type tick;
 };
 
-struct step
+// A tick ladder: converts prices to and from a tick index, so that a distance on the ladder is an integer difference.
+template<typename price_type = tick_price>
+class tick_rule
 {
-	decimal from;
-	decimal tick;
+public:
+  static constexpr std::size_t max_nb_steps = 16;
+
+  using index_type = std::int32_t;
+
+  constexpr tick_rule(std::initializer_list<tick_step<price_type>> steps) noexcept: nb_steps(steps.size())
+  {
+    ASSERTS(steps.size() && steps.size() <= max_nb_steps);
+    std::copy(steps.begin(), steps.end(), this->steps.begin());
+    for(std::size_t i = 1; i < nb_steps; ++i)
+    {
+      ASSERTS(this->steps[i - 1].from < this->steps[i].from);
+      ASSERTS((this->steps[i].from - this->steps[i - 1].from).raw() % this->steps[i - 1].tick.raw() == 0);
+      first_index[i] = first_index[i - 1] + (this->steps[i].from - this->steps[i - 1].from) / this->steps[i - 1].tick;
+    }
+  }
 
-	constexpr decimal max()
-	{
-	}
+  constexpr price_type tick_size(const price_type &price) const noexcept { return steps[step_of(price)].tick; }
 
-	constexpr auto prefered_exponent()
-	{
-	}
+  constexpr bool is_on_tick(const price_type &price) const noexcept
+  {
+    const auto &step = steps[step_of(price)];
+    return (price - step.from).raw() % step.tick.raw() == 0;
+  }
+
+  // the index of the tick at or below the price
+  constexpr index_type to_index(const price_type &price) const noexcept
+  {
+    const auto step = step_of(price);
+    return first_index[step] + (price - steps[step].from) / steps[step].tick;
+  }
+
+  constexpr price_type from_index(index_type index) const noexcept
+  {
+    std::size_t step = 0;
+    while(step + 1 < nb_steps && first_index[step + 1] <= index)
+      ++step;
+    return steps[step].from + steps[step].tick * (index - first_index[step]);
+  }
+
+  constexpr price_type round_down(const price_type &price) const noexcept { return from_index(to_index(price)); }
+  constexpr price_type round_up(const price_type &price) const noexcept { return is_on_tick(price) ? price : from_index(to_index(price) + 1); }
+  constexpr price_type add_ticks(const price_type &price, index_type nb_ticks) const noexcept { return from_index(to_index(price) + nb_ticks); }
+
+private:
+  constexpr std::size_t step_of(const price_type &price) const noexcept
+  {
+    std::size_t step = 0;
+    while(step + 1 < nb_steps && steps[step + 1].from <= price)
+      ++step;
+    return step;
+  }
+
+  std::array<tick_step<price_type>, max_nb_steps> steps {};
+  std::array<index_type, max_nb_steps> first_index {};
+  std::size_t nb_steps;
 };
 
-template<step steps...>
-struct tick_rule
+namespace tick_rules
 {
-	decimal encode(auto value)
-	{
-		for(auto &&step: steps)
-		{
-		}
-	}
+constexpr tick_rule<> uniform(double tick) noexcept { return tick_rule<>({{tick_price(0.), tick_price(tick)}}); }
+
+// a typical equity ladder: the tick grows with the price
+constexpr tick_rule<> equity {
+  {tick_price(0.), tick_price(.0001)}, {tick_price(1.), tick_price(.0005)}, {tick_price(5.), tick_price(.001)}, {tick_price(10.), tick_price(.005)},
+  {tick_price(50.), tick_price(.01)},  {tick_price(100.), tick_price(.05)}, {tick_price(500.), tick_price(.1)},  {tick_price(1'000.), tick_price(.5)},
 };
+} // namespace tick_rules
+
+} // namespace feed
+
+#if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+
+TEST_SUITE("decimal")
+{
+  TEST_CASE("fixed_price_wire")
+  {
+    using price = feed::fixed_price<4>;
+
+    static_assert(price::from_decimal32_bits(price(1.5).to_decimal32_bits()) == price(1.5));
+    static_assert(price::from_decimal32_bits(price(-123.4567).to_decimal32_bits()) == price(-123.4567));
+    // more than 7 digits, but trailing zeros
+    static_assert(price::from_decimal32_bits(price(12'345.).to_decimal32_bits()) == price(12'345.));
+    // 1.5, as encoded by std::decimal::decimal32
+    static_assert(price::from_decimal32_bits(0x3200'000f) == price(1.5));
+    // 1.23456 and -1.23455: finer than the scale, rounded
+    static_assert(price::from_decimal32_bits(96u << 23 | 123'456) == price(1.2346));
+    static_assert(price::from_decimal32_bits(1u << 31 | 96u << 23 | 123'455) == price(-1.2346));
+    static_assert(price::from_decimal32_bits(96u << 23 | 123'449) == price(1.2345));
+
+    // out of range: saturated
+    static_assert(price(1e12) == price::max() && price(-1e12) == price::lowest());
+    static_assert(price(214'748.3647) == price::max());
+    static_assert(price::from_decimal32_bits(price(1.).to_decimal32_bits() + (20u << 23)) == price::max());
+    static_assert(price::from_decimal32_bits(1u << 31 | 191u << 23 | 1) == price::lowest());
+    static_assert(price::from_decimal32_bits(191u << 23) == price());
+    CHECK(price(std::numeric_limits<double>::quiet_NaN()) == price());
+    CHECK(price::from_float_bits(std::bit_cast<std::uint32_t>(1e12f)) == price::max());
+
+    CHECK(price::from_float_bits(price(99.95).to_float_bits()) == price(99.95));
+    CHECK(static_cast<float>(price(99.95)) == 99.95f);
+  }
+
+  TEST_CASE("tick_rule")
+  {
+    using feed::tick_price;
+    constexpr auto &rule = feed::tick_rules::equity;
+
+    static_assert(rule.tick_size(tick_price(.5)) == tick_price(.0001));
+    static_assert(rule.tick_size(tick_price(10.)) == tick_price(.005));
+    static_assert(rule.is_on_tick(tick_price(10.005)));
+    static_assert(!rule.is_on_tick(tick_price(10.001)));
+
+    // a step boundary is a tick of both steps
+    static_assert(rule.add_ticks(tick_price(9.999), 1) == tick_price(10.));
+    static_assert(rule.add_ticks(tick_price(10.), 1) == tick_price(10.005));
+    static_assert(rule.add_ticks(tick_price(10.), -1) == tick_price(9.999));
+    static_assert(rule.to_index(tick_price(10.005)) - rule.to_index(tick_price(9.998)) == 3);
+
+    static_assert(rule.round_down(tick_price(10.007)) == tick_price(10.005));
+    static_assert(rule.round_up(tick_price(10.007)) == tick_price(10.01));
+    static_assert(rule.round_up(tick_price(10.01)) == tick_price(10.01));
+
+    static_assert(feed::tick_rules::uniform(.5).add_ticks(tick_price(3'500.), 3) == tick_price(3'501.5));
+  }
+}
 
+// GCOVR_EXCL_STOP
+#endif // defined(DOCTEST_LIBRARY_INCLUDED)
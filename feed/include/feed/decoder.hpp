@@ -0,0 +1,44 @@
+#pragma once
+
+#include <feed/feed_structures.hpp>
+
+#include <boilerplate/chrono.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <concepts>
+#include <cstddef>
+
+// The shape of the decode stage, whatever the wire format: for each message of the datagram, the message header handler is given the instrument and
+// the sequence id, and returns a closure for the instrument (falsy to skip the message). Then the update handler is given the timestamp, each update
+// and the closure. A decoder returns the number of bytes consumed, and takes the snapshots of the instruments (stateful formats decode against them).
+// A format with snapshots on the wire (e.g. the refreshes of RWF) gives them to the message header handler instead: a state reset, as a snapshot from
+// the snapshot server is.
+
+namespace feed
+{
+namespace detail
+{
+// the least the handlers of a decoder may be
+struct message_header_handler_archetype
+{
+  instrument_state *operator()(instrument_id_type, sequence_id_type) const noexcept;
+  void operator()(instrument_id_type, const instrument_state &) const noexcept;
+};
+
+struct update_handler_archetype
+{
+  void operator()(const network_clock::time_point &, const update &, instrument_state *) const noexcept;
+};
+} // namespace detail
+
+template<typename decoder_type, typename message_header_handler_type = detail::message_header_handler_archetype,
+         typename update_handler_type = detail::update_handler_archetype>
+concept decoder = requires(decoder_type &decoder, message_header_handler_type &message_header_handler, update_handler_type &update_handler,
+                           const network_clock::time_point &timestamp, const asio::const_buffer &buffer, instrument_id_type instrument,
+                           const instrument_state &snapshot) {
+  { decoder(message_header_handler, update_handler, timestamp, buffer) } -> std::convertible_to<std::size_t>;
+  decoder.reset(instrument, snapshot);
+};
+
+} // namespace feed
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <feed/feed_fields.hpp>
+#if defined(TICK_PRICE)
+#include <feed/decimal.hpp>
+#endif // defined(TICK_PRICE)
 
 #include <boilerplate/contracts.hpp>
 #if !defined(LEAN_AND_MEAN)
@@ -22,13 +25,13 @@
 
 #include <range/v3/span.hpp>
 
-#if !defined(LEAN_AND_MEAN)
+#if !defined(LEAN_AND_MEAN) && !defined(TICK_PRICE)
 #if defined(__clang__)
 // TODO: use Intel RDFP Math library
 #else // defined(__clang__)
 #  include <decimal/decimal>
 #endif // defined(__clang__)
-#endif // !defined(LEAN_AND_MEAN)
+#endif // !defined(LEAN_AND_MEAN) && !defined(TICK_PRICE)
 
 #include <bitset>
 
@@ -41,7 +44,10 @@ namespace endian = boost::endian;
 // TYPES
 //
 
-#if defined(LEAN_AND_MEAN)
+// TICK_PRICE: integer prices, the wire format is left untouched (float if LEAN_AND_MEAN, decimal32 otherwise)
+#if defined(TICK_PRICE)
+using price_t = tick_price;
+#elif defined(LEAN_AND_MEAN)
 using price_t = float;
 #elif defined(__clang__) // defined(LEAN_AND_MEAN)
 using price_t = units::make_quantity_type<struct price_dimension, float>;
@@ -52,7 +58,9 @@ using quantity_t = std::uint32_t;
 
 namespace literals
 {
-#if defined(LEAN_AND_MEAN)
+#if defined(TICK_PRICE)
+  constexpr price_t operator""_p(long double value) { return price_t(static_cast<double>(value)); }
+#elif defined(LEAN_AND_MEAN)
   inline price_t operator""_p(long double value) { return static_cast<price_t>(value); }
 #elif defined(__clang__) // defined(LEAN_AND_MEAN)
   inline price_t operator""_p(long double value) { return price_t(static_cast<float>(value)); }
@@ -136,7 +144,11 @@ template<>
 inline price_t read_value<price_t>(const struct update &update) noexcept
 {
   auto value = read_value<std::uint32_t>(update);
-#if !defined(LEAN_AND_MEAN) && !defined(__clang__)
+#if defined(TICK_PRICE) && defined(LEAN_AND_MEAN)
+  return price_t::from_float_bits(value);
+#elif defined(TICK_PRICE)
+  return price_t::from_decimal32_bits(value);
+#elif !defined(LEAN_AND_MEAN) && !defined(__clang__)
   return price_t {std::decimal::decimal32 {reinterpret_cast<std::decimal::decimal32::__decfloat32 &>(value)}};
 #else  // !defined(LEAN_AND_MEAN) && !defined(__clang__)
   return price_t {reinterpret_cast<float &>(value)};
@@ -172,7 +184,11 @@ template<>
 inline update encode_update(enum field field, const price_t &value) noexcept
 {
   std::uint32_t result;
-#if defined(LEAN_AND_MEAN)
+#if defined(TICK_PRICE) && defined(LEAN_AND_MEAN)
+  result = value.to_float_bits();
+#elif defined(TICK_PRICE)
+  result = value.to_decimal32_bits();
+#elif defined(LEAN_AND_MEAN)
   reinterpret_cast<float &>(result) = value;
 #elif defined(__clang__) // defined(LEAN_AND_MEAN)
   reinterpret_cast<float &>(result) = value.get();
@@ -375,7 +391,7 @@ value_type get_update_poly(const instrument_state &state, enum field field) noex
   // clang-format off
 #define HANDLE_FIELD(r, _, elem) \
     case field::BOOST_PP_TUPLE_ELEM(0, elem): \
-      static_assert(std::is_nothrow_convertible_v<field_type_t<field::BOOST_PP_TUPLE_ELEM(0, elem)>, value_type>); \
+      static_assert(std::is_nothrow_constructible_v<value_type, field_type_t<field::BOOST_PP_TUPLE_ELEM(0, elem)>>); \
       return static_cast<value_type>(get_update(state, BOOST_PP_CAT(BOOST_PP_TUPLE_ELEM(0, elem), _c){}));
     BOOST_PP_SEQ_FOR_EACH(HANDLE_FIELD, _, FEED_FIELDS)
 #undef HANDLE_FIELD
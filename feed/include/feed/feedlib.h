@@ -22,6 +22,13 @@ extern "C"
   };
 
 
+  enum up_wire_version
+  {
+    wire_version_v1 = 1,
+    wire_version_v2 = 2
+  };
+
+
   //
   // state
 
@@ -47,6 +54,11 @@ extern "C"
   void up_encoder_free(struct up_encoder *self);
   size_t up_encoder_encode(struct up_encoder *self, up_timestamp_t timestamp, const struct up_state *const states[], size_t nb_states,
                            void *buffer, size_t buffer_size);
+  // parallel arrays of updates, ordered by timestamp: each timestamp makes events, each run of an instrument a message (its sequence id following
+  // the previous one). Whole timestamps are encoded while they surely fit, consumed gets the number of updates encoded.
+  size_t up_encoder_encode_bulk(struct up_encoder *self, const up_timestamp_t timestamps[], const up_instrument_id_t instruments[],
+                                const uint8_t fields[], const double values[], size_t nb_updates, void *buffer, size_t buffer_size, size_t *consumed);
+  void up_encoder_set_wire_version(struct up_encoder *self, enum up_wire_version version, bool instrument_base);
 
 
   //
@@ -59,6 +71,44 @@ extern "C"
   struct up_decoder *up_decoder_new(up_on_message_t on_message, void *user_data);
   void up_decoder_free(struct up_decoder *self);
   size_t up_decoder_decode(struct up_decoder *self, const void *buffer, size_t buffer_size);
+  void up_decoder_reset(struct up_decoder *self, const struct up_state *state);
+
+  // columnar decoding of events (timestamp and packet, as captured): one row per update, the columns are plain arrays (Arrow primitive layouts).
+  // A null column is not filled.
+  struct up_columns
+  {
+    size_t capacity;
+    up_timestamp_t *timestamps;
+    up_instrument_id_t *instruments;
+    up_sequence_id_t *sequence_ids;
+    uint8_t *fields; // enum up_field
+    double *values;
+  };
+
+  // upper bound of the number of rows of the events
+  size_t up_events_nb_updates(const void *events, size_t events_size);
+  // decodes whole events while their rows fit, returns the number of rows; consumed gets the size of the decoded events
+  size_t up_decoder_decode_columns(struct up_decoder *self, const void *events, size_t events_size, struct up_columns *columns, size_t *consumed);
+
+
+  //
+  // replay
+
+  enum up_replay_mode
+  {
+    replay_real_time = 0,
+    replay_scaled = 1,
+    replay_as_fast_as_possible = 2,
+    replay_burst_preserving = 3
+  };
+
+  struct up_replay_statistics
+  {
+    uint64_t nb_packets;
+    uint64_t nb_batches;
+    int64_t max_lateness_ns;
+    int64_t mean_lateness_ns;
+  };
 
 
   //
@@ -81,13 +131,64 @@ extern "C"
 
   struct up_server;
 
+  // the server runs on its own thread, pinned to cpu unless negative, and busy polling if asked to. The functions are to be called from a single
+  // thread, the futures they return are completed by the server thread: the notify fd (an eventfd) is readable once up_server_next_completion has
+  // some to give. A completed future that no function returned holds an error without one (accepting the snapshot connections, or sending the first
+  // chunks of a push): it is the caller's to free. The commands do not wait for room: they fail (a null future, or false) while the server thread
+  // is behind, and the completions are only given back as up_server_next_completion drains them.
   struct up_server *up_server_new(const char *snapshot_host, const char *snapshot_service, const char *updates_host, const char *updates_service,
-                                  struct up_future *future);
+                                  int cpu, bool busy_poll, struct up_future *future);
   void up_server_free(struct up_server *self);
-  size_t up_server_poll(struct up_server *self, struct up_future *future);
+  int up_server_notify_fd(const struct up_server *self);
+  struct up_future *up_server_next_completion(struct up_server *self);
   struct up_future *up_server_push_update(struct up_server *self, const struct up_state *const states[], size_t nb_states);
-  struct up_future *up_server_replay(struct up_server *self, const void *buffer, size_t buffer_size);
-  void up_server_get_state(struct up_server *self, up_instrument_id_t instrument, struct up_state *state);
+  struct up_future *up_server_replay(struct up_server *self, const void *buffer, size_t buffer_size, enum up_replay_mode mode, double rate,
+                                     struct up_replay_statistics *statistics);
+  bool up_server_get_state(struct up_server *self, up_instrument_id_t instrument, struct up_state *state);
+  bool up_server_set_wire_version(struct up_server *self, enum up_wire_version version, bool instrument_base);
+
+
+  //
+  // capture
+
+  struct up_capture_writer;
+
+  struct up_capture_writer *up_capture_writer_new(const char *path, size_t block_size, struct up_future *future);
+  void up_capture_writer_free(struct up_capture_writer *self);
+  void up_capture_writer_write(struct up_capture_writer *self, const void *buffer, size_t buffer_size, struct up_future *future);
+  void up_capture_writer_close(struct up_capture_writer *self, struct up_future *future);
+
+  struct up_capture;
+
+  struct up_capture *up_capture_open(const char *path, struct up_future *future);
+  void up_capture_free(struct up_capture *self);
+  uint64_t up_capture_nb_events(const struct up_capture *self);
+  size_t up_capture_events(const struct up_capture *self, const void **data);
+  size_t up_capture_seek(const struct up_capture *self, up_timestamp_t timestamp, const void **data);
+  size_t up_capture_nb_blocks(const struct up_capture *self, up_instrument_id_t instrument);
+  size_t up_capture_instrument_block(const struct up_capture *self, up_instrument_id_t instrument, size_t n, const void **data);
+
+
+  //
+  // pcap
+
+  enum up_pcap_output
+  {
+    pcap_output_events = 0,
+    pcap_output_capture = 1
+  };
+
+  struct up_pcap_statistics
+  {
+    uint64_t nb_frames;
+    uint64_t nb_updates;
+    uint64_t nb_snapshots;
+    uint64_t nb_skipped;
+    uint64_t nb_gaps;
+  };
+
+  void up_pcap_ingest(const char *pcap_path, const char *output_path, enum up_pcap_output output, uint16_t updates_port, uint16_t snapshot_port,
+                      struct up_pcap_statistics *statistics, struct up_future *future);
 
 #if defined(__cplusplus)
 } // extern "C"
@@ -1,43 +1,173 @@
+#pragma once
 
+#if defined(USE_RTSDK)
 
-class decoder : public refinitiv::ema::access::OmmConsumerClient
+#include <feed/decoder.hpp>
+#include <feed/feed_structures.hpp>
+
+#include <boilerplate/boilerplate.hpp>
+#include <boilerplate/chrono.hpp>
+#include <boilerplate/likely.hpp>
+
+#include <asio/buffer.hpp>
+
+#include <rtr/rsslDataPackage.h>
+#include <rtr/rsslMessagePackage.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+// Refinitiv RWF as a feed::decoder, with the Transport API (ETA) decoding: the buffers are the messages returned by rsslRead. The streams are mapped
+// to instruments upfront, and the fields of the field lists to the feed fields. A refresh is a snapshot: it is given to the message header handler
+// as a state reset. An update without a sequence number follows on from the last message of its stream (no gap can be seen on such a stream).
+
+namespace feed::rtsdk
+{
+class decoder
 {
-    decoder(auto &&message_header_handler, auto &&update_handler)
-    {}
+public:
+  // field ids of the RDMFieldDictionary
+  static constexpr RsslFieldId bid = 22, ask = 25, bid_size = 30, ask_size = 31;
 
-    auto operator ()()
-    {
-        consumer.dispatch();
-    }
+  void subscribe(RsslInt32 stream_id, instrument_id_type instrument) noexcept { streams[stream_id] = {.instrument = instrument}; }
 
-protected:
-    void onUpdateMsg(const UpdateMsg &updateMsg, const OmmConsumerEvent &event)
-    {
-        cout << updateMsg << endl; // defaults to updateMsg.toString()
-    }
+  [[using gnu : always_inline, flatten, hot]] std::size_t operator()(auto &&message_header_handler, auto &&update_handler,
+                                                                     const network_clock::time_point &timestamp, const asio::const_buffer &buffer) noexcept
+  {
+    RsslBuffer rssl_buffer {.length = static_cast<RsslUInt32>(buffer.size()), .data = static_cast<char *>(const_cast<void *>(buffer.data()))};
+    RsslDecodeIterator iterator;
+    rsslClearDecodeIterator(&iterator);
+    rsslSetDecodeIteratorRWFVersion(&iterator, RSSL_RWF_MAJOR_VERSION, RSSL_RWF_MINOR_VERSION);
+    rsslSetDecodeIteratorBuffer(&iterator, &rssl_buffer);
 
-    void onStatusMsg(const StatusMsg &statusMsg, const OmmConsumerEvent &event)
+    RsslMsg message;
+    if(UNLIKELY(rsslDecodeMsg(&iterator, &message) != RSSL_RET_SUCCESS))
+      return buffer.size();
+    if(message.msgBase.containerType != RSSL_DT_FIELD_LIST
+       || (message.msgBase.msgClass != RSSL_MC_UPDATE && message.msgBase.msgClass != RSSL_MC_REFRESH))
+      return buffer.size();
+
+    const auto it = streams.find(message.msgBase.streamId);
+    if(UNLIKELY(it == streams.end()))
+      return buffer.size();
+    auto &stream = it->second;
+
+    // the state of the instrument replaced with the fields of the refresh, the sequence from there on
+    if(message.msgBase.msgClass == RSSL_MC_REFRESH) [[unlikely]]
     {
-        cout << statusMsg << endl; // defaults to statusMsg.toString()
+      instrument_state snapshot {};
+      snapshot.sequence_id = stream.sequence_id
+        = message.refreshMsg.flags & RSSL_RFMF_HAS_SEQ_NUM ? static_cast<sequence_id_type>(message.refreshMsg.seqNum) : stream.sequence_id + 1;
+      decode_fields(
+        iterator,
+        [&]([[maybe_unused]] const network_clock::time_point &timestamp, const update &update, [[maybe_unused]] auto closure) noexcept {
+          update_state(snapshot, update);
+        },
+        timestamp, nullptr);
+      message_header_handler(stream.instrument, std::as_const(snapshot));
+      return buffer.size();
     }
 
-    void onRefreshMsg(const RefreshMsg &refreshMsg, const OmmConsumerEvent &event)
+    const sequence_id_type sequence_id = stream.sequence_id
+      = message.updateMsg.flags & RSSL_UPMF_HAS_SEQ_NUM ? static_cast<sequence_id_type>(message.updateMsg.seqNum) : stream.sequence_id + 1;
+    const auto instrument_closure = message_header_handler(stream.instrument, sequence_id);
+    if(UNLIKELY(!instrument_closure))
+      return buffer.size();
+    decode_fields(iterator, update_handler, timestamp, instrument_closure);
+
+    return buffer.size();
+  }
+
+  // the sequence of the streams of the instrument from the snapshot on
+  void reset(instrument_id_type instrument, const instrument_state &snapshot) noexcept
+  {
+    for(auto &[stream_id, stream]: streams)
+      if(stream.instrument == instrument)
+        stream.sequence_id = snapshot.sequence_id;
+  }
+
+private:
+  struct stream_type
+  {
+    instrument_id_type instrument {};
+    sequence_id_type sequence_id = 0; // of the last message
+  };
+
+  static void decode_fields(RsslDecodeIterator &iterator, auto &&update_handler, const network_clock::time_point &timestamp,
+                            const auto &instrument_closure) noexcept
+  {
+    RsslFieldList field_list;
+    if(UNLIKELY(rsslDecodeFieldList(&iterator, &field_list, nullptr) != RSSL_RET_SUCCESS))
+      return;
+
+    RsslFieldEntry entry;
+    for(RsslRet ret; (ret = rsslDecodeFieldEntry(&iterator, &entry)) != RSSL_RET_END_OF_CONTAINER;)
     {
-        timestamp = clock::now();
-        const auto instrument_closure = message_header_handler(refreshMsg.getServiceName(), refreshMsg.getName());
-        if(UNLIKELY(!instrument_closure))
-            continue;
-
-        switch(refreshMsg.getPayload().getDataTyoe())
-        {
-            case DataType::FieldListEnum:
-                std::for_each(refreshMsg.getPayload().getFieldList(), update_handler(timestamp, update, instrument_closure));
-                break;
-            case DataType::NoDataEnum:
-                break;
-        }
+      if(UNLIKELY(ret != RSSL_RET_SUCCESS))
+        break;
+      switch(entry.fieldId)
+      {
+      case bid: handle_price(update_handler, timestamp, iterator, b0_v, instrument_closure); break;
+      case ask: handle_price(update_handler, timestamp, iterator, o0_v, instrument_closure); break;
+      case bid_size: handle_quantity(update_handler, timestamp, iterator, bq0_v, instrument_closure); break;
+      case ask_size: handle_quantity(update_handler, timestamp, iterator, oq0_v, instrument_closure); break;
+      default: break;
+      }
     }
+  }
+
+  static void handle_price(auto &update_handler, const network_clock::time_point &timestamp, RsslDecodeIterator &iterator, auto field,
+                           const auto &instrument_closure) noexcept
+  {
+    RsslReal real;
+    double value;
+    if(rsslDecodeReal(&iterator, &real) == RSSL_RET_SUCCESS && !real.isBlank && rsslRealToDouble(&value, &real) == RSSL_RET_SUCCESS)
+      update_handler(timestamp, encode_update(field, static_cast<price_t>(value)), instrument_closure);
+  }
+
+  static void handle_quantity(auto &update_handler, const network_clock::time_point &timestamp, RsslDecodeIterator &iterator, auto field,
+                              const auto &instrument_closure) noexcept
+  {
+    RsslUInt value;
+    if(rsslDecodeUInt(&iterator, &value) == RSSL_RET_SUCCESS)
+      update_handler(timestamp, encode_update(field, static_cast<quantity_t>(value)), instrument_closure);
+  }
+
+  std::unordered_map<RsslInt32, stream_type> streams {};
+};
+static_assert(feed::decoder<decoder>);
+
+} // namespace feed::rtsdk
+
+#  if defined(DOCTEST_LIBRARY_INCLUDED)
+// GCOVR_EXCL_START
+
+TEST_SUITE("rtsdk")
+{
+  TEST_CASE("rtsdk_decoder")
+  {
+    feed::rtsdk::decoder decoder;
+    decoder.subscribe(5, 1);
+
+    // not RWF: skipped
+    const std::array<std::byte, 4> garbage {};
+    std::size_t nb_calls = 0;
+    const auto message_header_handler = boilerplate::overloaded {
+      [&]([[maybe_unused]] feed::instrument_id_type instrument, [[maybe_unused]] feed::sequence_id_type sequence_id) noexcept -> feed::instrument_state * {
+        ++nb_calls;
+        return nullptr;
+      },
+      [&]([[maybe_unused]] feed::instrument_id_type instrument, [[maybe_unused]] const feed::instrument_state &snapshot) noexcept { ++nb_calls; }};
+    CHECK(decoder(message_header_handler, [&]([[maybe_unused]] auto &&...args) noexcept { ++nb_calls; }, network_clock::time_point(),
+                  asio::buffer(garbage)) == garbage.size());
+    CHECK(!nb_calls);
+  }
 }
 
-OmmConsumer consumer(OmmConsumerConfig("emaconfig.xml").operationModel(OmmConsumerConfig::UserDispatchEnum));
-consumer.registerClient(ReqMsg().serviceName("DIRECT_FEED").name("IBM.N"), client);
+// GCOVR_EXCL_STOP
+#  endif // defined(DOCTEST_LIBRARY_INCLUDED)
+
+#endif // defined(USE_RTSDK)
@@ -1,26 +1,43 @@
+#include <feed/binary/feed_capture.hpp>
+#include <feed/binary/feed_pcap.hpp>
 #include <feed/binary/feed_server.hpp>
 #include <feed/feed_structures.hpp>
 #include <feed/feedlib.h>
 
 #include <boilerplate/leaf.hpp>
+#include <boilerplate/spsc_ring_buffer.hpp>
 
 #include <asio/co_spawn.hpp>
+#include <asio/executor_work_guard.hpp>
 #include <asio/io_context.hpp>
 #include <asio/ip/tcp.hpp>
 #include <asio/ip/udp.hpp>
+#include <asio/post.hpp>
 #include <asio/use_future.hpp>
 
 #include <boost/range/iterator_range.hpp>
 
 #include <range/v3/span.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <limits>
+#include <pthread.h>
+#include <sched.h>
 #include <string_view>
+#include <sys/eventfd.h>
 #include <thread>
 #include <tuple>
+#include <type_traits>
+#include <unistd.h>
 #include <utility>
+#include <variant>
 #include <vector>
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -110,6 +127,23 @@ extern "C" __attribute__((visibility("default"))) void up_state_set_value_uint(u
 struct up_encoder
 {
   feed::state_map state_map {};
+  // reused from a call to the next: no allocation once warmed up
+  std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states {};
+
+  // one event per MTU-sized packet, all sharing the same timestamp
+  static std::byte *write_events(up_timestamp_t timestamp, const auto &packets, std::byte *target) noexcept
+  {
+    for(auto &&packet: packets)
+    {
+      auto *event = new(target) feed::detail::event {timestamp};
+      std::memcpy(&event->packet, packet.data(), packet.size());
+      target += offsetof(feed::detail::event, packet) + packet.size();
+    }
+    return target;
+  }
+
+  // the timestamp before each packet
+  static constexpr std::size_t event_header_size = offsetof(feed::detail::event, packet);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -122,21 +156,64 @@ extern "C" __attribute__((visibility("default"))) void up_encoder_free(up_encode
 extern "C" __attribute__((visibility("default"))) size_t up_encoder_encode(up_encoder *self, up_timestamp_t timestamp, const up_state *const states[],
                                                                            size_t nb_states, void *buffer, size_t buffer_size)
 {
-  std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states_;
-  states_.reserve(nb_states);
+  self->states.clear();
   for(const auto *state: ranges::make_span(states, nb_states))
-    states_.emplace_back(state->instrument, state->state);
-  auto result = self->state_map.update(states_);
-  if(result.size() == 0)
-    return 0;
+    self->states.emplace_back(state->instrument, state->state);
+  const auto packets = self->state_map.update(self->states);
+
+  std::size_t size = 0;
+  for(auto &&packet: packets)
+    size += offsetof(feed::detail::event, packet) + packet.size();
 
-  const auto size = result.size() + offsetof(feed::detail::event, packet);
   if(size < buffer_size)
+    up_encoder::write_events(timestamp, packets, static_cast<std::byte *>(buffer));
+  return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) size_t up_encoder_encode_bulk(up_encoder *self, const up_timestamp_t timestamps[],
+                                                                                const up_instrument_id_t instruments[], const uint8_t fields[],
+                                                                                const double values[], size_t nb_updates, void *buffer, size_t buffer_size,
+                                                                                size_t *consumed)
+{
+  auto *const buffer_begin = static_cast<std::byte *>(buffer), *const buffer_end = buffer_begin + buffer_size;
+  auto *target = buffer_begin;
+  std::size_t row = 0;
+  while(row < nb_updates)
   {
-    auto *target = new(buffer) feed::detail::event {timestamp};
-    std::memcpy(&target->packet, result.data(), result.size());
+    // the rows of a timestamp make a tick, each run of rows of an instrument a message
+    const auto timestamp = timestamps[row];
+    std::size_t tick_end = row;
+    self->states.clear();
+    for(; tick_end < nb_updates && timestamps[tick_end] == timestamp; ++tick_end)
+    {
+      if(self->states.empty() || std::get<0>(self->states.back()) != instruments[tick_end])
+        self->states.emplace_back(instruments[tick_end], feed::instrument_state {});
+      update_state_poly(std::get<1>(self->states.back()), static_cast<feed::field>(fields[tick_end]), values[tick_end]);
+    }
+
+    // the encoding moves the published states on: the tick is left for the next call if it may not fit
+    const auto remaining = static_cast<std::size_t>(buffer_end - target);
+    if(feed::state_map::max_encoded_size(self->states.size(), up_encoder::event_header_size) > remaining)
+      break;
+
+    // the packets are encoded in place, the timestamps go in the gaps left before them
+    const auto &bounds = self->state_map.update_into(self->states, target, remaining, up_encoder::event_header_size);
+    for(auto &&[offset, size]: bounds)
+      std::memcpy(target + offset - up_encoder::event_header_size, &timestamp, sizeof(timestamp));
+    if(!bounds.empty())
+      target += bounds.back().first + bounds.back().second;
+    row = tick_end;
   }
-  return size;
+
+  *consumed = row;
+  return static_cast<size_t>(target - buffer_begin);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) void up_encoder_set_wire_version(up_encoder *self, up_wire_version version, bool instrument_base)
+{
+  self->state_map.set_version(static_cast<feed::wire_version>(version), instrument_base);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -149,6 +226,7 @@ struct up_decoder
   void *user_data;
 
   up_state state;
+  feed::detail::delta_references references {};
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -170,6 +248,7 @@ extern "C" __attribute__((visibility("default"))) size_t up_decoder_decode(up_de
   } flush;
 
   return feed::decode(
+    self->references,
     [self, &flush](auto instrument_id, [[maybe_unused]] auto sequence_id) noexcept
     {
       std::exchange(flush, { .self = self });
@@ -185,6 +264,81 @@ extern "C" __attribute__((visibility("default"))) size_t up_decoder_decode(up_de
     network_clock::time_point(), asio::buffer(buffer, buffer_size));
 }
 
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) void up_decoder_reset(up_decoder *self, const up_state *state)
+{
+  self->references.reset(state->instrument, state->state);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) size_t up_events_nb_updates(const void *events, size_t events_size)
+{
+  size_t result = 0;
+  const auto *current = static_cast<const std::byte *>(events), *const end = current + events_size;
+  while(static_cast<std::size_t>(end - current) >= sizeof(feed::detail::event))
+  {
+    const auto *event = reinterpret_cast<const feed::detail::event *>(current); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto packet = asio::const_buffer(&event->packet, static_cast<std::size_t>(end - current) - offsetof(feed::detail::event, packet));
+    result += feed::detail::packet_nb_updates(packet);
+    current += offsetof(feed::detail::event, packet) + feed::detail::packet_size(packet);
+  }
+  return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) size_t up_decoder_decode_columns(up_decoder *self, const void *events, size_t events_size,
+                                                                                  up_columns *columns, size_t *consumed)
+{
+  size_t nb_rows = 0;
+  const auto *current = static_cast<const std::byte *>(events), *const end = current + events_size;
+  while(static_cast<std::size_t>(end - current) >= sizeof(feed::detail::event))
+  {
+    const auto *event = reinterpret_cast<const feed::detail::event *>(current); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto packet = asio::const_buffer(&event->packet, static_cast<std::size_t>(end - current) - offsetof(feed::detail::event, packet));
+    if(feed::detail::packet_nb_updates(packet) > columns->capacity - nb_rows)
+      break;
+
+    const auto timestamp = event->timestamp;
+    up_instrument_id_t instrument = 0;
+    up_sequence_id_t sequence_id = 0;
+    const auto size = feed::decode(
+      self->references,
+      [&](auto message_instrument, auto message_sequence_id) noexcept
+      {
+        instrument = message_instrument;
+        sequence_id = message_sequence_id;
+        return true;
+      },
+      [&]([[maybe_unused]] auto packet_timestamp, auto update, [[maybe_unused]] auto instrument_closure) noexcept
+      {
+        if(columns->timestamps)
+          columns->timestamps[nb_rows] = timestamp;
+        if(columns->instruments)
+          columns->instruments[nb_rows] = instrument;
+        if(columns->sequence_ids)
+          columns->sequence_ids[nb_rows] = sequence_id;
+        if(columns->fields)
+          columns->fields[nb_rows] = static_cast<uint8_t>(update.field);
+        if(columns->values)
+          columns->values[nb_rows] = feed::visit_update(
+            []([[maybe_unused]] auto field, auto value) noexcept
+            {
+              if constexpr(std::is_same_v<decltype(value), feed::price_t>)
+                return static_cast<double>(static_cast<float>(value));
+              else
+                return static_cast<double>(value);
+            },
+            update);
+        ++nb_rows;
+      },
+      network_clock::time_point(), packet);
+    current += offsetof(feed::detail::event, packet) + size;
+  }
+
+  *consumed = static_cast<size_t>(current - static_cast<const std::byte *>(events));
+  return nb_rows;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -257,15 +411,67 @@ auto make_handlers(up_future *future)
 } // namespace
 
 ///////////////////////////////////////////////////////////////////////////////
+// The server runs on its own thread, busy polling or blocked until there is something to do: the caller (a single thread) hands it commands through
+// a ring, and gets the completed futures back through another one, signalled on an eventfd. The pushes are sent one after the other, in order.
+// Neither side waits on the other: a command is refused when its ring is full, a completion kept aside until the caller drains some.
 struct up_server
 {
+  enum struct command_kind : std::uint8_t
+  {
+    push_update,
+    replay,
+    get_state,
+    set_wire_version
+  };
+
+  struct command
+  {
+    command_kind kind;
+    up_future *future = nullptr; // completed once run, if any
+
+    // push_update: the states follow the command
+    std::uint32_t nb_states = 0; // the future goes with the last chunk of states
+
+    // replay
+    asio::const_buffer events {};
+    feed::replay_parameters replay_parameters {};
+    up_replay_statistics *statistics = nullptr;
+
+    // get_state
+    up_instrument_id_t instrument = 0;
+    up_state *state = nullptr;
+    std::atomic_flag *done = nullptr;
+
+    // set_wire_version
+    feed::wire_version version = feed::wire_version::v1;
+    bool instrument_base = true;
+  };
+  static_assert(std::is_trivially_copyable_v<command> && std::is_trivially_copyable_v<up_state>);
+
+  static constexpr spsc_ring_buffer::size_t command_max_size = 64 * 1'024;
+  static constexpr auto completion_retry_period = std::chrono::milliseconds(1);
+  static constexpr std::uint32_t max_nb_states = (command_max_size - sizeof(command)) / sizeof(up_state);
+
+  struct push
+  {
+    std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states;
+    up_future *future;
+  };
+
   asio::io_context service {};
   struct feed::server server;
-  std::atomic_flag quit = false;
+  spsc_ring_buffer commands {1'024 * 1'024, command_max_size + 1};
+  spsc_ring_buffer completions {64 * 1'024, sizeof(up_future *) + 1};
+  int notify_fd = -1;
+  bool busy_poll = false;
+  std::atomic_bool quit = false;
+  std::deque<push> pushes {}; // server thread: the one in front being sent
+  std::deque<up_future *> overflow {}; // server thread: the completions the ring had no room for, in order
+  std::thread thread {};
 
   up_server(std::string_view snapshot_host, std::string_view snapshot_service, std::string_view updates_host, std::string_view updates_service,
-            up_future *future):
-    server(service)
+            int notify_fd, int cpu, bool busy_poll, up_future *future):
+    server(service), notify_fd(notify_fd), busy_poll(busy_poll)
   {
     asio::co_spawn(
       service,
@@ -284,94 +490,467 @@ struct up_server
             // __));
             BOOST_LEAF_CO_TRYV(server.connect(*snapshot_addresses.begin(), *updates_addresses.begin()));
             future->value = up_future::ok_v;
+            co_return boost::leaf::success();
+          },
+          make_handlers(future));
 
-            while(!quit.test(std::memory_order_acquire))
-              BOOST_LEAF_CO_TRYV(co_await server.accept_async());
+        // the future belongs to the caller once completed
+        const bool connected = std::holds_alternative<up_future::ok_t>(future->value);
+        complete(future);
+        if(!connected)
+          co_return;
 
+        up_future status {};
+        co_await boost::leaf::co_try_handle_all(
+          [&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>>
+          {
+            while(!quit.load(std::memory_order_acquire))
+              BOOST_LEAF_CO_TRYV(co_await server.accept_async());
             co_return boost::leaf::success();
           },
-          make_handlers(future));
-        co_return;
+          make_handlers(&status));
+        complete_status(std::move(status));
       },
       asio::detached);
+
+    thread = std::thread([this]() noexcept { run(); });
+    if(cpu >= 0)
+    {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpu, &cpu_set);
+      ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+    }
+  }
+
+  ~up_server()
+  {
+    quit.store(true, std::memory_order_release);
+    asio::post(service, []() noexcept {});
+    thread.join();
+    ::close(notify_fd);
+  }
+
+  // caller thread: false if the ring is full
+  [[nodiscard]] bool push(const command &command, const up_state *const states[] = nullptr) noexcept
+  {
+    const auto size = static_cast<spsc_ring_buffer::size_t>(sizeof(command) + command.nb_states * sizeof(up_state));
+    auto *const address = commands.producer_allocate(size);
+    if(!address) [[unlikely]]
+      return false;
+    std::memcpy(address, &command, sizeof(command));
+    for(std::uint32_t i = 0; i < command.nb_states; ++i)
+      std::memcpy(address + sizeof(command) + i * sizeof(up_state), states[i], sizeof(up_state));
+    commands.producer_commit(size);
+    commands.producer_flush();
+    if(!busy_poll)
+      asio::post(service, []() noexcept {}); // wakes the server thread up
+    return true;
+  }
+
+  up_future *next_completion() noexcept
+  {
+    const auto *address = completions.consumer_peek(sizeof(up_future *));
+    if(!address)
+      return nullptr;
+    up_future *result;
+    std::memcpy(&result, address, sizeof(result));
+    completions.consumer_commit(sizeof(result));
+    completions.consumer_flush();
+    return result;
+  }
+
+private:
+  // server thread
+  void run() noexcept
+  {
+    const auto work = asio::make_work_guard(service);
+    while(!quit.load(std::memory_order_acquire))
+    {
+      wait();
+      run_commands();
+    }
   }
 
-  ~up_server() { quit.notify_all(); }
+  // the completions ready, after the first one if not busy polling (a command posts one, see push). The completions kept aside are retried
+  // meanwhile
+  void wait() noexcept
+  {
+    std::error_code ignored;
+    if(!busy_poll)
+    {
+      if(overflow.empty())
+        service.run_one(ignored);
+      else
+        service.run_one_for(completion_retry_period);
+    }
+    service.poll(ignored);
+    flush_completions();
+  }
+
+  void run_commands() noexcept
+  {
+    while(const auto *address = commands.consumer_peek(sizeof(command)))
+    {
+      command command;
+      std::memcpy(&command, address, sizeof(command));
+      const auto size = static_cast<spsc_ring_buffer::size_t>(sizeof(command) + command.nb_states * sizeof(up_state));
+      const auto *record = commands.consumer_peek(size);
+      if(!record)
+        break;
+
+      // the other commands wait for the pushes before them, to keep the order
+      if(command.kind != command_kind::push_update)
+        while(!pushes.empty() && !quit.load(std::memory_order_acquire))
+          wait();
+
+      switch(command.kind)
+      {
+      case command_kind::push_update:
+      {
+        std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states;
+        states.reserve(command.nb_states);
+        for(std::uint32_t i = 0; i < command.nb_states; ++i)
+        {
+          up_state state;
+          std::memcpy(&state, record + sizeof(command) + i * sizeof(up_state), sizeof(state));
+          states.emplace_back(state.instrument, state.state);
+        }
+        pushes.push_back({.states = std::move(states), .future = command.future});
+        if(pushes.size() == 1)
+          asio::co_spawn(service, send_pushes(), asio::detached);
+        break;
+      }
+      case command_kind::replay:
+      {
+        // the replay busy-waits: it runs right away, serving snapshot requests and the state queries behind it while idle
+        commands.consumer_commit(size);
+        commands.consumer_flush();
+        boost::leaf::try_handle_all(
+          [&]() noexcept -> boost::leaf::result<void>
+          {
+            const auto replay_statistics = BOOST_LEAF_TRYX(server.replay(command.events, command.replay_parameters, [this]() noexcept {
+              run_queries();
+              flush_completions();
+            }));
+            if(command.statistics)
+              *command.statistics = {.nb_packets = replay_statistics.nb_packets,
+                                     .nb_batches = replay_statistics.nb_batches,
+                                     .max_lateness_ns = replay_statistics.max_lateness.count(),
+                                     .mean_lateness_ns = replay_statistics.mean_lateness().count()};
+            command.future->value = up_future::ok_v;
+            return boost::leaf::success();
+          },
+          make_handlers(command.future));
+        complete(command.future);
+        continue;
+      }
+      case command_kind::get_state: get_state(command); break;
+      case command_kind::set_wire_version: server.set_version(command.version, command.instrument_base); break;
+      }
+
+      commands.consumer_commit(size);
+    }
+    commands.consumer_flush();
+  }
+
+  // while a replay runs: the state queries in front, their caller blocked on them. The other commands wait for the replay, in order
+  void run_queries() noexcept
+  {
+    while(const auto *address = commands.consumer_peek(sizeof(command)))
+    {
+      command command;
+      std::memcpy(&command, address, sizeof(command));
+      if(command.kind != command_kind::get_state)
+        break;
+      get_state(command);
+      commands.consumer_commit(sizeof(command));
+    }
+    commands.consumer_flush();
+  }
+
+  void get_state(const command &command) noexcept
+  {
+    command.state->instrument = command.instrument;
+    command.state->state = server.at(command.instrument);
+    command.done->test_and_set(std::memory_order_release);
+    command.done->notify_one();
+  }
+
+  // one push at a time: the next one is encoded once the previous one is sent
+  boost::leaf::awaitable<void> send_pushes() noexcept
+  {
+    while(!pushes.empty())
+    {
+      auto &[states, future] = pushes.front();
+      up_future status {};
+      co_await boost::leaf::co_try_handle_all(
+        [&]() noexcept -> boost::leaf::awaitable<boost::leaf::result<void>>
+        {
+          BOOST_LEAF_CO_TRYV(co_await server.update_async(states));
+          if(future)
+            future->value = up_future::ok_v;
+          co_return boost::leaf::success();
+        },
+        make_handlers(future ? future : &status));
+      if(future)
+        complete(future);
+      else
+        complete_status(std::move(status));
+      pushes.pop_front();
+    }
+  }
+
+  // an error without a future (past the connection, or of the first chunks of states) completes one of its own, unknown to the caller
+  void complete_status(up_future &&status) noexcept
+  {
+    if(std::holds_alternative<std::string>(status.value))
+      complete(new up_future(std::move(status)));
+  }
+
+  // never blocks: a completion the ring has no room for is kept aside, and retried by wait
+  void complete(up_future *future) noexcept
+  {
+    overflow.push_back(future);
+    flush_completions();
+  }
+
+  void flush_completions() noexcept
+  {
+    if(overflow.empty())
+      return;
+    const auto nb_completions = overflow.size();
+    for(; !overflow.empty(); overflow.pop_front())
+    {
+      auto *const address = completions.producer_allocate(sizeof(up_future *));
+      if(!address) [[unlikely]]
+        break;
+      std::memcpy(address, &overflow.front(), sizeof(up_future *));
+      completions.producer_commit(sizeof(up_future *));
+    }
+    if(overflow.size() == nb_completions) [[unlikely]]
+      return;
+    completions.producer_flush();
+    ::eventfd_write(notify_fd, 1);
+  }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 extern "C" __attribute__((visibility("default"))) up_server *up_server_new(const char *snapshot_host, const char *snapshot_service, const char *updates_host,
-                                                                           const char *updates_service, up_future *future)
+                                                                           const char *updates_service, int cpu, bool busy_poll, up_future *future)
 {
-  return new up_server(snapshot_host, snapshot_service, updates_host, updates_service, future);
+  const auto notify_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(notify_fd < 0)
+  {
+    future->value = std::string("eventfd: ") + std::strerror(errno);
+    return nullptr;
+  }
+  return new up_server(snapshot_host, snapshot_service, updates_host, updates_service, notify_fd, cpu, busy_poll, future);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 extern "C" __attribute__((visibility("default"))) void up_server_free(up_server *self) { delete self; }
 
 ///////////////////////////////////////////////////////////////////////////////
-extern "C" __attribute__((visibility("default"))) size_t up_server_poll(up_server *self, up_future *future)
+extern "C" __attribute__((visibility("default"))) int up_server_notify_fd(const up_server *self) { return self->notify_fd; }
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) up_future *up_server_next_completion(up_server *self) { return self->next_completion(); }
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) up_future *up_server_push_update(up_server *self, const up_state *const states[], size_t nb_states)
 {
-  std::error_code error_code;
-  auto result = self->service.poll(error_code);
-  if(error_code)
+  auto *const result = up_future_new();
+  do
   {
-    std::ostringstream os;
-    os << "error_code " << error_code.value() << ":" << error_code.message();
-    future->value = os.str();
-  }
-  future->value = up_future::ok_v;
+    const auto nb_chunk_states = static_cast<std::uint32_t>(std::min<size_t>(nb_states, up_server::max_nb_states));
+    if(!self->push({.kind = up_server::command_kind::push_update, .future = nb_chunk_states == nb_states ? result : nullptr, .nb_states = nb_chunk_states},
+                   states)) [[unlikely]]
+    {
+      up_future_free(result);
+      return nullptr;
+    }
+    states += nb_chunk_states;
+    nb_states -= nb_chunk_states;
+  } while(nb_states);
   return result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-extern "C" __attribute__((visibility("default"))) up_future *up_server_push_update(up_server *self, const up_state *const states[], size_t nb_states)
+extern "C" __attribute__((visibility("default"))) up_future *up_server_replay(up_server *self, const void *buffer, size_t buffer_size, up_replay_mode mode,
+                                                                              double rate, up_replay_statistics *statistics)
 {
-  std::vector<std::tuple<feed::instrument_id_type, feed::instrument_state>> states_;
-  states_.reserve(nb_states);
-  for(const auto *state: ranges::make_span(states, nb_states))
-    states_.emplace_back(state->instrument, state->state);
+  static_assert(std::to_underlying(feed::replay_mode::burst_preserving) == replay_burst_preserving);
+
   auto *const result = up_future_new();
-  asio::co_spawn(
-    self->service,
-    [self, states = std::move(states_), result]() noexcept -> boost::leaf::awaitable<void> {
-      co_await boost::leaf::co_try_handle_all([&]() noexcept { return self->server.update_async(states); }, make_handlers(result));
+  if(!self->push({.kind = up_server::command_kind::replay,
+                  .future = result,
+                  .events = asio::buffer(buffer, buffer_size),
+                  .replay_parameters = {.mode = static_cast<feed::replay_mode>(mode), .rate = rate},
+                  .statistics = statistics})) [[unlikely]]
+  {
+    up_future_free(result);
+    return nullptr;
+  }
+  return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) bool up_server_get_state(up_server *self, up_instrument_id_t instrument, up_state *state)
+{
+  std::atomic_flag done;
+  if(!self->push({.kind = up_server::command_kind::get_state, .instrument = instrument, .state = state, .done = &done})) [[unlikely]]
+    return false;
+  done.wait(false, std::memory_order_acquire);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) bool up_server_set_wire_version(up_server *self, up_wire_version version, bool instrument_base)
+{
+  return self->push({.kind = up_server::command_kind::set_wire_version, .version = static_cast<feed::wire_version>(version), .instrument_base = instrument_base});
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+struct up_capture_writer
+{
+  feed::capture_writer writer;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) up_capture_writer *up_capture_writer_new(const char *path, size_t block_size, up_future *future)
+{
+  up_capture_writer *result = nullptr;
+  boost::leaf::try_handle_all(
+    [&]() noexcept -> boost::leaf::result<void>
+    {
+      BOOST_LEAF_AUTO(writer, feed::capture_writer::create(path, block_size ? block_size : feed::default_capture_block_size));
+      result = new up_capture_writer {std::move(writer)};
+      future->value = up_future::ok_v;
+      return boost::leaf::success();
     },
-    asio::detached);
+    make_handlers(future));
   return result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-extern "C" __attribute__((visibility("default"))) up_future *up_server_replay(up_server *self, const void *buffer, size_t buffer_size)
+extern "C" __attribute__((visibility("default"))) void up_capture_writer_free(up_capture_writer *self) { delete self; }
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) void up_capture_writer_write(up_capture_writer *self, const void *buffer, size_t buffer_size,
+                                                                               up_future *future)
 {
-  using clock_t = std::chrono::steady_clock;
-  using timer_t = asio::basic_waitable_timer<clock_t>;
+  boost::leaf::try_handle_all(
+    [&]() noexcept -> boost::leaf::result<void>
+    {
+      BOOST_LEAF_CHECK(self->writer.write(asio::buffer(buffer, buffer_size)));
+      future->value = up_future::ok_v;
+      return boost::leaf::success();
+    },
+    make_handlers(future));
+}
 
-  auto *const result = up_future_new();
-  asio::co_spawn(
-    self->service,
-    [self, buffer, buffer_size, result]() noexcept -> boost::leaf::awaitable<void>
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) void up_capture_writer_close(up_capture_writer *self, up_future *future)
+{
+  boost::leaf::try_handle_all(
+    [&]() noexcept -> boost::leaf::result<void>
     {
-      co_await boost::leaf::co_try_handle_all(
-        [&]() noexcept
-        {
-          return feed::replay_async([&](auto states) { return self->server.update_async(std::forward<decltype(states)>(states)); },
-                                    [&, clock_0 = clock_t::now()](auto timestamp) mutable -> boost::leaf::awaitable<boost::leaf::result<void>>
-                                    {
-                                      BOOST_LEAF_ASIO_CO_TRYV(co_await timer_t(self->service, clock_0 + timestamp).async_wait(_));
-                                      co_return boost::leaf::success();
-                                    },
-                                    asio::buffer(buffer, buffer_size));
-        },
-        make_handlers(result));
+      BOOST_LEAF_CHECK(self->writer.close());
+      future->value = up_future::ok_v;
+      return boost::leaf::success();
+    },
+    make_handlers(future));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+struct up_capture
+{
+  feed::capture_reader reader;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) up_capture *up_capture_open(const char *path, up_future *future)
+{
+  up_capture *result = nullptr;
+  boost::leaf::try_handle_all(
+    [&]() noexcept -> boost::leaf::result<void>
+    {
+      BOOST_LEAF_AUTO(reader, feed::capture_reader::open(path));
+      result = new up_capture {std::move(reader)};
+      future->value = up_future::ok_v;
+      return boost::leaf::success();
     },
-    asio::detached);
+    make_handlers(future));
   return result;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-extern "C" __attribute__((visibility("default"))) void up_server_get_state(up_server *self, up_instrument_id_t instrument, up_state *state)
+extern "C" __attribute__((visibility("default"))) void up_capture_free(up_capture *self) { delete self; }
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) uint64_t up_capture_nb_events(const up_capture *self) { return self->reader.header().nb_events; }
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) size_t up_capture_events(const up_capture *self, const void **data)
 {
-  state->instrument = instrument;
-  state->state = self->server.at(instrument);
+  const auto events = self->reader.events();
+  *data = events.data();
+  return events.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) size_t up_capture_seek(const up_capture *self, up_timestamp_t timestamp, const void **data)
+{
+  const auto events = self->reader.seek(timestamp);
+  *data = events.data();
+  return events.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) size_t up_capture_nb_blocks(const up_capture *self, up_instrument_id_t instrument)
+{
+  return static_cast<size_t>(self->reader.blocks_of(instrument).size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+extern "C" __attribute__((visibility("default"))) size_t up_capture_instrument_block(const up_capture *self, up_instrument_id_t instrument, size_t n,
+                                                                                    const void **data)
+{
+  const auto block_numbers = self->reader.blocks_of(instrument);
+  const auto block = self->reader.block(self->reader.blocks()[block_numbers[static_cast<std::ptrdiff_t>(n)]]);
+  *data = block.data();
+  return block.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+extern "C" __attribute__((visibility("default"))) void up_pcap_ingest(const char *pcap_path, const char *output_path, up_pcap_output output,
+                                                                      uint16_t updates_port, uint16_t snapshot_port, up_pcap_statistics *statistics,
+                                                                      up_future *future)
+{
+  boost::leaf::try_handle_all(
+    [&]() noexcept -> boost::leaf::result<void>
+    {
+      const feed::pcap_parameters parameters {.updates_port = updates_port, .snapshot_port = snapshot_port};
+      BOOST_LEAF_AUTO(pcap_statistics, output == pcap_output_capture ? feed::pcap_to_capture(pcap_path, output_path, parameters)
+                                                                     : feed::pcap_to_events(pcap_path, output_path, parameters));
+      if(statistics)
+        *statistics = {.nb_frames = pcap_statistics.nb_frames,
+                       .nb_updates = pcap_statistics.nb_updates,
+                       .nb_snapshots = pcap_statistics.nb_snapshots,
+                       .nb_skipped = pcap_statistics.nb_skipped,
+                       .nb_gaps = pcap_statistics.nb_gaps};
+      future->value = up_future::ok_v;
+      return boost::leaf::success();
+    },
+    make_handlers(future));
 }
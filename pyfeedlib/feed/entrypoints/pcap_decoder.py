@@ -8,7 +8,7 @@ from dpkt.ip import IP, IP_PROTO_UDP, IP_PROTO_TCP
 from dpkt.udp import UDP
 from dpkt.tcp import TCP
 
-from ..feed import Decoder, Field, Instrument, State
+from ..feed import Decoder, Field, Instrument, PcapOutput, State, pcap_ingest
 
 
 def main(argv=None):
@@ -17,9 +17,18 @@ def main(argv=None):
     parser.add_argument('--unbuffered', action='store_true')
     parser.add_argument('--snapshot-port', type=int, default=4400)
     parser.add_argument('--updates-port', type=int, default=4401)
+    output = parser.add_mutually_exclusive_group()
+    output.add_argument('--events', help='write the raw event stream, as replayed by player')
+    output.add_argument('--capture', help='write an indexed capture')
     args = parser.parse_args(argv)
 
     input_ = getattr(args, 'pcap-file')
+    if args.events or args.capture:
+        # native ingest, needs a regular file to map
+        output_path, output_kind = (args.events, PcapOutput.events) if args.events else (args.capture, PcapOutput.capture)
+        print(pcap_ingest(input_.name, output_path, output_kind, args.updates_port, args.snapshot_port))
+        return
+
     if args.unbuffered:
         input_ = getattr(input_, 'buffer', input_)
 
@@ -3,7 +3,7 @@
 import asyncio
 from argparse import ArgumentParser, FileType
 
-from ..feed import Address, Server
+from ..feed import Address, ReplayMode, Server
 
 
 def address(as_str) -> Address:
@@ -16,12 +16,17 @@ async def async_main(argv=None):
     parser.add_argument('scenario-file', type=FileType('rb'))
     parser.add_argument('--snapshot-address', type=address, default=Address('127.0.01', 4400))
     parser.add_argument('--update-address', type=address, default=Address('224.0.0.1', 4401))
+    parser.add_argument('--mode', type=lambda name: ReplayMode[name], choices=list(ReplayMode), default=ReplayMode.real_time)
+    parser.add_argument('--rate', type=float, default=1.0, help='speed factor for the scaled mode, from 0.1 to 100')
+    parser.add_argument('--cpu', type=int, default=-1, help='core to pin the server thread to')
+    parser.add_argument('--busy-poll', action='store_true', help='the server thread spins instead of blocking')
     args = parser.parse_args(argv)
     scenario_file = getattr(args, 'scenario-file')
 
-    server = Server(args.snapshot_address, args.update_address)
+    server = Server(args.snapshot_address, args.update_address, args.cpu, args.busy_poll)
     await server.connect()
-    await server.replay(scenario_file.read())
+    statistics = await server.replay(scenario_file.read(), args.mode, args.rate)
+    print(statistics)
 
 
 def main(argv=None):
@@ -1,8 +1,11 @@
 from abc import abstractmethod
 import asyncio
+import os
 from dataclasses import dataclass
 from enum import IntEnum, unique
-from typing import Any, Awaitable, Callable, Dict, Final, Optional, Tuple
+from typing import Any, Awaitable, Callable, Dict, Final, Iterator, Optional, Tuple
+
+import numpy
 
 from feedlib import lib as _feedlib
 from feedlib import ffi
@@ -18,6 +21,16 @@ class Address:
 
 
 Field = unique(IntEnum('Field', {member[len('field_'):]: value for member, value in vars(_feedlib).items() if member.startswith('field_')}))
+ReplayMode = unique(IntEnum('ReplayMode', {member[len('replay_'):]: value for member, value in vars(_feedlib).items() if member.startswith('replay_')}))
+WireVersion = unique(IntEnum('WireVersion', {member[len('wire_version_'):]: value for member, value in vars(_feedlib).items() if member.startswith('wire_version_')}))
+
+
+@dataclass
+class ReplayStatistics:
+    nb_packets: int
+    nb_batches: int
+    max_lateness_ns: int
+    mean_lateness_ns: int
 
 
 class State:
@@ -64,8 +77,9 @@ class State:
 
 
 class Encoder:
-    def __init__(self):
+    def __init__(self, wire_version: WireVersion = WireVersion.v1, instrument_base: bool = True):
         self._self = _feedlib.up_encoder_new()
+        _feedlib.up_encoder_set_wire_version(self._self, wire_version, instrument_base)
         self.__buffer = bytearray(256)
         self.__sequence_ids: Dict[Instrument, int] = {}
 
@@ -96,6 +110,26 @@ class Encoder:
             _feedlib.up_encoder_encode(self._self, timestamp, to_flush, len(to_flush), ffi.from_buffer(self.__buffer), n)
         return memoryview(self.__buffer[:n])
 
+    def encode_arrays(self, timestamps: numpy.ndarray, instruments: numpy.ndarray, fields: numpy.ndarray, values: numpy.ndarray) -> memoryview:
+        timestamps = numpy.ascontiguousarray(timestamps, numpy.uint64)
+        instruments = numpy.ascontiguousarray(instruments, numpy.uint16)
+        fields = numpy.ascontiguousarray(fields, numpy.uint8)
+        values = numpy.ascontiguousarray(values, numpy.float64)
+
+        result = bytearray()
+        consumed = ffi.new('size_t*')
+        row = 0
+        while row < len(timestamps):
+            n = _feedlib.up_encoder_encode_bulk(self._self, ffi.from_buffer('up_timestamp_t[]', timestamps[row:]), ffi.from_buffer('up_instrument_id_t[]', instruments[row:]),
+                                                ffi.from_buffer('uint8_t[]', fields[row:]), ffi.from_buffer('double[]', values[row:]), len(timestamps) - row,
+                                                ffi.from_buffer(self.__buffer), len(self.__buffer), consumed)
+            if not consumed[0]:  # a timestamp larger than the buffer
+                self.__buffer = bytearray(2 * len(self.__buffer))
+                continue
+            result += self.__buffer[:n]
+            row += consumed[0]
+        return memoryview(result)
+
 
 @ffi.def_extern()
 def pyfeedlib_up_on_message(state: State, user_data):
@@ -103,6 +137,32 @@ def pyfeedlib_up_on_message(state: State, user_data):
     decoder.on_message(State.borrow(state))
 
 
+@dataclass
+class Columns:
+    timestamp: numpy.ndarray
+    instrument: numpy.ndarray
+    sequence_id: numpy.ndarray
+    field: numpy.ndarray
+    value: numpy.ndarray
+
+    @classmethod
+    def with_capacity(cls, capacity: int) -> 'Columns':
+        return cls(numpy.empty(capacity, numpy.uint64), numpy.empty(capacity, numpy.uint16), numpy.empty(capacity, numpy.uint32), numpy.empty(capacity, numpy.uint8),
+                   numpy.empty(capacity, numpy.float64))
+
+    def __len__(self) -> int:
+        return len(self.timestamp)
+
+    def __getitem__(self, rows: slice) -> 'Columns':
+        return Columns(self.timestamp[rows], self.instrument[rows], self.sequence_id[rows], self.field[rows], self.value[rows])
+
+    def _as_up_columns(self) -> Tuple['struct up_columns*', Tuple[Any, ...]]:
+        # the buffers are only borrowed by the struct: they are to be kept alive along with it
+        buffers = (ffi.from_buffer('up_timestamp_t[]', self.timestamp), ffi.from_buffer('up_instrument_id_t[]', self.instrument),
+                   ffi.from_buffer('up_sequence_id_t[]', self.sequence_id), ffi.from_buffer('uint8_t[]', self.field), ffi.from_buffer('double[]', self.value))
+        return ffi.new('struct up_columns*', (len(self), *buffers)), buffers
+
+
 class Decoder:
     def __init__(self) -> None:
         self._handle = ffi.new_handle(self)
@@ -114,6 +174,16 @@ class Decoder:
     def decode(self, buffer: memoryview):
         _feedlib.up_decoder_decode(self._self, buffer, len(buffer))
 
+    def reset(self, state: State):
+        _feedlib.up_decoder_reset(self._self, state._self)
+
+    def decode_columns(self, events: memoryview) -> 'Columns':
+        columns = Columns.with_capacity(_feedlib.up_events_nb_updates(events, len(events)))
+        up_columns, _buffers = columns._as_up_columns()
+        consumed = ffi.new('size_t*')
+        nb_rows = _feedlib.up_decoder_decode_columns(self._self, events, len(events), up_columns, consumed)
+        return columns[:nb_rows]
+
     @abstractmethod
     def on_message(self, state: State):
         ...
@@ -143,34 +213,60 @@ class Future:
 
 
 class Server:
-    def __init__(self, snapshot: Address, update: Address):
+    def __init__(self, snapshot: Address, update: Address, cpu: int = -1, busy_poll: bool = False):
         self.__snapshot_address = snapshot
         self.__update_address = update
+        self.__cpu = cpu
+        self.__busy_poll = busy_poll
         self._self: Optional[_feedlib.up_server] = None
         self.__futures: Dict[up_future, asyncio.Future[None]] = {}
+        self.__error: Optional[Exception] = None
+
+    def __del__(self):
+        self.__close()
+
+    def __close(self):
+        if self._self is not None:
+            asyncio.get_event_loop().remove_reader(_feedlib.up_server_notify_fd(self._self))
+            _feedlib.up_server_free(self._self)
+            self._self = None
 
     async def connect(self):
         future = Future()
-        self._self = _feedlib.up_server_new(self.__snapshot_address.host.encode(), str(self.__snapshot_address.port).encode(), self.__update_address.host.encode(), str(self.__update_address.port).encode(), future._self)
-        asyncio.get_event_loop().create_task(self.__loop())
+        self._self = _feedlib.up_server_new(self.__snapshot_address.host.encode(), str(self.__snapshot_address.port).encode(), self.__update_address.host.encode(), str(self.__update_address.port).encode(), self.__cpu, self.__busy_poll, future._self)
+        if self._self == ffi.NULL:
+            self._self = None
+            future.check()
+        asyncio.get_event_loop().add_reader(_feedlib.up_server_notify_fd(self._self), self.__on_completions)
         try:
             await self.__wait(future._self)
         except Exception:
-            self._self = None
+            self.__close()
             raise
 
-    async def __loop(self):
-        while self._self is not None:
-
-            future = Future()
-            _feedlib.up_server_poll(self._self, future._self)
-            future.check()
-
-            for future, future_ in list(self.__futures.items()):
-                if _feedlib.up_future_is_set(future):
-                    del self.__futures[future]
-                    future_.set_result(None)
-            await asyncio.sleep(0.1)
+    def __on_completions(self):
+        try:
+            os.read(_feedlib.up_server_notify_fd(self._self), 8)
+        except BlockingIOError:
+            pass
+        while (future := _feedlib.up_server_next_completion(self._self)) != ffi.NULL:
+            future_ = self.__futures.pop(future, None)
+            if future_ is not None:
+                future_.set_result(None)
+                continue
+            # an error without a future: raised by the next call
+            try:
+                Future._check(future)
+            except RuntimeError as error:
+                self.__error = self.__error or error
+            finally:
+                _feedlib.up_future_free(future)
+
+    def __check(self):
+        assert(self._self is not None)
+        if (error := self.__error) is not None:
+            self.__error = None
+            raise error
 
     async def __wait(self, future: up_future):
         future_: Final[asyncio.Future[None]] = asyncio.Future()
@@ -178,13 +274,100 @@ class Server:
         await future_
         Future._check(future)
 
+    @staticmethod
+    def __pushed(result):
+        # the server thread is behind: the command is refused rather than waited for
+        if not result:
+            raise RuntimeError('up_server: command ring full')
+        return result
+
+    def set_wire_version(self, wire_version: WireVersion, instrument_base: bool = True):
+        self.__check()
+        self.__pushed(_feedlib.up_server_set_wire_version(self._self, wire_version, instrument_base))
+
     def get_state(self, instrument: Instrument) -> State:
-        assert(self._self is not None)
-        return _feedlib.up_server_get_state(self._self, instrument)
+        self.__check()
+        state = State.with_instrument(instrument)
+        self.__pushed(_feedlib.up_server_get_state(self._self, instrument, state._self))
+        return state
 
     async def push_update(self, states):
-        await self.__wait(_feedlib.up_server_push_update(self._self, states))
+        self.__check()
+        await self.__wait(self.__pushed(_feedlib.up_server_push_update(self._self, states)))
 
-    async def replay(self, buffer: memoryview):
-        assert(self._self is not None)
-        await self.__wait(_feedlib.up_server_replay(self._self, buffer, len(buffer)))
+    async def replay(self, buffer: memoryview, mode: ReplayMode = ReplayMode.real_time, rate: float = 1.0) -> ReplayStatistics:
+        self.__check()
+        statistics = ffi.new('struct up_replay_statistics*')
+        await self.__wait(self.__pushed(_feedlib.up_server_replay(self._self, buffer, len(buffer), mode, rate, statistics)))
+        return ReplayStatistics(statistics.nb_packets, statistics.nb_batches, statistics.max_lateness_ns, statistics.mean_lateness_ns)
+
+
+class CaptureWriter:
+    def __init__(self, path: str, block_size: int = 0):
+        future = Future()
+        self._self = _feedlib.up_capture_writer_new(path.encode(), block_size, future._self)
+        future.check()
+
+    def __del__(self):
+        if self._self is not None:
+            _feedlib.up_capture_writer_free(self._self)
+
+    def write(self, events: memoryview):
+        future = Future()
+        _feedlib.up_capture_writer_write(self._self, ffi.from_buffer(events), len(events), future._self)
+        future.check()
+
+    def close(self):
+        future = Future()
+        _feedlib.up_capture_writer_close(self._self, future._self)
+        future.check()
+
+
+class Capture:
+    def __init__(self, path: str):
+        future = Future()
+        self._self = _feedlib.up_capture_open(path.encode(), future._self)
+        future.check()
+
+    def __del__(self):
+        if self._self is not None:
+            _feedlib.up_capture_free(self._self)
+
+    def __len__(self) -> int:
+        return _feedlib.up_capture_nb_events(self._self)
+
+    def __view(self, size: int, data) -> memoryview:
+        return memoryview(ffi.buffer(data[0], size)) if size else memoryview(b'')
+
+    def events(self) -> memoryview:
+        data = ffi.new('const void**')
+        return self.__view(_feedlib.up_capture_events(self._self, data), data)
+
+    def seek(self, timestamp: int) -> memoryview:
+        data = ffi.new('const void**')
+        return self.__view(_feedlib.up_capture_seek(self._self, timestamp, data), data)
+
+    def blocks(self, instrument: Instrument) -> Iterator[memoryview]:
+        data = ffi.new('const void**')
+        for n in range(_feedlib.up_capture_nb_blocks(self._self, instrument)):
+            yield self.__view(_feedlib.up_capture_instrument_block(self._self, instrument, n, data), data)
+
+
+PcapOutput = unique(IntEnum('PcapOutput', {member[len('pcap_output_'):]: value for member, value in vars(_feedlib).items() if member.startswith('pcap_output_')}))
+
+
+@dataclass
+class PcapStatistics:
+    nb_frames: int
+    nb_updates: int
+    nb_snapshots: int
+    nb_skipped: int
+    nb_gaps: int
+
+
+def pcap_ingest(pcap_path: str, output_path: str, output: PcapOutput = PcapOutput.capture, updates_port: int = 4401, snapshot_port: int = 4400) -> PcapStatistics:
+    future = Future()
+    statistics = ffi.new('struct up_pcap_statistics*')
+    _feedlib.up_pcap_ingest(pcap_path.encode(), output_path.encode(), output, updates_port, snapshot_port, statistics, future._self)
+    future.check()
+    return PcapStatistics(statistics.nb_frames, statistics.nb_updates, statistics.nb_snapshots, statistics.nb_skipped, statistics.nb_gaps)